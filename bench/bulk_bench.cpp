@@ -0,0 +1,113 @@
+// Find-and-replace across a large document: the per-line replaces a diff
+// produces against the bulk ops pack_bulk turns them into, in wire bytes
+// and in time to pack and to merge on a receiver.
+// Run: ./build/synctext_bench_bulk [lines]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "synctext/codec.h"
+#include "synctext/merge.h"
+
+using namespace std;
+using namespace synctext;
+
+static uint32_t seed = 5;
+
+static uint32_t next(uint32_t n)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % n;
+}
+
+static double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static string replace_every(string s, const string &from, const string &to)
+{
+    for (size_t at = s.find(from); at != string::npos; at = s.find(from, at + to.size()))
+        s.replace(at, from.size(), to);
+    return s;
+}
+
+// Source-like lines; names[0] turns up on most of them, the others now and
+// then.
+static vector<string> make_document(size_t n, const vector<string> &names)
+{
+    vector<string> lines;
+    for (size_t i = 0; i < n; ++i)
+    {
+        string line = "    auto value" + to_string(i) + " = ";
+        line += next(10) < 9 ? names[0] + "->lookup(key" + to_string(next(100)) + ")" : string("compute()");
+        if (next(4) == 0)
+            line += " + " + names[1 + next(names.size() - 1)] + ".size()";
+        lines.push_back(line + ";");
+    }
+    return lines;
+}
+
+static size_t compressed_bytes(const vector<UpdateObject> &ops)
+{
+    vector<char> none;
+    return lz_compress(none, (const char *)ops.data(), ops.size() * sizeof(UpdateObject)).size();
+}
+
+// Merges ops into a fresh copy of before and checks it comes out as after.
+static double receive(const vector<string> &before, const vector<string> &after, const vector<UpdateObject> &ops,
+                      bool &same)
+{
+    vector<string> doc = before;
+    LineIndex index;
+    index.reset(doc.size());
+    auto start = chrono::steady_clock::now();
+    merge_updates(doc, index, {}, ops);
+    double ms = ms_since(start);
+    same = doc == after;
+    return ms;
+}
+
+static bool run(const char *what, const vector<string> &before, const vector<pair<string, string>> &renames)
+{
+    vector<string> after = before;
+    for (auto &line : after)
+        for (auto &r : renames)
+            line = replace_every(line, r.first, r.second);
+
+    LineIndex index;
+    index.reset(before.size());
+    vector<UpdateObject> ops = diff_lines(before, after, index, site_id("alice"), "alice");
+    auto start = chrono::steady_clock::now();
+    VersionVector base;
+    for (auto &u : ops)
+        witness(base, site_id("alice"), u.seq);
+    vector<UpdateObject> wire = pack_bulk(ops, after, index, base);
+    double pack_ms = ms_since(start);
+
+    bool lines_ok, bulk_ok;
+    double lines_ms = receive(before, after, ops, lines_ok);
+    double bulk_ms = receive(before, after, wire, bulk_ok);
+    printf("%s: %zu lines changed\n", what, ops.size());
+    printf("  per-line: %6zu ops, %9zu bytes raw, %8zu compressed, merge %7.1f ms%s\n", ops.size(),
+           ops.size() * sizeof(UpdateObject), compressed_bytes(ops), lines_ms, lines_ok ? "" : "  MISMATCH");
+    printf("  bulk:     %6zu ops, %9zu bytes raw, %8zu compressed, merge %7.1f ms%s; packed in %.1f ms\n",
+           wire.size(), wire.size() * sizeof(UpdateObject), compressed_bytes(wire), bulk_ms,
+           bulk_ok ? "" : "  MISMATCH", pack_ms);
+    return lines_ok && bulk_ok;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 50000;
+    vector<string> names = {"registry", "session", "transport", "scheduler"};
+    vector<string> doc = make_document(n, names);
+
+    bool ok = run("rename one name", doc, {{"registry", "catalog"}});
+    ok = run("rename three names", doc, {{"registry", "catalog"}, {"session", "conn"}, {"scheduler", "pool"}}) && ok;
+    ok = run("edit a prefix", doc, {{"->lookup(", "->find("}}) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+// Offset <-> (line, col) conversion: the LineOffsets treap against summing
+// line lengths over vector<string>, on a large document under edits.
+// Run: ./build/synctext_bench_offsets [lines] [queries]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "synctext/line_offsets.h"
+
+using namespace std;
+using namespace synctext;
+
+static uint32_t seed = 7;
+
+static uint32_t next(uint32_t n)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % n;
+}
+
+static double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// -------------------- Linear Baseline --------------------
+// What callers do without an index: walk the lines adding up lengths.
+static size_t linear_offset_of(const vector<string> &lines, size_t line)
+{
+    size_t offset = 0;
+    for (size_t i = 0; i < line; ++i)
+        offset += lines[i].size() + 1;
+    return offset;
+}
+
+static LinePos linear_locate(const vector<string> &lines, size_t offset)
+{
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        if (offset <= lines[i].size())
+            return {i, offset};
+        offset -= lines[i].size() + 1;
+    }
+    return {lines.size(), 0};
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    int queries = argc > 2 ? atoi(argv[2]) : 200;
+
+    // short lines stay in the string's inline buffer, so the baseline is
+    // measured at its best
+    vector<string> lines(n);
+    for (auto &line : lines)
+        line.assign(next(16), 'x');
+
+    auto start = chrono::steady_clock::now();
+    LineOffsets index;
+    index.reset(lines);
+    double build_ms = ms_since(start);
+
+    // edits: retype, insert and delete lines anywhere, keeping both in step;
+    // only the index's share is timed, the vector shifts are the baseline's
+    int edits = 2000;
+    double edit_ms = 0;
+    for (int i = 0; i < edits; ++i)
+    {
+        size_t pos = next(lines.size());
+        uint32_t kind = next(10);
+        if (kind < 6)
+            lines[pos].assign(next(16), 'y');
+        else if (kind < 8)
+            lines.insert(lines.begin() + pos, string(next(16), 'z'));
+        else
+            lines.erase(lines.begin() + pos);
+        start = chrono::steady_clock::now();
+        if (kind < 6)
+            index.set(pos, lines[pos].size());
+        else if (kind < 8)
+            index.insert(pos, lines[pos].size());
+        else
+            index.erase(pos);
+        edit_ms += ms_since(start);
+    }
+
+    vector<size_t> at_line(queries), at_offset(queries);
+    size_t bytes = index.bytes();
+    for (int q = 0; q < queries; ++q)
+    {
+        at_line[q] = next(lines.size());
+        at_offset[q] = ((size_t)next(1u << 24) << 24 | next(1u << 24)) % bytes;
+    }
+
+    size_t checksum_linear = 0, checksum_tree = 0;
+    start = chrono::steady_clock::now();
+    for (int q = 0; q < queries; ++q)
+    {
+        checksum_linear += linear_offset_of(lines, at_line[q]);
+        LinePos p = linear_locate(lines, at_offset[q]);
+        checksum_linear += p.line * 31 + p.col;
+    }
+    double linear_ms = ms_since(start);
+
+    // the tree repeats the query set until the timing is meaningful
+    int rounds = 1000;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r)
+        for (int q = 0; q < queries; ++q)
+        {
+            size_t sum = index.offset_of(at_line[q]);
+            LinePos p = index.locate(at_offset[q]);
+            if (r == 0)
+                checksum_tree += sum + p.line * 31 + p.col;
+        }
+    double tree_ms = ms_since(start) / rounds;
+
+    printf("%zu lines, %zu bytes, %d edits, %d query pairs (offset_of + locate)\n", lines.size(), bytes, edits,
+           queries);
+    printf("treap build %.0f ms, %d edits %.1f ms (%.2f us each), %.1f bytes/line\n", build_ms, edits, edit_ms,
+           edit_ms * 1000 / edits, (double)index.memory_bytes() / lines.size());
+    printf("approach        total ms    us/query pair\n");
+    printf("linear        %10.2f %14.2f\n", linear_ms, linear_ms * 1000 / queries);
+    printf("treap         %10.4f %14.3f   (%.0fx)\n", tree_ms, tree_ms * 1000 / queries, linear_ms / tree_ms);
+
+    if (index.size() != lines.size() || index.bytes() != linear_offset_of(lines, lines.size()) ||
+        checksum_linear != checksum_tree)
+    {
+        printf("MISMATCH: the index disagrees with the lines\n");
+        return 1;
+    }
+    return 0;
+}
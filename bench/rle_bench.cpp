@@ -0,0 +1,224 @@
+// Memory of the character sequence CRDT: run-length B-tree against one node
+// per character, replaying the same editing trace.
+// Run: ./build/synctext_bench_rle [edits]
+
+#include <malloc.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/run_sequence.h"
+
+using namespace std;
+using namespace synctext;
+
+// -------------------- Trace --------------------
+// A synthetic session shaped like recorded ones (e.g. the automerge-perf
+// paper trace): mostly typing one character at a cursor, backspaces,
+// selection deletes, pastes, and about one cursor jump in a hundred edits.
+struct Edit
+{
+    size_t pos;
+    size_t del; // characters removed at pos
+    string text; // then inserted at pos
+};
+
+static vector<Edit> make_trace(int edits)
+{
+    static const char alphabet[] = "etaoin shrdlu cmfwyp vbgkqjxz\n";
+    vector<Edit> trace;
+    trace.reserve(edits);
+    uint32_t seed = 2024;
+    auto next = [&](uint32_t n) {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % n;
+    };
+    size_t cursor = 0, length = 0;
+    for (int i = 0; i < edits; ++i)
+    {
+        uint32_t r = next(1000);
+        if (r < 10 && length > 0)
+            cursor = next(length + 1);
+
+        Edit e{cursor, 0, ""};
+        if (r < 100 && cursor > 0)
+        {
+            e.pos = --cursor; // backspace
+            e.del = 1;
+        }
+        else if (r < 115 && cursor < length)
+            e.del = min<size_t>(length - cursor, 5 + next(60)); // selection delete
+        else if (r < 125)
+        {
+            size_t n = 10 + next(200); // paste
+            for (size_t k = 0; k < n; ++k)
+                e.text += alphabet[next(sizeof(alphabet) - 1)];
+        }
+        else
+            e.text = alphabet[next(sizeof(alphabet) - 1)];
+        length += e.text.size() - e.del;
+        cursor += e.text.size();
+        trace.push_back(e);
+    }
+    return trace;
+}
+
+// -------------------- Per-character Baseline --------------------
+// What a straightforward RGA keeps: a list node per character with its id,
+// origin and tombstone flag, plus an id index. A cursor iterator makes local
+// typing O(1); jumps walk the list.
+class CharList
+{
+public:
+    CharList()
+    {
+        at = chars.insert(chars.end(), {DOC_START, DOC_START, 0, true});
+        index[key(DOC_START)] = at;
+    }
+
+    void apply(const Edit &e, uint32_t site)
+    {
+        seek(e.pos);
+        for (size_t k = 0; k < e.del; ++k)
+        {
+            auto it = next_visible(at);
+            it->deleted = true;
+        }
+        for (char c : e.text)
+        {
+            CharId id{site, ++clock};
+            at = chars.insert(next(at), {id, at->id, c, false});
+            index[key(id)] = at;
+            cursor++;
+        }
+    }
+
+    string text() const
+    {
+        string out;
+        for (const Char &c : chars)
+            if (!c.deleted)
+                out += c.c;
+        return out;
+    }
+
+private:
+    struct Char
+    {
+        CharId id, origin;
+        char c;
+        bool deleted;
+    };
+    typedef list<Char>::iterator Iter;
+
+    static uint64_t key(CharId id) { return (uint64_t)id.site << 32 | id.seq; }
+
+    Iter next_visible(Iter it)
+    {
+        do
+            ++it;
+        while (it->deleted);
+        return it;
+    }
+
+    // leaves at on the visible character before pos (the head for 0)
+    void seek(size_t pos)
+    {
+        if (pos < cursor / 2)
+        {
+            at = chars.begin();
+            cursor = 0;
+        }
+        while (cursor > pos)
+        {
+            do
+                --at;
+            while (at->deleted && at != chars.begin());
+            cursor--;
+        }
+        while (cursor < pos)
+        {
+            at = next_visible(at);
+            cursor++;
+        }
+    }
+
+    list<Char> chars;
+    unordered_map<uint64_t, Iter> index;
+    Iter at;
+    size_t cursor = 0;
+    uint32_t clock = 0;
+};
+
+// -------------------- Harness --------------------
+static size_t heap_in_use()
+{
+    return mallinfo2().uordblks;
+}
+
+struct Result
+{
+    string text;
+    size_t heap;
+    double ms;
+};
+
+static Result replay_runs(const vector<Edit> &trace, size_t &runs, size_t &estimate, size_t &total)
+{
+    size_t before = heap_in_use();
+    auto start = chrono::steady_clock::now();
+    RunSequence seq;
+    for (const Edit &e : trace)
+    {
+        if (e.del)
+            seq.erase(e.pos, e.del);
+        if (!e.text.empty())
+            seq.insert(e.pos, e.text, 1);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    size_t heap = heap_in_use() - before;
+    runs = seq.run_count();
+    estimate = seq.memory_bytes();
+    total = seq.total();
+    return {seq.text(), heap, ms};
+}
+
+static Result replay_chars(const vector<Edit> &trace)
+{
+    size_t before = heap_in_use();
+    auto start = chrono::steady_clock::now();
+    CharList list;
+    for (const Edit &e : trace)
+        list.apply(e, 1);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    size_t heap = heap_in_use() - before;
+    return {list.text(), heap, ms};
+}
+
+int main(int argc, char *argv[])
+{
+    int edits = argc > 1 ? atoi(argv[1]) : 120000;
+    vector<Edit> trace = make_trace(edits);
+
+    size_t runs = 0, estimate = 0, total = 0;
+    Result rle = replay_runs(trace, runs, estimate, total);
+    Result naive = replay_chars(trace);
+
+    printf("edits %d, %zu characters visible, %zu with tombstones, %zu runs\n", edits, rle.text.size(), total, runs);
+    printf("structure         heap bytes   bytes/char        ms\n");
+    printf("per-char list   %12zu %12.1f %9.1f\n", naive.heap, (double)naive.heap / total, naive.ms);
+    printf("rle b-tree      %12zu %12.1f %9.1f  (estimate %zu)\n", rle.heap, (double)rle.heap / total, rle.ms,
+           estimate);
+
+    if (rle.text != naive.text)
+    {
+        printf("MISMATCH: the two replays differ\n");
+        return 1;
+    }
+    return 0;
+}
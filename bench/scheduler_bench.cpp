@@ -0,0 +1,75 @@
+// Work-stealing scheduler throughput: many strands, 1 to 64 workers.
+// Run: ./build/synctext_bench_scheduler
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "synctext/scheduler.h"
+
+using namespace std;
+using namespace synctext;
+
+// Synthetic merge: splice a few replace ops into a 64-line document, the
+// same per-line work merge_updates does, without the file I/O.
+static size_t bench_merge_work(uint32_t seed)
+{
+    vector<string> doc(64, "The quick brown fox jumps over the lazy dog");
+    size_t sum = 0;
+    for (int k = 0; k < 5; ++k)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        string &line = doc[seed % doc.size()];
+        size_t sc = seed % line.size();
+        line = line.substr(0, sc) + "edit" + line.substr(min(line.size(), sc + 3));
+        sum += line.size();
+    }
+    return sum;
+}
+
+// Posts tasks to many strands and reports throughput per worker count;
+// also checks that every strand ran its tasks in order.
+int main()
+{
+    const int DOCS = 512, TASKS_PER_DOC = 400;
+    cout << "hardware threads: " << thread::hardware_concurrency() << "\n";
+    cout << "workers  docs  tasks    ms      tasks/s     speedup  steals\n";
+    double base = 0;
+    bool violated = false;
+    for (unsigned workers = 1; workers <= 64; workers *= 2)
+    {
+        Scheduler sched(workers);
+        vector<shared_ptr<Strand>> strands;
+        vector<long> next_seq(DOCS, 0);
+        std::atomic<long> done{0}, misordered{0}, sink{0};
+        for (int d = 0; d < DOCS; ++d)
+            strands.push_back(make_shared<Strand>(sched));
+
+        auto start = chrono::steady_clock::now();
+        for (int t = 0; t < TASKS_PER_DOC; ++t)
+            for (int d = 0; d < DOCS; ++d)
+                strands[d]->post([&, d, t] {
+                    if (next_seq[d]++ != t)
+                        misordered.fetch_add(1);
+                    sink.fetch_add(bench_merge_work(d * 131 + t), memory_order_relaxed);
+                    done.fetch_add(1, memory_order_release);
+                });
+        long total = (long)DOCS * TASKS_PER_DOC;
+        while (done.load(memory_order_acquire) < total)
+            this_thread::sleep_for(chrono::microseconds(200));
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        double rate = total / (ms / 1000.0);
+        if (workers == 1)
+            base = rate;
+        violated |= misordered.load() != 0;
+        printf("%7u %5d %6ld %8.1f %12.0f %9.2fx %7ld%s\n", workers, DOCS, total, ms, rate, rate / base,
+               sched.steals.load(), misordered.load() ? "  ORDER VIOLATION" : "");
+    }
+    return violated ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// Substring search on a large document: the trigram index against scanning
+// every line, plus what keeping the index costs per edit.
+// Run: ./build/synctext_bench_search [megabytes]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "synctext/search_index.h"
+
+using namespace std;
+using namespace synctext;
+
+static uint32_t seed = 11;
+
+static uint32_t next(uint32_t n)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % n;
+}
+
+static double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// -------------------- Text --------------------
+// Prose-like lines: words drawn from a Zipf-distributed vocabulary, so a
+// few words are everywhere and most are rare, as in real documents.
+struct Vocabulary
+{
+    vector<string> words;
+    vector<double> cumulative;
+
+    explicit Vocabulary(int n)
+    {
+        double total = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            string w;
+            int len = 2 + next(9);
+            for (int k = 0; k < len; ++k)
+                w += (char)('a' + next(26));
+            words.push_back(w);
+            total += 1.0 / (i + 1);
+            cumulative.push_back(total);
+        }
+        for (double &c : cumulative)
+            c /= total;
+    }
+
+    const string &pick()
+    {
+        double r = next(1 << 24) / double(1 << 24);
+        size_t lo = 0, hi = cumulative.size() - 1;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (cumulative[mid] < r)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return words[lo];
+    }
+};
+
+static string make_line(Vocabulary &vocab)
+{
+    string line;
+    size_t target = 30 + next(60);
+    while (line.size() < target)
+        line += (line.empty() ? "" : " ") + vocab.pick();
+    return line;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100;
+    Vocabulary vocab(50000);
+    vector<string> lines;
+    size_t bytes = 0;
+    while (bytes < megabytes << 20)
+    {
+        lines.push_back(make_line(vocab));
+        bytes += lines.back().size() + 1;
+    }
+    LineIndex index;
+    index.reset(lines.size());
+
+    auto start = chrono::steady_clock::now();
+    TrigramIndex trigrams;
+    trigrams.reset(lines, index);
+    double build_ms = ms_since(start);
+    SearchStats built = trigrams.stats();
+
+    printf("%zu MB, %zu lines; index built in %.0f ms: %zu trigrams, %zu postings, %.0f MB (%.1f bytes/line)\n",
+           bytes >> 20, lines.size(), build_ms, built.trigrams, built.postings, built.memory_bytes / 1048576.0,
+           (double)built.memory_bytes / lines.size());
+
+    // needles from rare to common, a phrase, and one that is nowhere
+    vector<string> needles = {vocab.words[40000], vocab.words[5000], vocab.words[500] + " " + vocab.words[700],
+                              vocab.words[20], "zzqzzq"};
+    printf("needle               hits   scan ms   index us   speedup\n");
+    for (auto &needle : needles)
+    {
+        start = chrono::steady_clock::now();
+        vector<SearchHit> scanned = scan_lines(needle, lines);
+        double scan_ms = ms_since(start);
+
+        int rounds = 20;
+        vector<SearchHit> found;
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+            found = trigrams.search(needle, lines, index);
+        double index_ms = ms_since(start) / rounds;
+
+        bool same = found.size() == scanned.size();
+        for (size_t i = 0; same && i < found.size(); ++i)
+            same = found[i].line == scanned[i].line && found[i].col == scanned[i].col;
+        printf("%-18s %6zu %9.1f %10.1f %9.1fx%s\n", needle.c_str(), found.size(), scan_ms, index_ms * 1000,
+               scan_ms / index_ms, same ? "" : "  MISMATCH");
+        if (!same)
+            return 1;
+    }
+
+    // edits: rewrite random lines and insert new ones, as merges would
+    int edits = 200000;
+    size_t memory_before = trigrams.stats().memory_bytes;
+    uint64_t ns_before = trigrams.stats().update_ns, updates_before = trigrams.stats().updates;
+    for (int i = 0; i < edits; ++i)
+    {
+        size_t pos = next(lines.size());
+        if (next(40) == 0)
+        {
+            LineId id = index.next_id(1);
+            index.insert(index.at(pos), id);
+            lines.insert(lines.begin() + pos + 1, make_line(vocab));
+            trigrams.set(id, lines[pos + 1]);
+        }
+        else
+        {
+            lines[pos] = make_line(vocab);
+            trigrams.set(index.at(pos), lines[pos]);
+        }
+    }
+    SearchStats after = trigrams.stats();
+    uint64_t updates = after.updates - updates_before;
+    printf("%d edits: %.2f us per update, index %+.1f MB (%+.0f bytes per op, %zu postings incl. stale)\n", edits,
+           (after.update_ns - ns_before) / 1000.0 / updates,
+           ((double)after.memory_bytes - memory_before) / 1048576.0,
+           ((double)after.memory_bytes - memory_before) / edits, after.postings);
+
+    vector<SearchHit> found = trigrams.search(needles[0], lines, index);
+    vector<SearchHit> scanned = scan_lines(needles[0], lines);
+    if (found.size() != scanned.size())
+    {
+        printf("MISMATCH after edits\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// A large paste end to end: diffing it, cutting its text into FRAME_TEXT
+// frames, assembling them on the receiver and merging the op, against the
+// 255 bytes an op's own field carries.
+// Run: ./build/synctext_bench_stream [megabytes]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "synctext/codec.h"
+#include "synctext/merge.h"
+#include "synctext/text_stream.h"
+
+using namespace std;
+using namespace synctext;
+
+static double ms_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+struct Received
+{
+    BatchHeader hdr;
+    TextChunk chunk;
+    const char *data;
+    size_t len;
+};
+
+static Received parse(const vector<char> &frame)
+{
+    Received r;
+    memcpy(&r.hdr, frame.data(), sizeof(r.hdr));
+    memcpy(&r.chunk, frame.data() + sizeof(r.hdr), sizeof(r.chunk));
+    r.data = frame.data() + sizeof(r.hdr) + sizeof(r.chunk);
+    r.len = r.hdr.payload_len - sizeof(r.chunk);
+    return r;
+}
+
+// Sends what diff_lines made of before -> after to a receiver holding
+// before; false if the receiver ends up with something else.
+static bool paste(const char *what, const vector<string> &before, const vector<string> &after)
+{
+    uint32_t site = site_id("alice");
+    LineIndex sender;
+    sender.reset(before.size());
+    auto start = chrono::steady_clock::now();
+    vector<OpText> texts;
+    vector<UpdateObject> ops = diff_lines(before, after, sender, site, "alice", COLUMNS_BYTES, &texts);
+    double diff_ms = ms_since(start);
+
+    start = chrono::steady_clock::now();
+    vector<shared_ptr<const vector<char>>> frames;
+    size_t streamed = 0;
+    for (auto &t : texts)
+    {
+        streamed += t.text.size();
+        for (size_t offset = 0; offset < t.text.size();)
+            frames.push_back(build_text_frame("doc", "alice", t, offset));
+    }
+    double frame_ms = ms_since(start);
+
+    // receiver: ops first, then the chunks as the transport hands them over
+    vector<string> doc = before;
+    LineIndex index;
+    index.reset(before.size());
+    TextAssembly texts_in;
+    vector<UpdateObject> ready;
+    for (auto &u : ops)
+        if (texts_in.admit(u))
+            ready.push_back(u);
+    start = chrono::steady_clock::now();
+    for (auto &frame : frames)
+    {
+        Received r = parse(*frame);
+        vector<UpdateObject> done = texts_in.add(site, r.chunk, r.data, r.len);
+        ready.insert(ready.end(), done.begin(), done.end());
+    }
+    double assemble_ms = ms_since(start);
+
+    const char *assembled = nullptr;
+    for (auto &u : ready)
+        if (const string *whole = texts_in.find(u))
+            assembled = whole->data();
+    start = chrono::steady_clock::now();
+    LineTracking track;
+    track.texts = &texts_in;
+    merge_updates(doc, index, {}, ready, track);
+    double merge_ms = ms_since(start);
+    for (auto &u : ready)
+        texts_in.drop(u);
+
+    bool moved = false;
+    for (auto &line : doc)
+        moved = moved || line.data() == assembled;
+
+    // what the op fields alone carry
+    vector<string> cut = before;
+    LineIndex cut_index;
+    cut_index.reset(before.size());
+    merge_updates(cut, cut_index, {}, ops);
+    size_t cut_bytes = 0, want = 0;
+    for (auto &line : cut)
+        cut_bytes += line.size();
+    for (auto &line : after)
+        want += line.size();
+
+    printf("%-22s %9.1f MB %7zu frames  diff %6.1f ms  frames %6.1f ms  assemble %6.1f ms (%5.0f MB/s)  "
+           "merge %6.1f ms%s\n",
+           what, streamed / 1048576.0, frames.size(), diff_ms, frame_ms, assemble_ms,
+           streamed / 1048576.0 / (assemble_ms / 1000), merge_ms, moved ? "  (line is the assembly buffer)" : "");
+    printf("%-22s fields alone: %zu of %zu bytes arrive\n", "", cut_bytes, want);
+    return doc == after;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100;
+    string big;
+    big.reserve(megabytes << 20);
+    while (big.size() < megabytes << 20)
+        big += "pasted text, é and 中 included; ";
+
+    vector<string> doc = {"first line", "second line", "third line"};
+    vector<string> pasted = doc;
+    pasted.insert(pasted.begin() + 1, big);
+    bool ok = paste("insert a long line", doc, pasted);
+
+    // a megabyte replaced into the middle of it
+    vector<string> edited = pasted;
+    edited[1] = big.substr(0, big.size() / 2) + string(1 << 20, 'r') + big.substr(big.size() / 2 + 4096);
+    ok = paste("replace inside it", pasted, edited) && ok;
+
+    if (!ok)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
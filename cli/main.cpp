@@ -0,0 +1,732 @@
+// Terminal front end for libsynctext.
+// Build: cmake -S . -B build && cmake --build build
+// Run: ./build/CRDT <user_id>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "synctext/persistence.h"
+#include "synctext/session.h"
+#include "synctext/stats.h"
+
+using namespace std;
+using namespace synctext;
+
+const int MAX_NOTIFICATIONS = 5;
+
+// -------------------- Globals (lock-free snapshot style) --------------------
+// shared_ptr snapshots (copy-on-write). We will use atomic_thread_fence for visibility.
+// Notifications are charged to MEM_NOTIFY.
+typedef std::pmr::vector<std::pmr::string> Notifications;
+std::shared_ptr<Notifications> recent_ptr = std::make_shared<Notifications>(tagged_resource(MEM_NOTIFY));
+
+// printing flag (atomic, used by safe_print)
+std::atomic_flag printing = ATOMIC_FLAG_INIT;
+
+// -------------------- Safe Print (Lock-free) --------------------
+void safe_print(const string &msg)
+{
+    while (printing.test_and_set(std::memory_order_acquire))
+        std::this_thread::yield();
+    cout << msg << endl;
+    printing.clear(std::memory_order_release);
+}
+
+// -------------------- Helper: append to recent notifications (copy-on-write) ----------
+void append_recent_notification(const string &msg)
+{
+    // copy current snapshot
+    atomic_thread_fence(memory_order_acquire);
+    auto cur = recent_ptr;
+    auto next = std::make_shared<Notifications>(*cur, tagged_resource(MEM_NOTIFY));
+    next->emplace_back(msg);
+    if (next->size() > MAX_NOTIFICATIONS)
+        next->erase(next->begin());
+    // publish
+    atomic_thread_fence(memory_order_release);
+    recent_ptr = next;
+}
+
+// -------------------- Terminal UI --------------------
+const char *log_color(LogKind kind)
+{
+    switch (kind)
+    {
+    case LogKind::Notice: return "\033[1;36m";
+    case LogKind::Local: return "\033[1;34m";
+    case LogKind::Remote: return "\033[1;32m";
+    case LogKind::Merge: return "\033[1;35m";
+    case LogKind::Warning: return "\033[1;33m";
+    case LogKind::Error: return "\033[1;31m";
+    default: return "";
+    }
+}
+
+void print_log(LogKind kind, const string &msg)
+{
+    const char *color = log_color(kind);
+    safe_print(*color ? color + msg + "\033[0m" : msg);
+}
+
+string now_string()
+{
+    time_t now = time(0);
+    string dt = ctime(&now);
+    if (!dt.empty() && dt.back() == '\n') dt.pop_back();
+    return dt;
+}
+
+// Cursors are found through doc.index, so the caller holds what guards it.
+void display_file(const Document &doc, const vector<string> &lines, const string &last_update)
+{
+    system("clear");
+    cout << "Document: " << doc.filename << endl;
+    cout << "Last updated: " << last_update << endl;
+    cout << "----------------------------------------" << endl;
+    vector<pair<long, Presence>> cursors;
+    for (auto &p : doc.presence.read())
+        cursors.push_back({doc.index.position(p.line), p});
+    for (int i = 0; i < (int)lines.size(); i++)
+    {
+        cout << "Line " << i << ": " << lines[i];
+        for (auto &c : cursors)
+            if (c.first == i)
+                cout << "   \033[1;36m<" << c.second.user_id << " @ col " << c.second.col << ">\033[0m";
+        cout << endl;
+    }
+    cout << "----------------------------------------" << endl;
+
+    // snapshot recent notifications and print
+    atomic_thread_fence(memory_order_acquire);
+    auto recent_snapshot = recent_ptr;
+    if (!recent_snapshot->empty())
+    {
+        cout << "\n--- Recent Notifications ---" << endl;
+        for (auto &msg : *recent_snapshot)
+            cout << "\033[1;33m" << msg << "\033[0m" << endl;
+        cout << "-----------------------------" << endl;
+    }
+
+    cout << "Monitoring for changes..." << endl;
+}
+
+void on_received(const Document &, const UpdateObject &upd)
+{
+    string what;
+    if (strcmp(upd.op_type, "insert") == 0)
+        what = " inserted, \"" + string(upd.new_content) + "\"";
+    else if (strcmp(upd.op_type, "delete") == 0)
+        what = " deleted, \"" + string(upd.old_content) + "\"";
+    else if (strcmp(upd.op_type, "bulk") == 0)
+        what = " on, \"" + string(upd.old_content) + "\" → \"" + string(upd.new_content) + "\" in " +
+               to_string(upd.start_col) + " line(s)";
+    else
+        what = ", cols " + to_string(upd.start_col) + "-" + to_string(upd.end_col) +
+               ", \"" + string(upd.old_content) + "\" → \"" + string(upd.new_content) + "\"";
+    if (upd.new_len)
+        what += " (" + to_string(upd.new_len) + " bytes, streamed)";
+    string msg = "[Received update from " + string(upd.user_id) +
+                 "] Line " + to_string(upd.line) + what + " @ " + string(upd.timestamp);
+
+    // append to recent notifications (copy-on-write)
+    append_recent_notification(msg);
+
+    print_log(LogKind::Remote, msg);
+}
+
+// Large bulk batches (pastes, catching up) get one line rather than one
+// per op, so they don't hold the terminal while edits come in.
+void on_received_bulk(const Document &doc, const vector<UpdateObject> &batch)
+{
+    if (batch.size() <= INTERACTIVE_MAX_OPS) // a bulk op or a streamed line: worth showing
+    {
+        for (auto &upd : batch)
+            on_received(doc, upd);
+        return;
+    }
+    int first = batch[0].line, last = batch[0].line;
+    size_t bytes = 0;
+    for (auto &upd : batch)
+    {
+        first = min(first, upd.line);
+        last = max(last, upd.line);
+        bytes += upd.new_len ? upd.new_len : strlen(upd.new_content);
+    }
+    string msg = "[Received " + to_string(batch.size()) + " update(s) from " + string(batch[0].user_id) +
+                 ", bulk] Lines " + to_string(first) + "-" + to_string(last) + ", " + to_string(bytes) +
+                 " bytes of new text @ " + string(batch[0].timestamp);
+    append_recent_notification(msg);
+    print_log(LogKind::Remote, msg);
+}
+
+// -------------------- Version History --------------------
+// spec: a version number, or @<epoch ms> for the version current then.
+void print_version(const Document &doc, const string &spec)
+{
+    Version v;
+    VersionLookup found = VERSION_UNKNOWN;
+    if (!spec.empty() && spec[0] == '@')
+        found = doc.versions.at_time(atoll(spec.c_str() + 1), v);
+    else if (!spec.empty())
+        found = doc.versions.at_version(strtoull(spec.c_str(), nullptr, 10), v);
+    if (found != VERSION_FOUND)
+    {
+        string why = found == VERSION_TRIMMED ? "Version " + spec + " of " + doc.name + " is no longer kept"
+                                              : "No version " + spec + " of " + doc.name;
+        safe_print(why + " (latest is " + to_string(doc.versions.latest()) + ", " +
+                   to_string(doc.versions.retained()) + " kept; see --versions)");
+        return;
+    }
+    time_t secs = v.time_ms / 1000;
+    string when = ctime(&secs);
+    when.erase(when.find_last_not_of('\n') + 1);
+    string out = doc.name + " at version " + to_string(v.number) + " (" + when + "):";
+    for (auto &line : v.lines.lines())
+        out += "\n  " + line;
+    safe_print(out);
+}
+
+// -------------------- Blame --------------------
+// spec: "<line> [count]", numbered like the document view.
+void print_blame(const Document &doc, const string &spec)
+{
+    stringstream ss(spec);
+    long line = -1, count = 1;
+    ss >> line >> count;
+    if (line < 0 || count < 1)
+    {
+        safe_print("Usage: blame <line> [count]");
+        return;
+    }
+    string out = doc.name + " lines " + to_string(line) + "-" + to_string(line + count - 1) + ":";
+    for (auto &span : doc.blame.blame(line, count))
+    {
+        string who = span.user_id.empty() ? string("(on disk)") : span.user_id;
+        if (!span.user_id.empty())
+        {
+            time_t secs = span.ts;
+            string when = ctime(&secs);
+            who += ", " + when.erase(when.find_last_not_of('\n') + 1);
+        }
+        string where = span.lines > 1 ? "lines " + to_string(span.line) + "-" + to_string(span.line + span.lines - 1)
+                                      : "line " + to_string(span.line);
+        if (span.len != string::npos)
+            where += " cols " + to_string(span.col) + "-" + to_string(span.col + span.len);
+        else if (span.col > 0)
+            where += " cols " + to_string(span.col) + "-";
+        out += "\n  " + where + ": " + who;
+    }
+    safe_print(out);
+}
+
+// -------------------- Search --------------------
+void print_search(Session &session, const shared_ptr<Document> &doc, const string &needle)
+{
+    if (needle.empty())
+    {
+        safe_print("Usage: search <text>");
+        return;
+    }
+    session.search(doc, needle, [doc, needle](const SearchResult &r) {
+        string out = "\"" + needle + "\" in " + doc->name + ": " + to_string(r.hits.size()) + " hit(s) in " +
+                     to_string(r.elapsed_ns / 1000) + " us" + (r.indexed ? "" : " (scanned)");
+        for (size_t i = 0; i < r.hits.size() && i < 20; ++i)
+            out += "\n  line " + to_string(r.hits[i].line) + " col " + to_string(r.hits[i].col);
+        if (r.hits.size() > 20)
+            out += "\n  ...";
+        if (r.stats.updates > 0)
+            out += "\n  index: " + to_string(r.stats.lines) + " lines, " + to_string(r.stats.trigrams) +
+                   " trigrams, " + to_string(r.stats.postings) + " postings, " +
+                   to_string(r.stats.memory_bytes / 1024) + " KiB; " + to_string(r.stats.updates) + " updates, " +
+                   to_string(r.stats.update_ns / r.stats.updates) + " ns each";
+        safe_print(out);
+    });
+}
+
+// -------------------- Peers --------------------
+void print_peers(const Document &doc)
+{
+    string out = "Peers sending to " + doc.name + ":";
+    auto stats = doc.inbound.stats();
+    for (auto &p : stats)
+        out += "\n  " + p.user_id + ": received " + to_string(p.received) + " (" + to_string(p.received_bulk) +
+               " bulk), merged " + to_string(p.merged) + ", queued " + to_string(p.queued) + " (" +
+               to_string(p.queued_bulk) + " bulk, " + to_string(p.spilled) + " on disk, max " +
+               to_string(p.max_queued) + ")" +
+               (p.rate ? ", capped at " + to_string(p.rate) + " ops/s " + to_string(p.capped) + " time(s)" : "");
+    if (stats.empty())
+        out += " (none yet)";
+    safe_print(out);
+}
+
+// -------------------- Cursor --------------------
+// spec: "<line> <col> [<sel_line> <sel_col>]", numbered like the document view.
+void set_cursor_from(Session &session, const shared_ptr<Document> &doc, const string &spec)
+{
+    stringstream ss(spec);
+    long line = -1, col = -1, sel_line = -1, sel_col = -1;
+    ss >> line >> col;
+    if (!(ss >> sel_line >> sel_col))
+    {
+        sel_line = line;
+        sel_col = col;
+    }
+    if (line < 0 || col < 0 || sel_line < 0 || sel_col < 0)
+    {
+        safe_print("Usage: cursor <line> <col> [<sel_line> <sel_col>]");
+        return;
+    }
+    session.set_cursor(doc, line, col, sel_line, sel_col);
+}
+
+// -------------------- Memory --------------------
+void print_memory(const string &title, const vector<pair<string, MemoryUsage>> &usage)
+{
+    string out = title + ":";
+    for (auto &u : usage)
+        out += "\n  " + u.first + ": " + to_string(u.second.live / 1024) + " KiB live, " +
+               to_string(u.second.peak / 1024) + " KiB peak, " + to_string(u.second.allocations) + " allocations";
+    safe_print(out);
+}
+
+void print_own_memory()
+{
+    vector<pair<string, MemoryUsage>> usage;
+    for (int t = 0; t < MEM_TAGS; ++t)
+        usage.push_back({mem_tag_name((MemTag)t), memory_usage((MemTag)t)});
+    print_memory("Memory by subsystem", usage);
+}
+
+// -------------------- Profile --------------------
+string short_count(double n)
+{
+    char buf[32];
+    if (n >= 1e9)
+        snprintf(buf, sizeof(buf), "%.1fG", n / 1e9);
+    else if (n >= 1e6)
+        snprintf(buf, sizeof(buf), "%.1fM", n / 1e6);
+    else if (n >= 1e3)
+        snprintf(buf, sizeof(buf), "%.1fk", n / 1e3);
+    else
+        snprintf(buf, sizeof(buf), "%.0f", n);
+    return buf;
+}
+
+// Per-call averages of each stage's counters; counters that could not be
+// opened are left out.
+void print_profile(const string &title, const vector<pair<string, StageStats>> &stages, uint32_t counters)
+{
+    string out = title + ":";
+    for (auto &st : stages)
+    {
+        const StageStats &s = st.second;
+        out += "\n  " + st.first + ": " + to_string(s.invocations) + " calls";
+        if (s.invocations == 0)
+            continue;
+        double n = s.invocations;
+        char times[96];
+        snprintf(times, sizeof(times), "; per call %.3f ms wall, %.3f ms CPU", s.wall_ns / n / 1e6,
+                 s.counts[PERF_CPU_NS] / n / 1e6);
+        out += times;
+        for (int c : {PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_MISSES, PERF_BRANCH_MISSES, PERF_PAGE_FAULTS})
+            if (counters & (1u << c))
+            {
+                out += ", " + short_count(s.counts[c] / n) + " " + perf_counter_name((PerfCounter)c);
+                if (c == PERF_INSTRUCTIONS && s.counts[PERF_CYCLES])
+                {
+                    char ipc[32];
+                    snprintf(ipc, sizeof(ipc), " (IPC %.2f)", (double)s.counts[PERF_INSTRUCTIONS] / s.counts[PERF_CYCLES]);
+                    out += ipc;
+                }
+            }
+    }
+    safe_print(out);
+}
+
+void print_own_profile()
+{
+    if (!profiling())
+    {
+        safe_print("Profiling is off (start with --profile)");
+        return;
+    }
+    vector<pair<string, StageStats>> stages;
+    for (int s = 0; s < PERF_STAGES; ++s)
+        stages.push_back({perf_stage_name((PerfStage)s), stage_stats((PerfStage)s)});
+    print_profile("Stages", stages, perf_counters());
+}
+
+// --stats: another process's segment, without starting a session
+int print_stats(const string &user_id)
+{
+    StatsSnapshot snap;
+    if (!read_stats(user_id, snap))
+    {
+        cerr << "No running session for " << user_id << endl;
+        return 1;
+    }
+    print_memory("Memory by subsystem (pid " + to_string(snap.pid) + ", " +
+                     to_string(now_ms() - snap.updated_ms) + " ms ago)",
+                 snap.memory);
+    if (snap.profiling)
+        print_profile("Stages", snap.stages, snap.counters);
+    return 0;
+}
+
+// -------------------- Daemon Control --------------------
+// One process serves many documents: the session's reactor reads the
+// control FIFO alongside its inotify watch and transport.
+string ctl_pipe_name(const string &user_id)
+{
+    return "/tmp/ctl_" + user_id;
+}
+
+void handle_control_command(Session &session, const string &line)
+{
+    stringstream ss(line);
+    string cmd, name;
+    ss >> cmd >> name;
+    if (cmd == "open" && !name.empty())
+        session.open(name);
+    else if (cmd == "close" && !name.empty())
+        session.close(name);
+    else if (cmd == "at" && !name.empty())
+    {
+        string spec;
+        ss >> spec;
+        if (auto doc = session.find(name))
+            print_version(*doc, spec);
+        else
+            safe_print("Not open: " + name);
+    }
+    else if (cmd == "search" && !name.empty())
+    {
+        string needle;
+        getline(ss >> ws, needle);
+        if (auto doc = session.find(name))
+            print_search(session, doc, needle);
+        else
+            safe_print("Not open: " + name);
+    }
+    else if (cmd == "blame" && !name.empty())
+    {
+        string spec;
+        getline(ss, spec);
+        if (auto doc = session.find(name))
+            print_blame(*doc, spec);
+        else
+            safe_print("Not open: " + name);
+    }
+    else if ((cmd == "undo" || cmd == "redo") && !name.empty())
+    {
+        auto doc = session.find(name);
+        if (!doc)
+            safe_print("Not open: " + name);
+        else if (cmd == "undo")
+            session.undo(doc);
+        else
+            session.redo(doc);
+    }
+    else if (cmd == "cursor" && !name.empty())
+    {
+        string spec;
+        getline(ss, spec);
+        if (auto doc = session.find(name))
+            set_cursor_from(session, doc, spec);
+        else
+            safe_print("Not open: " + name);
+    }
+    else if (cmd == "peers" && !name.empty())
+    {
+        if (auto doc = session.find(name))
+            print_peers(*doc);
+        else
+            safe_print("Not open: " + name);
+    }
+    else if (cmd == "memory")
+        print_own_memory();
+    else if (cmd == "profile")
+        print_own_profile();
+    else if (cmd == "list")
+    {
+        string names;
+        for (auto &doc : session.documents())
+            names += (names.empty() ? "" : ", ") + doc;
+        safe_print("Open documents: " + (names.empty() ? string("(none)") : names));
+    }
+    else if (!cmd.empty())
+        safe_print("Unknown command: " + line + " (use open <doc>, close <doc>, undo <doc>, redo <doc>, at <doc> <version|@ms>, blame <doc> <line> [count], search <doc> <text>, cursor <doc> <line> <col> [<sel_line> <sel_col>], peers <doc>, memory, profile, list)");
+}
+
+Detached control_loop(Session &session, int fd)
+{
+    Reactor &r = *session.reactor();
+    char buf[4096];
+    string pending;
+    while (true)
+    {
+        ssize_t n = co_await async_read(r, fd, buf, sizeof(buf));
+        if (n <= 0)
+        {
+            co_await SleepFor{r, chrono::milliseconds(100)};
+            continue;
+        }
+        pending.append(buf, n);
+        size_t nl;
+        while ((nl = pending.find('\n')) != string::npos)
+        {
+            handle_control_command(session, pending.substr(0, nl));
+            pending.erase(0, nl + 1);
+        }
+    }
+}
+
+void run_daemon(Session &session)
+{
+    string ctl = ctl_pipe_name(session.user_id());
+    if (mkfifo(ctl.c_str(), 0666) == -1 && errno != EEXIST)
+    {
+        perror("mkfifo control");
+        exit(1);
+    }
+    int ctl_fd = open(ctl.c_str(), O_RDONLY | O_NONBLOCK);
+    int ctl_keepalive = open(ctl.c_str(), O_WRONLY); // no EOF when clients disconnect
+    if (ctl_fd == -1 || ctl_keepalive == -1)
+    {
+        perror("open control");
+        exit(1);
+    }
+    safe_print("Daemon ready. Control: echo 'open <doc>' > " + ctl);
+
+    control_loop(session, ctl_fd);
+    session.run();
+}
+
+// -------------------- Main --------------------
+void print_usage()
+{
+    cerr << "Usage: ./CRDT <user_id> [--compress] [--daemon [doc]...]\n"
+            "       ./CRDT <user_id> --stats\n"
+            "       [--transport seqpacket]\n"
+            "       [--transport fifo|tcp|unix --listen <addr> [--peer <addr>]...]\n"
+            "       [--columns code-points|utf16|bytes] [--search-index] [--versions <count>|all]\n"
+            "       [--peer-rate [user=]<ops/s>]...\n"
+            "       [--memory-ceiling <MB> [--spill-dir <dir>]] [--profile]\n"
+            "  tcp addresses are host:port, unix addresses are socket paths\n";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        print_usage();
+        return 1;
+    }
+
+    SessionConfig cfg;
+    cfg.user_id = argv[1];
+    if (argc == 3 && string(argv[2]) == "--stats")
+        return print_stats(cfg.user_id);
+    bool daemon_mode = false;
+    vector<string> daemon_docs;
+    for (int i = 2; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--compress")
+            cfg.compress = true;
+        else if (arg == "--profile")
+            cfg.profile = true;
+        else if (arg == "--versions" && has_value)
+        {
+            string count = argv[++i];
+            cfg.versions_kept = count == "all" ? 0 : (size_t)strtoull(count.c_str(), nullptr, 10);
+            if (count != "all" && cfg.versions_kept == 0)
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (arg == "--search-index")
+            cfg.search_index = true;
+        else if (arg == "--daemon")
+        {
+            daemon_mode = true;
+            while (i + 1 < argc && argv[i + 1][0] != '-')
+                daemon_docs.push_back(argv[++i]);
+        }
+        else if (arg == "--transport" && has_value)
+        {
+            string kind = argv[++i];
+            if (kind == "fifo")
+                cfg.transport = TRANSPORT_FIFO;
+            else if (kind == "tcp")
+                cfg.transport = TRANSPORT_TCP;
+            else if (kind == "unix")
+                cfg.transport = TRANSPORT_UNIX;
+            else if (kind == "seqpacket")
+                cfg.transport = TRANSPORT_SEQPACKET;
+            else
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (arg == "--columns" && has_value)
+        {
+            string unit = argv[++i];
+            if (unit == "code-points")
+                cfg.columns = COLUMNS_CODE_POINTS;
+            else if (unit == "utf16")
+                cfg.columns = COLUMNS_UTF16;
+            else if (unit == "bytes")
+                cfg.columns = COLUMNS_BYTES;
+            else
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (arg == "--listen" && has_value)
+            cfg.listen_addr = argv[++i];
+        else if (arg == "--peer" && has_value)
+            cfg.peers.push_back(argv[++i]);
+        else if (arg == "--peer-rate" && has_value)
+        {
+            // "<ops/s>" for every peer, "<user>=<ops/s>" for one
+            string spec = argv[++i];
+            size_t eq = spec.find('=');
+            uint32_t rate = strtoul(spec.c_str() + (eq == string::npos ? 0 : eq + 1), nullptr, 10);
+            if (eq == string::npos)
+                cfg.peer_rate = rate;
+            else
+                cfg.peer_rates[spec.substr(0, eq)] = rate;
+        }
+        else if (arg == "--memory-ceiling" && has_value)
+            cfg.memory_ceiling = (size_t)strtoull(argv[++i], nullptr, 10) << 20;
+        else if (arg == "--spill-dir" && has_value)
+            cfg.spill_dir = argv[++i];
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    bool stream = cfg.transport == TRANSPORT_TCP || cfg.transport == TRANSPORT_UNIX;
+    if (stream && cfg.listen_addr.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    cfg.async = daemon_mode;
+
+    SessionHooks hooks;
+    hooks.log = print_log;
+    hooks.received = on_received;
+    hooks.received_bulk = on_received_bulk;
+    hooks.merged = [&](const Document &doc, size_t applied) {
+        if (daemon_mode)
+        {
+            // no full-screen view when serving many documents
+            print_log(LogKind::Merge, "[Merging complete] " + doc.name + ": applied " + to_string(applied) +
+                                          " update(s).");
+            return;
+        }
+        display_file(doc, doc.lines, now_string());
+        print_log(LogKind::Merge, "[Merging complete] Applied updates.");
+    };
+
+    signal(SIGPIPE, SIG_IGN);
+    Session session(cfg, hooks);
+    for (auto &name : daemon_mode ? daemon_docs : vector<string>{DEFAULT_DOC})
+        session.open(name);
+    try
+    {
+        session.start();
+    }
+    catch (const system_error &e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    if (daemon_mode)
+    {
+        run_daemon(session);
+        return 0;
+    }
+
+    auto doc = session.find(DEFAULT_DOC);
+    string filename = doc->filename;
+
+    // "undo", "redo", "at <version|@ms>", "blame <line> [count]",
+    // "search <text>", "cursor <line> <col> [<sel_line> <sel_col>]", "peers",
+    // "memory" and "profile" typed on stdin
+    thread([&session, doc] {
+        string line;
+        while (getline(cin, line))
+        {
+            if (line == "undo" || line == "u")
+                session.undo(doc);
+            else if (line == "redo" || line == "r")
+                session.redo(doc);
+            else if (line.rfind("at ", 0) == 0)
+                print_version(*doc, line.substr(3));
+            else if (line.rfind("blame ", 0) == 0)
+                print_blame(*doc, line.substr(6));
+            else if (line.rfind("search ", 0) == 0)
+                print_search(session, doc, line.substr(7));
+            else if (line.rfind("cursor ", 0) == 0)
+                set_cursor_from(session, doc, line.substr(7));
+            else if (line == "peers")
+                print_peers(*doc);
+            else if (line == "memory")
+                print_own_memory();
+            else if (line == "profile")
+                print_own_profile();
+        }
+    }).detach();
+
+    struct stat file_stat;
+    stat(filename.c_str(), &file_stat);
+    time_t last_mod_time = file_stat.st_mtime;
+    long long last_gc = now_ms();
+
+    while (true)
+    {
+        stat(filename.c_str(), &file_stat);
+        if (file_stat.st_mtime != last_mod_time)
+        {
+            last_mod_time = file_stat.st_mtime;
+            {
+                lock_guard<mutex> lock(doc->sync_m);
+                display_file(*doc, read_file(filename), now_string());
+            }
+            session.file_changed(doc);
+        }
+        if (now_ms() - last_gc >= GC_INTERVAL_MS)
+        {
+            session.collect_garbage(doc);
+            last_gc = now_ms();
+        }
+        this_thread::sleep_for(chrono::seconds(2));
+    }
+    return 0;
+}
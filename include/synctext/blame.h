@@ -0,0 +1,103 @@
+// Authorship ("blame") of every character, run-length encoded.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/memory.h"
+
+namespace synctext
+{
+
+struct BlameSpan
+{
+    std::string user_id; // empty: in the file before this session opened it
+    long ts;             // epoch seconds of the op that wrote it
+    size_t line;
+    size_t col, len; // len == npos: to the end of the line
+    size_t lines;    // whole lines covered (col == 0, len == npos); 1 otherwise
+};
+
+// -------------------- Blame Index --------------------
+// Who last wrote each character, kept as runs in an implicit treap keyed by
+// line. A run is either a block of whole lines written by one (user, ts) or
+// a single line holding column runs, whose last run reaches the end of the
+// line. Neighbouring runs by the same (user, ts) are merged, so memory is
+// proportional to the number of runs, and splices and queries are
+// O(log n) plus the runs they touch. Calls take a short lock, so blame can
+// be read from any thread while merges splice it.
+class BlameIndex
+{
+public:
+    BlameIndex();
+    BlameIndex(const BlameIndex &) = delete;
+    BlameIndex &operator=(const BlameIndex &) = delete;
+    ~BlameIndex();
+
+    // Forgets everything; n lines attributed to nobody.
+    void reset(size_t n);
+
+    void insert_lines(size_t pos, size_t count, const std::string &user_id, long ts);
+    void erase_lines(size_t pos, size_t count);
+
+    // On line pos, erased characters at col were replaced by inserted ones.
+    void replace(size_t pos, size_t col, size_t erased, size_t inserted, const std::string &user_id, long ts);
+
+    // Runs covering lines [line, line + count), in order.
+    std::vector<BlameSpan> blame(size_t line, size_t count) const;
+
+    size_t lines() const;
+    size_t run_count() const;
+    size_t memory_bytes() const;
+
+private:
+    static const uint32_t TO_END = UINT32_MAX; // column run reaching the end of the line
+
+    struct Author
+    {
+        uint32_t user; // into users
+        long ts;
+        bool operator==(const Author &o) const { return user == o.user && ts == o.ts; }
+    };
+    struct ColRun
+    {
+        uint32_t len;
+        Author by;
+    };
+    typedef std::vector<ColRun, TaggedAllocator<ColRun, MEM_DOCUMENT>> ColRuns;
+    struct Node
+    {
+        uint32_t lines; // 1 when cols is not empty
+        Author by;      // whole-line runs
+        ColRuns cols;
+        uint32_t prio;
+        size_t size; // lines in this subtree
+        Node *left, *right;
+    };
+
+    static size_t size_of(const Node *n) { return n ? n->size : 0; }
+    static void update(Node *n);
+    static Node *join(Node *a, Node *b);
+    void split(Node *t, size_t k, Node *&a, Node *&b); // a: first k lines
+    static Node *edge(Node *t, bool rightmost);
+    static void resize(Node *t, bool rightmost, long delta);
+    Node *make(uint32_t lines, Author by);
+    void destroy(Node *t);
+    Node *join_merging(Node *a, Node *b);
+    uint32_t intern(const std::string &user_id);
+    void collect(const Node *t, size_t base, size_t lo, size_t hi, std::vector<BlameSpan> &out) const;
+
+    mutable std::mutex m;
+    Node *root = nullptr;
+    size_t nodes = 0;
+    std::vector<std::string> users;
+    std::unordered_map<std::string, uint32_t> user_ids;
+    TaggedAllocator<Node, MEM_DOCUMENT> alloc;
+    uint32_t rng = 0x2545f491;
+};
+
+} // namespace synctext
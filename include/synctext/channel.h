@@ -0,0 +1,125 @@
+// Channel policies: one-way frame carriers for BasicEngine (see engine.h).
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/types.h>
+
+namespace synctext
+{
+
+// A channel provides
+//   bool send(const char *frame, size_t len);  false if the frame does not fit right now
+//   ssize_t receive(char *buf, size_t cap);    one whole frame, 0 if none is pending, -1 on error
+// with one sender and one receiver. Constructors throw std::system_error
+// if the kernel object can't be created.
+
+// -------------------- Pipe --------------------
+// An anonymous pipe, the kernel path the FIFO transport takes without the
+// name lookup. Frames are length-delimited by their BatchHeader.
+class PipeChannel
+{
+public:
+    PipeChannel();
+    PipeChannel(const PipeChannel &) = delete;
+    PipeChannel &operator=(const PipeChannel &) = delete;
+    ~PipeChannel();
+
+    bool send(const char *frame, size_t len);
+    ssize_t receive(char *buf, size_t cap);
+
+private:
+    int rfd = -1, wfd = -1;
+};
+
+// -------------------- Socket --------------------
+// A SOCK_SEQPACKET socketpair, as the seqpacket transport uses: the kernel
+// keeps frame boundaries.
+class SocketChannel
+{
+public:
+    SocketChannel();
+    SocketChannel(const SocketChannel &) = delete;
+    SocketChannel &operator=(const SocketChannel &) = delete;
+    ~SocketChannel();
+
+    bool send(const char *frame, size_t len);
+    ssize_t receive(char *buf, size_t cap);
+
+private:
+    int fds[2] = {-1, -1};
+};
+
+// -------------------- Shared-Memory Ring --------------------
+// Single-producer single-consumer byte ring in a shared mapping: each frame
+// is a 4-byte length and its bytes, wrapping at the end. No system calls
+// on the hot path, so send and receive are inline.
+struct RingControl
+{
+    alignas(64) std::atomic<uint64_t> head; // bytes ever written; producer only
+    alignas(64) std::atomic<uint64_t> tail; // bytes ever read; consumer only
+};
+
+class ShmRingChannel
+{
+public:
+    static const size_t RING_BYTES = 1 << 20; // power of two
+
+    // name: a POSIX shm name so another process can attach; nullptr maps
+    // an anonymous ring shared with children only.
+    explicit ShmRingChannel(const char *name = nullptr);
+    ShmRingChannel(const ShmRingChannel &) = delete;
+    ShmRingChannel &operator=(const ShmRingChannel &) = delete;
+    ~ShmRingChannel();
+
+    bool send(const char *frame, size_t len)
+    {
+        uint64_t head = ctl->head.load(std::memory_order_relaxed);
+        uint64_t tail = ctl->tail.load(std::memory_order_acquire);
+        if (RING_BYTES - (head - tail) < sizeof(uint32_t) + len)
+            return false;
+        uint32_t n = len;
+        copy_in(head, (const char *)&n, sizeof(n));
+        copy_in(head + sizeof(n), frame, len);
+        ctl->head.store(head + sizeof(n) + len, std::memory_order_release);
+        return true;
+    }
+
+    ssize_t receive(char *buf, size_t cap)
+    {
+        uint64_t tail = ctl->tail.load(std::memory_order_relaxed);
+        if (ctl->head.load(std::memory_order_acquire) == tail)
+            return 0;
+        uint32_t n;
+        copy_out(tail, (char *)&n, sizeof(n));
+        if (n > cap)
+            return -1;
+        copy_out(tail + sizeof(n), buf, n);
+        ctl->tail.store(tail + sizeof(n) + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    void copy_in(uint64_t pos, const char *src, size_t len)
+    {
+        size_t at = pos & (RING_BYTES - 1), first = len < RING_BYTES - at ? len : RING_BYTES - at;
+        memcpy(data + at, src, first);
+        memcpy(data, src + first, len - first);
+    }
+
+    void copy_out(uint64_t pos, char *dst, size_t len) const
+    {
+        size_t at = pos & (RING_BYTES - 1), first = len < RING_BYTES - at ? len : RING_BYTES - at;
+        memcpy(dst, data + at, first);
+        memcpy(dst + first, data, len - first);
+    }
+
+    RingControl *ctl = nullptr;
+    char *data = nullptr;
+    size_t mapped = 0;
+    std::string created; // shm name this side created and unlinks
+};
+
+} // namespace synctext
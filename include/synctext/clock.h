@@ -0,0 +1,60 @@
+// Clock policies: what goes in UpdateObject::ts and how LWW orders it.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// A clock policy provides
+//   long tick();             stamp for a local op, greater than any stamp seen so far
+//   void observe(long ts);   a remote op arrived carrying ts
+// Clocks belong to one engine and are used from one thread (its strand),
+// so they are plain members rather than atomics.
+
+// -------------------- Wall Clock --------------------
+// Epoch seconds, as diff_lines has always stamped ops. Two edits within the
+// same second tie and fall back to user_id.
+struct WallClock
+{
+    long tick() { return (long)(now_ms() / 1000); }
+    void observe(long) {}
+};
+
+// -------------------- Lamport Clock --------------------
+// Causal order only: an op is stamped after everything its author had seen,
+// but concurrent ops are ordered by who has seen more, not by real time.
+struct LamportClock
+{
+    long counter = 0;
+
+    long tick() { return ++counter; }
+    void observe(long ts) { counter = std::max(counter, ts); }
+};
+
+// -------------------- Hybrid Logical Clock --------------------
+// Physical milliseconds in the high bits and a logical counter in the low
+// 16: stays close to wall time but never goes backwards, and an op always
+// sorts after what its author had received.
+struct HybridClock
+{
+    static const int LOGICAL_BITS = 16;
+    long last = 0;
+
+    long tick()
+    {
+        long physical = (long)now_ms() << LOGICAL_BITS;
+        last = std::max(last + 1, physical);
+        return last;
+    }
+
+    void observe(long ts) { last = std::max(last, ts); }
+
+    static long long physical_ms(long ts) { return ts >> LOGICAL_BITS; }
+};
+
+} // namespace synctext
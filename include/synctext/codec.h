@@ -0,0 +1,74 @@
+// Batch framing and the LZ4-style codec with a preset dictionary.
+#pragma once
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// Dictionary agreed between sender and receiver; id 0 means none.
+struct WireDict
+{
+    std::vector<char> bytes;
+    uint32_t id = 0;
+};
+
+std::vector<char> lz_compress(const std::vector<char> &dict, const char *src, size_t len);
+bool lz_decompress(const std::vector<char> &dict, const char *src, size_t len, char *dst, size_t raw_len);
+uint32_t fnv1a(const char *p, size_t n);
+
+// Builds a dictionary of at most DICT_MAX_BYTES from a document snapshot.
+std::vector<char> train_dictionary(const std::vector<std::string> &lines);
+
+// Id of a dictionary trained for doc; the name is hashed in so ids of
+// different documents' dictionaries don't collide. Never 0.
+uint32_t dictionary_id(const std::string &doc, const std::vector<char> &bytes);
+
+std::vector<char> build_frame(const std::string &doc, const char *payload, size_t payload_len, uint16_t count,
+                              size_t raw_len, uint16_t flags, uint32_t dict_id = 0);
+
+// A frame to queue for sending, charged to MEM_QUEUES until its last
+// holder lets go.
+std::shared_ptr<const std::vector<char>> share_frame(std::vector<char> frame);
+
+// Turns a received frame payload back into ops; false if it cannot be decoded.
+// dict is the dictionary agreed with the sender (nullptr if none).
+bool decode_batch(const BatchHeader &hdr, const char *payload, size_t payload_len, std::vector<UpdateObject> &ops,
+                  const WireDict *dict);
+
+// The lane a batch travels in: bulk if it has more than INTERACTIVE_MAX_OPS
+// ops, a bulk op or an op whose text is streamed.
+Lane lane_of(const std::vector<UpdateObject> &ops);
+
+inline const size_t SEQPACKET_OPS_PER_FRAME = (SEQPACKET_MAX_FRAME - sizeof(BatchHeader)) / sizeof(UpdateObject);
+
+// Raw and compressed frames for one batch, each built the first time a
+// peer needs it so a broadcast compresses at most once. dict is null when
+// compression is off; the frames carry FRAME_BULK for LANE_BULK.
+struct BatchEncoder
+{
+    std::string doc;
+    const char *raw;
+    size_t raw_len;
+    uint16_t count;
+    const WireDict *dict;
+    uint16_t lane_flags;
+    std::shared_ptr<const std::vector<char>> raw_frame, packed_frame;
+    bool tried_packing = false;
+
+    BatchEncoder(const std::string &doc, const UpdateObject *ops, size_t n, const WireDict *dict, Lane lane)
+        : doc(doc), raw((const char *)ops), raw_len(n * sizeof(UpdateObject)), count(n), dict(dict),
+          lane_flags(lane == LANE_BULK ? FRAME_BULK : 0) {}
+
+    // peer_has_dict: the peer advertised (or acked) our wire dictionary
+    std::shared_ptr<const std::vector<char>> frame_for(bool peer_has_dict);
+};
+
+ssize_t read_full(int fd, void *buf, size_t len);
+
+} // namespace synctext
@@ -0,0 +1,48 @@
+// Conflict policies: how a batch of ops is folded into a document.
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "synctext/merge.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// A conflict policy provides
+//   static std::vector<UpdateObject> merge(std::vector<std::string> &doc, LineIndex &index,
+//                                          const std::vector<UpdateObject> &applied,
+//                                          const std::vector<UpdateObject> &incoming,
+//                                          const LineTracking &track = {});
+// with the contract of merge_updates: applied ops are already in doc, the
+// ops returned name lines not seen yet, and track follows doc.
+
+// Overlapping replaces on a line: the highest ts wins, the rest are
+// dropped. This is what sessions use and peers agree on over the wire.
+struct LwwLines
+{
+    static std::vector<UpdateObject> merge(std::vector<std::string> &doc, LineIndex &index,
+                                           const std::vector<UpdateObject> &applied,
+                                           const std::vector<UpdateObject> &incoming,
+                                           const LineTracking &track = {})
+    {
+        return merge_updates(doc, index, applied, incoming, track);
+    }
+};
+
+// Every replace survives: deletions are unioned and concurrent insertions
+// at the same column are ordered by (ts, user_id), so no edit is lost and
+// the result does not depend on arrival order.
+struct SequenceLines
+{
+    static std::vector<UpdateObject> merge(std::vector<std::string> &doc, LineIndex &index,
+                                           const std::vector<UpdateObject> &applied,
+                                           const std::vector<UpdateObject> &incoming,
+                                           const LineTracking &track = {})
+    {
+        return merge_sequence(doc, index, applied, incoming, track);
+    }
+};
+
+} // namespace synctext
@@ -0,0 +1,79 @@
+// One synced document: <user_id>_<name>.txt plus its pending op buffers.
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/blame.h"
+#include "synctext/codec.h"
+#include "synctext/inbound.h"
+#include "synctext/line_index.h"
+#include "synctext/line_offsets.h"
+#include "synctext/memory.h"
+#include "synctext/persistence.h"
+#include "synctext/presence.h"
+#include "synctext/search_index.h"
+#include "synctext/stability.h"
+#include "synctext/text_stream.h"
+#include "synctext/undo.h"
+#include "synctext/utf8.h"
+#include "synctext/versions.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+struct Strand;
+
+typedef std::vector<UpdateObject, TaggedAllocator<UpdateObject, MEM_QUEUES>> OpBuffer;
+
+struct Document
+{
+    std::string name;
+    std::string filename;
+    WireDict dict; // SessionConfig::compress; set before the document is published, id 0 if none
+    PeerQueues inbound; // remote ops as they arrive, per sender, until a merge takes them
+    // ops a merge must see next: deferred by the last one, or whose text just completed
+    std::shared_ptr<OpBuffer> recv = std::make_shared<OpBuffer>();
+    std::shared_ptr<OpBuffer> local = std::make_shared<OpBuffer>();
+
+    // content last seen on disk, written by every merge, and the ids of its
+    // lines. In async sessions both are touched only on the strand, in sync
+    // sessions under sync_m; rescan/remerge coalesce repeated requests into
+    // one queued task each.
+    std::vector<std::string> lines;
+    FileStamp on_disk; // the file as lines was last read from or written to it
+    MemoryCharge lines_held{MEM_DOCUMENT}; // about what lines holds; set whenever they are replaced
+    LineIndex index;
+    LineOffsets offsets; // byte offset of each line of lines
+    ColumnCache columns; // column <-> byte tables of lines, by line id
+    std::unique_ptr<TrigramIndex> trigrams; // SessionConfig::search_index
+    UndoHistory history; // our own edits
+    VersionLog versions; // every state lines has had; readable from any thread
+    BlameIndex blame;    // who wrote each character of lines; likewise
+    TextAssembly texts;  // long text arriving for remote ops, and the ops waiting for it
+    PresenceBoard presence; // our cursor in it, and everyone else's; SessionConfig::presence
+    std::vector<OpText> unsent_text; // long text of our ops still in local; guarded like lines
+    std::mutex sync_m;
+    long merges = 0;
+    std::shared_ptr<Strand> strand;
+    std::atomic<bool> rescan{false}, remerge{false}, collect{false};
+    std::atomic<bool> spilling{false}; // inbound went over SessionConfig::memory_ceiling; logged once
+
+    // tombstone collection, guarded like lines: the highest op seq merged
+    // per site, what peers have published, and bytes dropped so far
+    VersionVector seen;
+    StableFrontier frontier;
+    size_t reclaimed_bytes = 0;
+};
+
+typedef std::unordered_map<std::string, std::shared_ptr<Document>> DocTable;
+
+// Names travel in BatchHeader::doc and become part of a file name.
+bool valid_document_name(const std::string &name);
+
+} // namespace synctext
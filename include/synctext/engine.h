@@ -0,0 +1,114 @@
+// Compile-time sync engine: channel, clock and conflict policy are template
+// parameters, so every call on the op path is direct and can be inlined.
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "synctext/channel.h"
+#include "synctext/clock.h"
+#include "synctext/codec.h"
+#include "synctext/conflict.h"
+#include "synctext/line_index.h"
+#include "synctext/merge.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// One user's replica of one document. commit() turns a local edit into
+// stamped ops and sends them; poll() merges whatever peers sent. Frames are
+// the same BatchHeader frames the transports carry, uncompressed, and at
+// most SEQPACKET_MAX_FRAME bytes so every channel can take them.
+//
+// Session keeps its runtime-selected transport and merges with LwwLines
+// and WallClock; BasicEngine exists to compare policy combinations without
+// virtual dispatch in the numbers (bench/policy_bench.cpp).
+template <typename Channel, typename Clock, typename Conflict>
+class BasicEngine
+{
+public:
+    BasicEngine(std::string user_id, std::string doc, std::vector<std::string> lines)
+        : user(std::move(user_id)), site(site_id(user)), name(std::move(doc)), doc_lines(std::move(lines)),
+          rx(SEQPACKET_MAX_FRAME)
+    {
+        index.reset(doc_lines.size());
+    }
+
+    // The user changed the document to next. Returns the number of ops
+    // produced; frames the channel can't take yet are resent by flush().
+    size_t commit(Channel &out, const std::vector<std::string> &next)
+    {
+        std::vector<UpdateObject> ops = diff_lines(doc_lines, next, index, site, user);
+        for (auto &op : ops)
+            op.ts = clk.tick();
+        doc_lines = next;
+        for (size_t i = 0; i < ops.size(); i += SEQPACKET_OPS_PER_FRAME)
+        {
+            size_t n = std::min(SEQPACKET_OPS_PER_FRAME, ops.size() - i);
+            backlog.push_back(build_frame(name, (const char *)&ops[i], n * sizeof(UpdateObject), n,
+                                          n * sizeof(UpdateObject), 0));
+        }
+        flush(out);
+        return ops.size();
+    }
+
+    // Sends queued frames until the channel is full; true if none are left.
+    bool flush(Channel &out)
+    {
+        while (!backlog.empty() && out.send(backlog.front().data(), backlog.front().size()))
+            backlog.pop_front();
+        return backlog.empty();
+    }
+
+    // Merges every frame pending on in. Returns the number of ops applied;
+    // ops naming lines that have not arrived yet wait for the next poll.
+    size_t poll(Channel &in)
+    {
+        size_t applied = 0;
+        if (!waiting.empty())
+        {
+            batch.swap(waiting);
+            waiting = Conflict::merge(doc_lines, index, {}, batch);
+            applied += batch.size() - waiting.size();
+        }
+        ssize_t n;
+        while ((n = in.receive(rx.data(), rx.size())) > 0)
+        {
+            BatchHeader hdr;
+            if ((size_t)n < sizeof(hdr))
+                continue;
+            memcpy(&hdr, rx.data(), sizeof(hdr));
+            if (hdr.magic != BATCH_MAGIC || strncmp(hdr.doc, name.c_str(), sizeof(hdr.doc)) != 0 ||
+                !decode_batch(hdr, rx.data() + sizeof(hdr), n - sizeof(hdr), batch, nullptr))
+                continue;
+            for (auto &op : batch)
+                clk.observe(op.ts);
+            auto deferred = Conflict::merge(doc_lines, index, {}, batch);
+            applied += batch.size() - deferred.size();
+            waiting.insert(waiting.end(), deferred.begin(), deferred.end());
+        }
+        return applied;
+    }
+
+    const std::vector<std::string> &lines() const { return doc_lines; }
+    const LineIndex &line_index() const { return index; }
+    Clock &clock() { return clk; }
+    size_t pending_frames() const { return backlog.size(); }
+
+private:
+    std::string user;
+    uint32_t site;
+    std::string name;
+    std::vector<std::string> doc_lines;
+    LineIndex index;
+    Clock clk;
+    std::vector<char> rx;
+    std::vector<UpdateObject> batch, waiting;
+    std::deque<std::vector<char>> backlog;
+};
+
+} // namespace synctext
@@ -0,0 +1,122 @@
+// Remote ops waiting to merge, queued per sending peer so one peer's flood
+// can't hold everyone else's edits back.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "synctext/memory.h"
+#include "synctext/spill.h"
+#include "synctext/stability.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+struct PeerStats
+{
+    std::string user_id;
+    uint64_t received = 0; // ops queued since the document was opened
+    uint64_t received_bulk = 0;
+    uint64_t merged = 0;   // ops handed to a merge
+    uint64_t capped = 0;   // drains that left ops queued for the rate cap
+    size_t queued = 0;
+    size_t queued_bulk = 0;
+    size_t max_queued = 0;
+    size_t spilled = 0; // of queued, on disk
+    uint32_t rate = 0; // ops/s cap, 0 = none
+};
+
+// -------------------- Peer Queues --------------------
+// One FIFO per op author, drained deficit round robin: each round every
+// peer with ops queued may take INBOUND_QUANTUM more, so a drain of n ops
+// is shared evenly between the peers that have any, and a peer sending a
+// few ops at a time gets them all in the next merge however much another
+// has queued. A peer's own ops keep their order within a lane.
+//
+// Each lane has its own queues. Interactive ops go first: a drain that
+// finds some takes at most INBOUND_QUANTUM bulk ops besides, so merges
+// stay small while people type and bulk work still moves. They never pass
+// bulk ops the same peer sent before them, though: a merge only settles
+// the replaces it sees together, so one peer's ops must merge in order.
+//
+// A rate cap is a token bucket holding up to one second of ops: ops over
+// it stay queued (never dropped, every op must merge for peers to
+// converge) and leave as tokens come back.
+//
+// With a memory ceiling, ops queued beyond it move to disk: the queue
+// holding the most in memory gives up its oldest to its lane's SpillLog,
+// and drains read a queue's spilled ops back before its in-memory ones.
+// A burst the merger can't keep up with then costs latency, not RAM.
+//
+// Calls take a short lock: transports push from their threads while
+// merges drain.
+class PeerQueues
+{
+public:
+    // ops_per_sec for every peer (0 = uncapped), or for the user ids in
+    // overrides
+    void set_rates(uint32_t ops_per_sec, const std::unordered_map<std::string, uint32_t> &overrides);
+
+    // bytes of queued ops kept in memory (0 = no limit); more spill to a
+    // file in dir
+    void set_ceiling(size_t bytes, const std::string &dir);
+
+    void push(const UpdateObject *begin, const UpdateObject *end, Lane lane);
+
+    // Up to budget ops, interactive first, fairly shared and within rate
+    // caps, in the order each peer sent them.
+    std::vector<UpdateObject> drain(size_t budget, long long now_ms);
+
+    size_t size() const;           // ops queued
+    size_t spilled() const;        // of those, on disk
+    bool ready(long long now_ms) const; // some can be drained now
+
+    // seen, held back to just below each peer's oldest queued op (as
+    // integrated_frontier does for ops waiting to merge)
+    VersionVector hold_back(VersionVector seen) const;
+
+    std::vector<PeerStats> stats() const;
+
+private:
+    struct Peer
+    {
+        std::deque<UpdateObject, TaggedAllocator<UpdateObject, MEM_QUEUES>> ops[LANES]; // in memory, after any spilled
+        std::unique_ptr<SpillLog> spilled[LANES]; // the lane's oldest, once over the ceiling
+        uint32_t spilled_seq[LANES] = {};         // lowest seq spilled since the log last emptied
+        size_t deficit[LANES] = {};
+        bool active[LANES] = {}; // in the lane's round robin
+        uint64_t bulk_in = 0, bulk_out = 0; // bulk ops pushed and drained
+        // runs of the interactive queue: ops, and bulk_in when they came;
+        // a run waits until bulk_out catches up
+        std::deque<std::pair<size_t, uint64_t>, TaggedAllocator<std::pair<size_t, uint64_t>, MEM_QUEUES>> after_bulk;
+        double tokens = 0;       // shared by both lanes
+        long long refilled_ms = 0;
+        PeerStats stats;
+    };
+
+    uint32_t rate_for(const std::string &user_id) const;
+    void refill(Peer &p, long long now_ms) const;
+    void drain_lane(Lane lane, size_t budget, long long now_ms, std::vector<UpdateObject> &out,
+                    std::vector<uint32_t> &capped);
+    void spill_over();
+
+    mutable std::mutex m;
+    std::unordered_map<uint32_t, Peer> peers; // by site
+    std::deque<uint32_t> round[LANES];        // peers with ops queued, next turn first
+    uint32_t default_rate = 0;
+    std::unordered_map<std::string, uint32_t> rates;
+    size_t total = 0;
+    size_t on_disk = 0; // of total, in spill logs
+    size_t ceiling = 0; // ops
+    std::string spill_dir;
+};
+
+} // namespace synctext
@@ -0,0 +1,125 @@
+// Stable line identities and the order-statistic index that maps them to
+// positions in the document.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/memory.h"
+#include "synctext/stability.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// Site of the lines a document starts with: every peer numbers its initial
+// lines {0, 1..n}, so identical files start with identical ids.
+inline const uint32_t INITIAL_SITE = 0;
+inline const LineId DOC_START = {0, 0}; // insert at the top of the document
+
+inline bool operator==(LineId a, LineId b) { return a.site == b.site && a.seq == b.seq; }
+inline bool operator!=(LineId a, LineId b) { return !(a == b); }
+
+// Site of a user's lines; never INITIAL_SITE.
+uint32_t site_id(const std::string &user_id);
+
+// -------------------- Line Index --------------------
+// Every line ever inserted, deleted ones included as tombstones, in
+// document order. A treap keyed by implicit position keeps subtree counts
+// of all and of visible lines, so id -> position and position -> id are
+// O(log n).
+//
+// New ids take seq = 1 + the highest seq seen (a Lamport clock), and a
+// line inserted after P goes right after P, past any concurrent insert
+// after P with a greater (seq, site). Every peer therefore places
+// concurrent inserts the same way whatever order they arrive in (RGA).
+class LineIndex
+{
+public:
+    LineIndex() = default;
+    LineIndex(const LineIndex &) = delete;
+    LineIndex &operator=(const LineIndex &) = delete;
+
+    // Forgets everything and numbers n initial lines.
+    void reset(size_t n);
+
+    LineId next_id(uint32_t site) { return {site, ++clock}; }
+
+    // Moves the clock past a remote op's seq.
+    void witness(uint32_t seq) { clock = seq > clock ? seq : clock; }
+
+    // Places id after `after` (DOC_START: first line). Returns its visible
+    // position, or -1 if `after` is unknown.
+    long insert(LineId after, LineId id);
+
+    // Tombstones id on behalf of the delete op `by` (its site and seq).
+    // Returns the visible position it had, or -1 if it was unknown or
+    // already deleted.
+    long erase(LineId id, LineId by);
+
+    bool contains(LineId id) const { return nodes_by_id.count(key(id)) != 0; }
+
+    // Records that the replace op `by` rewrote id. last_change keeps the
+    // greatest (seq, site) of them, so peers that applied the same ops agree
+    // on it; a line never rewritten gives its own id, the insert that made
+    // it. DOC_START if id is unknown.
+    void changed(LineId id, LineId by);
+    LineId last_change(LineId id) const;
+
+    // Visible position of id; -1 if unknown or deleted.
+    long position(LineId id) const;
+
+    LineId at(size_t pos) const; // visible line at pos; pos < size()
+
+    // Nearest visible line before id, deleted or not; DOC_START if there is
+    // none or id is unknown.
+    LineId visible_before(LineId id) const;
+    size_t size() const;         // visible lines
+    size_t tombstones() const;
+
+    // Drops tombstones whose delete is under the stable frontier (see
+    // stability.h), looking at no more than `budget` of them so callers can
+    // interleave merges. Freed nodes are reused by later inserts. Returns
+    // the number dropped.
+    size_t compact(const VersionVector &stable, size_t budget);
+    size_t memory_bytes() const;
+
+private:
+    struct Node
+    {
+        LineId id;
+        uint32_t prio;
+        bool visible;
+        LineId deleted_by; // delete op that tombstoned it
+        LineId changed_by; // see last_change; DOC_START until rewritten
+        Node *left, *right, *parent;
+        size_t count; // nodes in this subtree
+        size_t live;  // visible nodes in this subtree
+    };
+
+    static uint64_t key(LineId id) { return (uint64_t)id.site << 32 | id.seq; }
+    static size_t count_of(const Node *n) { return n ? n->count : 0; }
+    static size_t live_of(const Node *n) { return n ? n->live : 0; }
+    static void update(Node *n);
+    static Node *join(Node *a, Node *b);
+    static void split(Node *t, size_t k, Node *&a, Node *&b); // a: first k nodes
+    static size_t rank(const Node *n);                          // position among all nodes
+    Node *node_at(size_t k) const;                              // k-th node, tombstones included
+    Node *make_node(LineId id);
+
+    Node *root = nullptr;
+    std::deque<Node, TaggedAllocator<Node, MEM_DOCUMENT>> storage; // stable addresses
+    std::vector<Node *, TaggedAllocator<Node *, MEM_DOCUMENT>> free_nodes;
+    std::deque<Node *, TaggedAllocator<Node *, MEM_DOCUMENT>> graves; // tombstones, oldest first
+    std::unordered_map<uint64_t, Node *, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                       TaggedAllocator<std::pair<const uint64_t, Node *>, MEM_DOCUMENT>>
+        nodes_by_id;
+    uint32_t clock = 0;
+    uint32_t rng = 0x9e3779b9;
+};
+
+} // namespace synctext
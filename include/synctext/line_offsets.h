@@ -0,0 +1,78 @@
+// Byte offsets of lines: absolute offset <-> (line, col) in O(log n).
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "synctext/memory.h"
+
+namespace synctext
+{
+
+struct LinePos
+{
+    size_t line;
+    size_t col; // bytes into the line; its length when the offset is the '\n'
+};
+
+// -------------------- Line Offsets --------------------
+// The length of every line of a document as it is written to disk (each
+// line followed by '\n'), in a treap keyed by implicit position that keeps
+// subtree byte sums. Lines can be inserted, erased and resized anywhere in
+// O(log n), which a Fenwick tree over positions can't do without
+// renumbering, and both conversions are one O(log n) descent.
+class LineOffsets
+{
+public:
+    LineOffsets() = default;
+    LineOffsets(const LineOffsets &) = delete;
+    LineOffsets &operator=(const LineOffsets &) = delete;
+
+    // Forgets everything and indexes lines; O(n).
+    void reset(const std::vector<std::string> &lines);
+
+    void insert(size_t pos, size_t len); // pos <= size()
+    void erase(size_t pos);              // pos < size()
+    void set(size_t pos, size_t len);    // pos < size()
+
+    size_t size() const;  // lines
+    size_t bytes() const; // file size, newlines included
+    size_t length(size_t pos) const;
+
+    // Offset of the first byte of line (bytes() when line == size()).
+    size_t offset_of(size_t line) const;
+
+    // Line and column of the byte at offset; offsets at or past bytes()
+    // map to {size(), 0}.
+    LinePos locate(size_t offset) const;
+
+    size_t memory_bytes() const;
+
+private:
+    struct Node
+    {
+        uint32_t len; // newline excluded
+        uint32_t prio;
+        Node *left, *right;
+        size_t count; // lines in this subtree
+        size_t sum;   // bytes in this subtree, newlines included
+    };
+
+    static size_t count_of(const Node *n) { return n ? n->count : 0; }
+    static size_t sum_of(const Node *n) { return n ? n->sum : 0; }
+    static void update(Node *n);
+    static Node *join(Node *a, Node *b);
+    static void split(Node *t, size_t k, Node *&a, Node *&b); // a: first k lines
+    Node *node_at(size_t pos) const;
+    Node *make_node(size_t len);
+
+    Node *root = nullptr;
+    std::deque<Node, TaggedAllocator<Node, MEM_DOCUMENT>> storage; // stable addresses
+    std::vector<Node *, TaggedAllocator<Node *, MEM_DOCUMENT>> free_nodes;
+    uint32_t rng = 0x85ebca6b;
+};
+
+} // namespace synctext
@@ -0,0 +1,44 @@
+// Finding several literal patterns in a line at once, for bulk replaces.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace synctext
+{
+
+struct PatternMatch
+{
+    size_t pattern; // index into the set
+    size_t at;      // byte offset in the text
+};
+
+// -------------------- Pattern Set --------------------
+// Distinct, non-empty byte patterns matched in one pass over a text by an
+// Aho-Corasick automaton compiled to a full transition table (256 entries
+// per state), so each text byte costs one lookup however many patterns
+// there are. A single pattern skips the automaton and uses string::find,
+// which memchr makes faster.
+class PatternSet
+{
+public:
+    explicit PatternSet(std::vector<std::string> patterns);
+
+    // For each pattern, its leftmost non-overlapping matches in text, as
+    // repeated find() from the end of the previous match gives them.
+    // Appended to out by end offset.
+    void find(const std::string &text, std::vector<PatternMatch> &out) const;
+
+    size_t size() const { return patterns.size(); }
+    const std::string &pattern(size_t k) const { return patterns[k]; }
+
+private:
+    std::vector<std::string> patterns;
+    std::vector<int32_t> next;   // state * 256 + byte -> state
+    std::vector<int32_t> output; // pattern ending at the state, or -1
+    std::vector<int32_t> more;   // nearest state down the failure chain with output; 0 if none
+};
+
+} // namespace synctext
@@ -0,0 +1,97 @@
+// Memory accounting: what each subsystem's containers hold, by subsystem.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+namespace synctext
+{
+
+enum MemTag
+{
+    MEM_DOCUMENT, // lines and what tracks them: index, offsets, versions, blame, columns, trigrams, history, texts
+    MEM_QUEUES,   // ops and frames waiting to merge or to be sent
+    MEM_NOTIFY,   // notifications kept for display
+    MEM_MERGE,    // temporaries of a merge
+    MEM_TAGS
+};
+
+const char *mem_tag_name(MemTag tag);
+
+struct MemoryUsage
+{
+    uint64_t live = 0; // bytes allocated and not yet freed
+    uint64_t peak = 0;
+    uint64_t allocations = 0; // by TaggedAllocator and tagged_resource() only
+};
+
+MemoryUsage memory_usage(MemTag tag);
+
+// What the allocators below call: charges bytes and counts one allocation.
+void memory_allocated(MemTag tag, size_t bytes);
+// Memory whose container type is fixed by an interface, such as a
+// document's lines, is charged by its owner; that counts no allocation.
+void memory_charge(MemTag tag, size_t bytes);
+void memory_release(MemTag tag, size_t bytes);
+
+// A memory_resource counting against tag, over new_delete_resource().
+std::pmr::memory_resource *tagged_resource(MemTag tag);
+
+// -------------------- Tagged Allocator --------------------
+// A stateless std allocator counting against Tag. The containers a
+// subsystem owns take it, so only what the library keeps is counted and
+// the host program's allocator is left alone.
+template <class T, MemTag Tag>
+struct TaggedAllocator
+{
+    typedef T value_type;
+    template <class U>
+    struct rebind
+    {
+        typedef TaggedAllocator<U, Tag> other;
+    };
+
+    TaggedAllocator() = default;
+    template <class U>
+    TaggedAllocator(const TaggedAllocator<U, Tag> &) {}
+
+    T *allocate(size_t n)
+    {
+        T *p = std::allocator<T>().allocate(n);
+        memory_allocated(Tag, n * sizeof(T));
+        return p;
+    }
+    void deallocate(T *p, size_t n)
+    {
+        memory_release(Tag, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <class U>
+    bool operator==(const TaggedAllocator<U, Tag> &) const { return true; }
+    template <class U>
+    bool operator!=(const TaggedAllocator<U, Tag> &) const { return false; }
+};
+
+// -------------------- Memory Charge --------------------
+// A charge its owner resizes as what it accounts for grows and shrinks;
+// released when destroyed.
+class MemoryCharge
+{
+public:
+    explicit MemoryCharge(MemTag tag) : tag(tag) {}
+    ~MemoryCharge() { set(0); }
+    MemoryCharge(const MemoryCharge &) = delete;
+    MemoryCharge &operator=(const MemoryCharge &) = delete;
+
+    void set(size_t bytes);
+    size_t bytes() const { return held; }
+
+private:
+    MemTag tag;
+    size_t held = 0;
+};
+
+} // namespace synctext
@@ -0,0 +1,95 @@
+// Merge engine (CRDT LWW) and change detection on line snapshots.
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "synctext/blame.h"
+#include "synctext/line_index.h"
+#include "synctext/line_offsets.h"
+#include "synctext/search_index.h"
+#include "synctext/text_stream.h"
+#include "synctext/types.h"
+#include "synctext/utf8.h"
+#include "synctext/versions.h"
+
+namespace synctext
+{
+
+bool ranges_overlap(int a1, int b1, int a2, int b2);
+
+// Per-line structures a merge keeps in step with doc; any may be null.
+// columns also sets the unit op columns are read in: bytes without it.
+// texts holds the whole text of incoming ops with new_len set; without it
+// they write what their field holds. changed collects the lines touched,
+// for VersionLog::commit.
+struct LineTracking
+{
+    BlameIndex *blame = nullptr;
+    LineOffsets *offsets = nullptr;
+    ColumnCache *columns = nullptr;
+    TrigramIndex *trigrams = nullptr;
+    TextAssembly *texts = nullptr;
+    ChangedLines *changed = nullptr;
+};
+
+// Folds incoming ops into doc, whose line ids are index. Inserts and
+// deletes go through the index, then bulk ops are expanded into replaces
+// against the result; overlapping replaces on the same line are
+// resolved by timestamp (ties: smaller user_id wins). applied holds ops
+// already in doc (our own edits): they take part in LWW but are not
+// replayed. Returns the incoming ops that name lines this peer has not seen
+// yet, to be retried with the next merge. track is spliced along with doc.
+std::vector<UpdateObject> merge_updates(std::vector<std::string> &doc, LineIndex &index,
+                                        const std::vector<UpdateObject> &applied,
+                                        const std::vector<UpdateObject> &incoming, const LineTracking &track = {});
+
+// Same, but every replace survives: the union of deleted columns is removed
+// and insertions at the same column are concatenated in (ts, user_id)
+// order, all against the line as it was before the batch. Blame credits a
+// rewritten line's changed middle to the latest op on it.
+std::vector<UpdateObject> merge_sequence(std::vector<std::string> &doc, LineIndex &index,
+                                         const std::vector<UpdateObject> &applied,
+                                         const std::vector<UpdateObject> &incoming, const LineTracking &track = {});
+
+// The wire form of a batch of our own ops, doc and index being the
+// document now. Replaces that amount to one find-and-replace (the edit
+// widened to the words around it, checked against the whole line) become a
+// single "bulk" op per run of at least BULK_MIN_LINES lines that has no
+// other line holding the pattern or edited in the batch; receivers expand
+// it back into replaces. Lines edited twice in the batch, or since, are
+// sent as they are. base is what this peer has integrated (our own ops
+// included); receivers leave alone lines whose insert or last rewrite it
+// does not hold, as we never saw them as they are there.
+std::vector<UpdateObject> pack_bulk(const std::vector<UpdateObject> &ops, const std::vector<std::string> &doc,
+                                    const LineIndex &index, const VersionVector &base,
+                                    ColumnUnit unit = COLUMNS_BYTES);
+
+// Matched (old, new) line pairs of a shortest edit script (Myers), in
+// order; false if the script needs more than max_d edits.
+bool myers_matches(const std::vector<std::string> &a, const std::vector<std::string> &b, int max_d,
+                   std::vector<std::pair<int, int>> &matches);
+
+// Splices our own ops, already applied to doc and index, into track in the
+// order diff_lines (or invert_edit) produced them.
+void track_local(const LineTracking &track, const std::vector<UpdateObject> &ops, const std::vector<std::string> &doc,
+                 const LineIndex &index);
+
+// Fills in op_type, line, user_id and both timestamps of a local op.
+void stamp(UpdateObject &upd, const char *type, int line, const std::string &user_id);
+
+// Line diff (Myers) from old_lines to new_lines: "insert" and "delete" ops
+// for added and removed lines, and one "replace" per line edited in place,
+// trimmed to the differing middle and never cutting a character; its
+// columns count unit. index holds the ids of old_lines and is updated to
+// describe new_lines; new lines get ids from site. New text too long for
+// its field goes whole to long_text, to be streamed, if given; otherwise
+// it is cut short. Old text cut short goes whole to old_text, if given,
+// for undo.
+std::vector<UpdateObject> diff_lines(const std::vector<std::string> &old_lines,
+                                     const std::vector<std::string> &new_lines, LineIndex &index, uint32_t site,
+                                     const std::string &user_id, ColumnUnit unit = COLUMNS_BYTES,
+                                     std::vector<OpText> *long_text = nullptr, std::vector<OpText> *old_text = nullptr);
+
+} // namespace synctext
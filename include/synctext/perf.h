@@ -0,0 +1,78 @@
+// Opt-in profiling: CPU counters per invocation of the hot stages, read with
+// perf_event_open and summed per stage.
+#pragma once
+
+#include <cstdint>
+
+namespace synctext
+{
+
+enum PerfStage
+{
+    STAGE_SCAN,      // diffing a rescanned file into ops
+    STAGE_MERGE,     // merge_and_apply
+    STAGE_BROADCAST, // encoding and sending our batches and texts
+    STAGE_DECODE,    // decoding a received batch
+    PERF_STAGES
+};
+
+enum PerfCounter
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_CPU_NS,      // task clock: time on a CPU
+    PERF_PAGE_FAULTS, // mostly first touches of fresh allocations
+    PERF_COUNTERS
+};
+
+const char *perf_stage_name(PerfStage stage);
+const char *perf_counter_name(PerfCounter counter);
+
+// Summed over every invocation of a stage, on every thread.
+struct StageStats
+{
+    uint64_t invocations = 0;
+    uint64_t wall_ns = 0;
+    uint64_t counts[PERF_COUNTERS] = {}; // zero for counters not in perf_counters()
+};
+
+StageStats stage_stats(PerfStage stage);
+
+// Turns profiling on for the process (it stays on) and returns
+// perf_counters(). Hardware counters need a PMU and perf_event_paranoid <= 2;
+// without them stages still record wall and CPU time.
+uint32_t enable_profiling();
+bool profiling();
+uint32_t perf_counters(); // bit 1 << PerfCounter for each counter that could be opened
+
+// -------------------- Perf Scope --------------------
+// Charges what this thread does until the scope ends to stage; a no-op
+// unless profiling is on. Counters are per thread, so a scope must not
+// span a co_await. A nested scope pauses the enclosing
+// one: a merge that a rescan runs counts as a merge, not as scanning.
+class PerfScope
+{
+public:
+    explicit PerfScope(PerfStage stage);
+    ~PerfScope();
+    PerfScope(const PerfScope &) = delete;
+    PerfScope &operator=(const PerfScope &) = delete;
+
+    struct Reading
+    {
+        uint64_t wall_ns;
+        uint64_t counts[PERF_COUNTERS];
+    };
+
+private:
+    void charge(const Reading &now);
+
+    PerfStage stage;
+    bool active = false;
+    PerfScope *outer = nullptr;
+    Reading start;
+};
+
+} // namespace synctext
@@ -0,0 +1,28 @@
+// Documents on disk: one line per element, '\n' separated.
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace synctext
+{
+
+// What stat() reports for a file; any write to it, or a rename over it,
+// changes it. Compared instead of the contents to spot edits not yet read.
+struct FileStamp
+{
+    long long mtime_ns = -1;
+    off_t size = -1;
+    ino_t ino = 0;
+
+    bool operator==(const FileStamp &) const = default;
+};
+
+FileStamp file_stamp(const std::string &filename); // mtime_ns -1 if it can't be stat'ed
+
+std::vector<std::string> read_file(const std::string &filename);
+void write_initial_file(const std::string &filename);
+void write_file_from_lines(const std::string &filename, const std::vector<std::string> &lines);
+
+} // namespace synctext
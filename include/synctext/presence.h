@@ -0,0 +1,68 @@
+// Cursor presence in a seqlocked shared-memory table, outside the op path.
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// One user's cursor and selection, by line id so that lines inserted or
+// deleted above it by anyone leave it where it was. seq is a seqlock: the
+// owner makes it odd while writing, readers retry if it was odd or changed
+// under them.
+struct PresenceSlot
+{
+    std::atomic<uint32_t> seq;
+    std::atomic<int32_t> owner_pid; // 0 = free
+    char user_id[32];
+    LineId line;
+    int32_t col; // cursor; -1 if unknown
+    LineId sel_line;
+    int32_t sel_col; // selection anchor; equals the cursor when nothing is selected
+    int64_t updated_ms;
+};
+
+struct PresenceTable
+{
+    PresenceSlot slots[MAX_PRESENCE];
+};
+
+struct Presence
+{
+    std::string user_id;
+    LineId line, sel_line; // LineIndex::position finds them in the document
+    int col, sel_col;
+    long long updated_ms;
+};
+
+// This process's slot in the document's table, PRESENCE_SHM_PREFIX + its
+// name. A publish is a few stores, so an editor can update it every frame
+// without touching the transports or the merge engine.
+class PresenceBoard
+{
+public:
+    PresenceBoard() = default;
+    PresenceBoard(const PresenceBoard &) = delete;
+    PresenceBoard &operator=(const PresenceBoard &) = delete;
+    ~PresenceBoard();
+
+    // Maps document's table and claims a slot; false if shm is unavailable
+    // or full.
+    bool open(const std::string &document, const std::string &user_id);
+
+    // Wait-free for the writer; safe to call at display rate. No-op if not open.
+    void publish(LineId line, int col, LineId sel_line, int sel_col);
+
+    // Consistent copy of every other live user's cursor, once they have one.
+    std::vector<Presence> read() const;
+
+private:
+    PresenceTable *table = nullptr;
+    int slot = -1;
+};
+
+} // namespace synctext
@@ -0,0 +1,171 @@
+// C++20 coroutines on an epoll reactor.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <sys/types.h>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "synctext/scheduler.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// -------------------- Coroutine Reactor --------------------
+// A coroutine waiting for an fd or a timer parks its handle in the reactor;
+// other threads hand handles back through a copy-on-write ready list and an
+// eventfd. Co<T> is a lazily started awaitable task; Detached starts at once
+// and frees itself.
+struct CoPromiseBase
+{
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            return h.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T>
+struct CoValue : CoPromiseBase
+{
+    T value{};
+    void return_value(T v) { value = std::move(v); }
+};
+
+template <>
+struct CoValue<void> : CoPromiseBase
+{
+    void return_void() {}
+};
+
+template <typename T = void>
+struct Co
+{
+    struct promise_type : CoValue<T>
+    {
+        Co get_return_object() { return Co(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    std::coroutine_handle<promise_type> h;
+
+    explicit Co(std::coroutine_handle<promise_type> h) : h(h) {}
+    Co(Co &&other) noexcept : h(std::exchange(other.h, {})) {}
+    Co(const Co &) = delete;
+    ~Co()
+    {
+        if (h)
+            h.destroy();
+    }
+
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        h.promise().continuation = caller;
+        return h;
+    }
+    T await_resume()
+    {
+        if constexpr (!std::is_void_v<T>)
+            return std::move(h.promise().value);
+    }
+};
+
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+
+struct Reactor
+{
+    int ep = -1;
+    int wake_fd = -1;
+    std::shared_ptr<std::vector<void *>> ready = std::make_shared<std::vector<void *>>();
+    std::multimap<std::chrono::steady_clock::time_point, std::coroutine_handle<>> timers; // reactor thread only
+    std::unordered_map<int, bool> registered;                                              // fds added to epoll
+    std::atomic<bool> stopping{false};
+
+    // Throws std::system_error if epoll or the eventfd can't be created.
+    Reactor();
+    ~Reactor();
+
+    // Resume h on the reactor thread; callable from any thread.
+    void post(std::coroutine_handle<> h);
+
+    // One-shot readiness wait; reactor thread only.
+    void wait_fd(int fd, uint32_t events, std::coroutine_handle<> h);
+
+    // Runs until stop(); coroutines still parked then are never resumed.
+    void run();
+    void stop();
+};
+
+// Awaitables. FdReady and SleepFor must be awaited on the reactor thread;
+// the hops move the coroutine between the reactor, strands and workers.
+struct FdReady
+{
+    Reactor &r;
+    int fd;
+    uint32_t events;
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) { r.wait_fd(fd, events, h); }
+    void await_resume() {}
+};
+
+struct SleepFor
+{
+    Reactor &r;
+    std::chrono::milliseconds delay;
+    bool await_ready() { return delay.count() <= 0; }
+    void await_suspend(std::coroutine_handle<> h) { r.timers.emplace(std::chrono::steady_clock::now() + delay, h); }
+    void await_resume() {}
+};
+
+struct ResumeOnReactor
+{
+    Reactor &r;
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) { r.post(h); }
+    void await_resume() {}
+};
+
+struct ResumeOnStrand
+{
+    Strand &s;
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) { s.post([h] { h.resume(); }); }
+    void await_resume() {}
+};
+
+
+Co<ssize_t> async_read(Reactor &r, int fd, void *buf, size_t len);
+Co<bool> async_read_exact(Reactor &r, int fd, void *buf, size_t len);
+
+} // namespace synctext
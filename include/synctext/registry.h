@@ -0,0 +1,83 @@
+// Shared-memory registry of users on this host (FIFO and SEQPACKET transports).
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#include "synctext/stability.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// What a user publishes per open document: its version vector (sites past
+// MAX_VERSION_SITES are left out, which readers take as 0: nothing from
+// them is stable yet) and the wire dictionary it decodes the document with.
+struct DocSlot
+{
+    char doc[32];
+    uint32_t dict_id; // 0 = none
+    uint32_t n;
+    LineId sites[MAX_VERSION_SITES]; // {site, seq}
+};
+
+struct UserInfo
+{
+    char user_id[32];
+    uint32_t caps; // CAP_* bits advertised at registration
+    int32_t pid;   // checked against SCM_CREDENTIALS on SEQPACKET
+    std::atomic<uint32_t> vseq; // seqlock over docs, as in presence.h
+    DocSlot docs[MAX_VERSION_DOCS];
+};
+
+struct Registry
+{
+    int user_count;
+    UserInfo users[MAX_USERS];
+};
+
+struct PeerInfo
+{
+    std::string user_id;
+    uint32_t caps;
+    pid_t pid;
+    std::map<std::string, uint32_t> dicts; // document -> wire dictionary it decodes with
+
+    uint32_t dict_for(const std::string &doc) const
+    {
+        auto it = dicts.find(doc);
+        return it == dicts.end() ? 0 : it->second;
+    }
+};
+
+// Adds (or refreshes) user_id with what it can decode and returns every
+// registered user. Throws std::system_error if the registry can't be mapped.
+std::vector<PeerInfo> register_user(const std::string &user_id, uint32_t caps);
+
+// Current registry contents; empty if nobody has registered yet.
+std::vector<PeerInfo> registered_peers();
+
+// Looks up which registered user owns pid; empty if none.
+std::string registered_user_for_pid(pid_t pid);
+
+// Publishes user_id's integrated frontier for doc; false if user_id is not
+// registered or has no free document slot.
+bool publish_versions(const std::string &user_id, const std::string &doc, const VersionVector &vv);
+
+// Publishes the wire dictionary user_id decodes doc with (0 = none); false
+// as for publish_versions.
+bool publish_dictionary(const std::string &user_id, const std::string &doc, uint32_t dict_id);
+
+// Whether a live registered user other than user_id decodes doc with dict_id.
+bool dictionary_in_use(const std::string &user_id, const std::string &doc, uint32_t dict_id);
+
+// Every other live registered user and the frontier it last published for
+// doc (empty if it hasn't published one).
+std::vector<std::pair<std::string, VersionVector>> registered_versions(const std::string &user_id,
+                                                                       const std::string &doc);
+
+} // namespace synctext
@@ -0,0 +1,121 @@
+// Character sequence CRDT stored as run-length-encoded items in a B-tree.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/line_index.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// Characters are identified like lines (line_index.h): the inserting site
+// and a Lamport seq. A string inserted at once takes consecutive seqs.
+typedef LineId CharId;
+
+struct CharSpan
+{
+    CharId id; // first character
+    uint32_t len;
+};
+
+// -------------------- Run Sequence --------------------
+// Every character ever inserted, deleted ones kept as tombstones, in RGA
+// order. Consecutive characters from one site with consecutive seqs, each
+// typed after the previous one, share one run (site, seq, len, origin,
+// deleted) whose text lives in an append-only arena; runs are split when an
+// edit lands inside them and re-joined when neighbours line up again. The
+// runs sit in the leaves of a B-tree whose nodes count all and visible
+// characters, so position lookups are O(log n). A per-site map from the
+// first seq of each run to its leaf finds characters by id.
+class RunSequence
+{
+public:
+    static const int LEAF_RUNS = 64;
+    static const int FANOUT = 32;
+
+    RunSequence();
+    RunSequence(const RunSequence &) = delete;
+    RunSequence &operator=(const RunSequence &) = delete;
+    ~RunSequence();
+
+    // Local edits at visible positions. insert returns the id of the first
+    // character and, in origin, what a peer needs to integrate it; erase
+    // returns the spans it deleted.
+    CharId insert(size_t pos, const std::string &text, uint32_t site, CharId *origin = nullptr);
+    std::vector<CharSpan> erase(size_t pos, size_t len);
+
+    // Remote edits. integrate places text (ids id, id+1, ...) after origin
+    // (DOC_START: at the front); false if origin is unknown. erase_ids
+    // deletes a span; false if part of it is unknown.
+    bool integrate(CharId origin, CharId id, const std::string &text);
+    bool erase_ids(CharId id, uint32_t len);
+
+    bool contains(CharId id) const;
+    long position(CharId id) const; // visible position; -1 if unknown or deleted
+
+    std::string text() const;
+    size_t size() const;  // visible characters
+    size_t total() const; // tombstones included
+    size_t run_count() const { return runs; }
+    size_t memory_bytes() const;
+
+private:
+    struct Run
+    {
+        uint32_t site, seq, len;
+        uint32_t text_off; // into arena
+        CharId origin;     // character this run was typed after
+        bool deleted;
+    };
+
+    struct Inner;
+    struct Node
+    {
+        Inner *parent = nullptr;
+        bool leaf;
+        int n = 0;
+        size_t total = 0, live = 0;
+    };
+    struct Leaf : Node
+    {
+        Leaf *next = nullptr;
+        Run runs[LEAF_RUNS];
+    };
+    struct Inner : Node
+    {
+        Node *child[FANOUT];
+    };
+
+    struct Pos
+    {
+        Leaf *leaf;
+        int slot;     // run within leaf; == leaf->n past its end
+        uint32_t off; // character within run
+    };
+
+    Pos locate(size_t pos) const; // visible character pos < size()
+    bool find(CharId id, Pos &at) const;
+    Pos insert_run(Leaf *leaf, int slot, const Run &run);
+    void split_run(Pos at, uint32_t k); // run keeps [0, k)
+    void insert_child(Inner *parent, Node *after, Node *child);
+    void refresh(Node *node);
+    void coalesce(Leaf *leaf, int slot);
+    void mark_deleted(Pos at, uint32_t len, CharSpan *span);
+    static bool follows(const Run &a, const Run &b); // b can join the end of a
+    static bool sorts_before(CharId a, CharId b);    // RGA: a goes nearer the origin
+
+    Node *root;
+    Leaf *first;
+    std::string arena;
+    std::unordered_map<uint32_t, std::map<uint32_t, Leaf *>> by_site; // site -> first seq -> leaf
+    size_t runs = 0, leaves = 1, inners = 0;
+    uint32_t clock = 0;
+};
+
+} // namespace synctext
@@ -0,0 +1,84 @@
+// Work-stealing scheduler and strands (serial executors) on top of it.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace synctext
+{
+
+// -------------------- Work-Stealing Scheduler --------------------
+// Each worker owns a Chase-Lev deque: it pushes and pops at the bottom,
+// idle workers steal from the top of a random victim. Tasks submitted from
+// outside the pool (listeners, the reactor) go through a small injection
+// queue. Strands layered on top give per-document ordering.
+struct Task
+{
+    std::function<void()> fn;
+};
+
+struct WorkDeque
+{
+    static const int64_t CAPACITY = 4096; // power of two; overflow goes to the injection queue
+    std::atomic<int64_t> top{0}, bottom{0};
+    std::atomic<Task *> slots[CAPACITY];
+
+    bool push(Task *task); // owner only
+    Task *pop();           // owner only
+    Task *steal();         // any thread
+};
+
+struct Scheduler
+{
+    std::vector<std::unique_ptr<WorkDeque>> deques;
+    std::vector<std::thread> workers;
+    std::mutex inject_m;
+    std::deque<Task *> injected;
+    std::mutex idle_m;
+    std::condition_variable idle_cv;
+    std::atomic<int> sleeping{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<long> steals{0};
+
+    explicit Scheduler(unsigned n);
+    ~Scheduler();
+
+    void submit(std::function<void()> fn);
+
+private:
+    Task *find_work(unsigned self, uint32_t &rng);
+    bool has_visible_work();
+    void run(unsigned self);
+};
+
+// Serial executor: tasks posted to a strand run one at a time, in post
+// order, on whichever worker picks the strand up. Producers push onto an
+// intrusive MPSC list; the first post after the strand went idle schedules
+// a drain task.
+struct Strand : std::enable_shared_from_this<Strand>
+{
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        std::function<void()> fn;
+    };
+
+    Scheduler &sched;
+    std::atomic<Node *> head;
+    Node *tail; // consumer side, touched only by the running drain
+    std::atomic<long> pending{0};
+
+    explicit Strand(Scheduler &s);
+    ~Strand();
+
+    void post(std::function<void()> fn);
+    void drain();
+};
+
+} // namespace synctext
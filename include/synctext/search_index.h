@@ -0,0 +1,98 @@
+// Substring search over a live document through a trigram index.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/line_index.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+inline const size_t SEARCH_MAX_HITS = 1000; // per query
+// a line id -> position lookup, in lines scanned (synctext_bench_search:
+// about 740 ns against 55 ns a line)
+inline const size_t SEARCH_LOOKUP_COST = 13;
+inline const size_t SEARCH_SAMPLE = 1024; // of the rarest list, intersected first to estimate the candidates
+
+struct SearchHit
+{
+    size_t line;
+    size_t col; // byte offset of the match in the line
+};
+
+struct SearchStats
+{
+    size_t lines;    // indexed
+    size_t trigrams; // distinct
+    size_t postings; // stale ones included
+    size_t memory_bytes;
+    uint64_t updates;   // lines (re)indexed or dropped
+    uint64_t update_ns; // spent doing so
+};
+
+// -------------------- Trigram Index --------------------
+// For every 3-byte sequence, the slots of the lines containing it; a slot
+// stands for a line id, so inserts and deletes elsewhere renumber nothing.
+// Re-indexing a line gives it the next slot instead of hunting down its old
+// postings, which keeps every list sorted. Entries for retired slots are
+// skipped by queries until they outnumber live ones; a sweep then drops
+// them and renumbers the slots in order. An update costs O(line length)
+// amortized.
+//
+// A query intersects the needle's trigram lists, rarest first, and checks
+// the lines left against the text, so it costs about as much as the rarest
+// list rather than the document. Needles under 3 bytes scan, and so do
+// needles in so many lines that a scan would find max_hits of them sooner
+// than the candidates could be put in document order. That is judged from
+// the first SEARCH_SAMPLE entries of the rarest list before the rest is
+// intersected, so a common word costs little more than the scan.
+class TrigramIndex
+{
+public:
+    // Indexes lines, whose ids are index.
+    void reset(const std::vector<std::string> &lines, const LineIndex &index);
+
+    void set(LineId id, const std::string &line); // added or changed
+    void erase(LineId id);
+
+    // Matches of needle in lines (described by index), in document order;
+    // at most max_hits.
+    std::vector<SearchHit> search(const std::string &needle, const std::vector<std::string> &lines,
+                                  const LineIndex &index, size_t max_hits = SEARCH_MAX_HITS) const;
+
+    SearchStats stats() const;
+
+private:
+    struct Slot
+    {
+        LineId id;
+        uint32_t trigrams; // postings it has
+        bool used;
+    };
+
+    static uint64_t key(LineId id) { return (uint64_t)id.site << 32 | id.seq; }
+    void retire(uint32_t slot);
+    void sweep();
+
+    typedef std::vector<uint32_t, TaggedAllocator<uint32_t, MEM_DOCUMENT>> SlotList;
+    std::unordered_map<uint32_t, SlotList, std::hash<uint32_t>, std::equal_to<uint32_t>,
+                       TaggedAllocator<std::pair<const uint32_t, SlotList>, MEM_DOCUMENT>>
+        postings; // trigram -> slots
+    std::vector<Slot, TaggedAllocator<Slot, MEM_DOCUMENT>> slots;
+    std::unordered_map<uint64_t, uint32_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                       TaggedAllocator<std::pair<const uint64_t, uint32_t>, MEM_DOCUMENT>>
+        slot_of;
+    size_t live_postings = 0, stale_postings = 0, retired = 0;
+    uint64_t updates = 0, update_ns = 0;
+};
+
+// Matches of needle by reading every line; what search falls back to.
+std::vector<SearchHit> scan_lines(const std::string &needle, const std::vector<std::string> &lines,
+                                  size_t max_hits = SEARCH_MAX_HITS);
+
+} // namespace synctext
@@ -0,0 +1,228 @@
+// A Session is one user's view of the sync network: its documents, its
+// transport and, for async sessions, the scheduler and reactor driving them.
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/codec.h"
+#include "synctext/document.h"
+#include "synctext/presence.h"
+#include "synctext/reactor.h"
+#include "synctext/scheduler.h"
+#include "synctext/stats.h"
+#include "synctext/transport.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+enum class LogKind
+{
+    Info,    // setup and housekeeping
+    Notice,  // peers, documents, broadcasts
+    Local,   // a local change was detected
+    Remote,  // an update arrived
+    Merge,   // a merge was written
+    Warning, // dropped input, concurrent editing
+    Error    // rejected input, failed sends
+};
+
+struct SessionConfig
+{
+    std::string user_id;
+    TransportKind transport = TRANSPORT_FIFO;
+    std::string listen_addr;        // TCP host:port or Unix socket path
+    std::vector<std::string> peers; // stream transports dial these
+    bool compress = false;                    // each document's snapshot trains its wire dictionary
+    bool presence = true;                     // share cursors through each document's presence table
+    ColumnUnit columns = COLUMNS_CODE_POINTS; // what op columns count; must match on every peer
+    // keep a trigram index of each document for search(). It takes about 6x
+    // the document's size: some 395 bytes a line, 618 MB for 100 MB of text
+    // in synctext_bench_search, plus about 320 bytes per changed line until
+    // stale postings are swept.
+    bool search_index = false;
+    size_t versions_kept = VERSIONS_KEPT;     // of each document, for VersionLog lookups; 0 = every version
+    bool stats = true;                        // publish memory use per subsystem (see stats.h)
+    bool profile = false;                     // count cycles, cache misses etc. per stage (see perf.h)
+
+    // ops/s merged from any one peer, 0 = uncapped; peer_rates overrides it
+    // by user id. Ops over the cap wait in the document's inbound queues
+    // (sync sessions release them with the next delivery).
+    uint32_t peer_rate = 0;
+    std::unordered_map<std::string, uint32_t> peer_rates;
+
+    // bytes of queued ops each document keeps in memory, and of queued
+    // frames each stream connection does (0 = no limit). The oldest beyond
+    // it spill to unlinked files in spill_dir, which should be on disk, not
+    // tmpfs.
+    size_t memory_ceiling = 0;
+    std::string spill_dir = "/var/tmp";
+
+    // async: rescans and merges run on a work-stealing scheduler, I/O on a
+    // reactor that run() drives; otherwise work runs on the calling thread
+    // and the transport's listener thread.
+    bool async = false;
+    unsigned workers = 0;    // 0 = one per CPU
+    bool watch_files = true; // async: rescan documents when their file is written
+};
+
+struct SearchResult
+{
+    std::vector<SearchHit> hits; // col in SessionConfig::columns
+    uint64_t elapsed_ns;
+    bool indexed; // false: every line was scanned
+    SearchStats stats;
+};
+
+// Callbacks run on whichever thread produced the event; keep them short.
+struct SessionHooks
+{
+    std::function<void(LogKind, const std::string &)> log; // default: stderr
+    std::function<void(const Document &, const UpdateObject &)> received;
+    std::function<void(const Document &, const std::vector<UpdateObject> &)> received_bulk; // instead of received per op
+    std::function<void(const Document &, size_t applied)> merged; // doc.lines holds the result
+};
+
+class Session
+{
+public:
+    explicit Session(SessionConfig config, SessionHooks hooks = {});
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+    ~Session();
+
+    // Loads the wire dictionary, opens the stats segment and starts the
+    // transport. Throws std::system_error if an endpoint can't be created.
+    void start();
+
+    // Async sessions: drives the reactor until stop().
+    void run();
+    void stop();
+
+    // Document <name> is the file <user_id>_<name>.txt, created if missing.
+    // Updates for documents that are not open are dropped.
+    std::shared_ptr<Document> open(const std::string &name);
+    bool close(const std::string &name);
+    std::shared_ptr<Document> find(const std::string &name) const;
+    std::vector<std::string> documents() const;
+
+    // The document's file was written: diff it against doc.lines into ops,
+    // buffer and broadcast them (on its strand in async sessions).
+    void file_changed(const std::shared_ptr<Document> &doc);
+
+    // Publishes the document's integrated frontier in the registry and drops
+    // tombstones every peer has moved past, GC_CHUNK at a time so merges run
+    // in between (on its strand in async sessions, which do this every
+    // GC_INTERVAL_MS). Registry transports only: stream peers publish no
+    // frontier, so nothing becomes stable.
+    void collect_garbage(const std::shared_ptr<Document> &doc);
+
+    // Reverts our latest edit (or re-applies the latest undo) on top of
+    // whatever peers have done since, writes the file and sends the inverse
+    // ops like any other local change. Edits on disk not diffed yet count
+    // as the latest edit.
+    void undo(const std::shared_ptr<Document> &doc);
+    void redo(const std::shared_ptr<Document> &doc);
+
+    // Finds needle in the document's lines (on its strand in async
+    // sessions) and hands the result to done on that thread.
+    void search(const std::shared_ptr<Document> &doc, const std::string &needle,
+                std::function<void(const SearchResult &)> done);
+
+    // Publishes our cursor and selection anchor in the document's presence
+    // table (on its strand in async sessions): positions as in doc.lines,
+    // past the end meaning its last line, columns in SessionConfig::columns.
+    // Saving the file moves the cursor to the last edit as well. No-op
+    // without SessionConfig::presence.
+    void set_cursor(const std::shared_ptr<Document> &doc, size_t line, int col, size_t sel_line, int sel_col);
+
+    // Entry points for transports. Delivered ops queue per peer and lane
+    // and are merged round robin, interactive first (see inbound.h). Batches over STREAM_BATCH_OPS leave in
+    // slices; async sessions send those, and long text, from a backlog one
+    // frame at a time so other batches go out in between.
+    void deliver(const BatchHeader &hdr, const std::vector<UpdateObject> &batch);
+    void deliver_text(const BatchHeader &hdr, const char *payload, size_t len);
+    void broadcast(const std::string &doc, const std::vector<UpdateObject> &ops);
+
+    const SessionConfig &config() const { return cfg; }
+    const std::string &user_id() const { return cfg.user_id; }
+    // doc's wire dictionary; null if doc isn't open or is sent uncompressed.
+    std::shared_ptr<const WireDict> wire_dict(const std::string &doc) const;
+    StatsBoard &stats() { return stats_board; }
+    Reactor *reactor() { return loop.get(); }
+    Scheduler *scheduler() { return sched.get(); }
+    void log(LogKind kind, const std::string &msg) const;
+
+private:
+    // What a document's strand leaves for the broadcast strand to send.
+    struct Outgoing
+    {
+        std::vector<std::vector<UpdateObject>> batches;
+        std::vector<OpText> texts;
+    };
+
+    // A frame waiting in the backlog: a slice of a large batch, or the next
+    // part of a long text (ops empty).
+    struct Backlogged
+    {
+        std::string doc;
+        std::vector<UpdateObject> ops;
+        OpText text;
+        size_t offset = 0;
+
+        size_t heap_bytes() const { return ops.capacity() * sizeof(UpdateObject) + text.text.capacity(); }
+    };
+
+    void setup_dictionary(Document &doc);
+    void advertise_dictionary(const Document &doc);
+    void release_dictionary(const Document &doc);
+    void scan(Document &doc, const std::vector<std::string> &current, Outgoing *outgoing);
+    void queue_local(Document &doc, const std::vector<UpdateObject> &ops, Outgoing *outgoing);
+    void revert(Document &doc, bool redo, Outgoing *outgoing);
+    void send_texts(const std::string &doc, std::vector<OpText> texts);
+    bool backlogged(const std::string &doc) const;
+    void pump_backlog();
+    Detached backlog_pump();
+    void merge_and_apply(Document &doc, const std::vector<UpdateObject> &local_ops);
+    void try_merge_if_needed(Document &doc, const std::vector<UpdateObject> &local_ops = {}, bool force = false);
+    void schedule(const std::shared_ptr<Document> &doc, bool rescan, bool force = false);
+    Detached document_pipeline(std::shared_ptr<Document> doc, bool rescan, bool force);
+    VersionVector integrated(Document &doc) const; // every op merged into doc, ours included
+    VersionVector observe_peers(Document &doc);
+    void compact_step(Document &doc, const VersionVector &stable, size_t &todo, size_t &dropped, size_t &bytes);
+    void report_reclaimed(Document &doc, size_t dropped, size_t bytes);
+    Detached gc_pipeline(std::shared_ptr<Document> doc);
+    Detached history_pipeline(std::shared_ptr<Document> doc, bool redo);
+    SearchResult find_in(Document &doc, const std::string &needle);
+    Detached search_pipeline(std::shared_ptr<Document> doc, std::string needle,
+                             std::function<void(const SearchResult &)> done);
+    void place_cursor(Document &doc, size_t line, int col, size_t sel_line, int sel_col);
+    Detached cursor_pipeline(std::shared_ptr<Document> doc, size_t line, int col, size_t sel_line, int sel_col);
+    Detached inotify_loop(int fd);
+    Detached flush_loop();
+    Detached gc_loop();
+    Detached stats_loop();
+
+    SessionConfig cfg;
+    SessionHooks hooks;
+    uint32_t site; // our LineId site
+    std::shared_ptr<const DocTable> docs = std::make_shared<const DocTable>(); // replaced, never mutated
+    std::atomic<bool> started{false}; // registered with the transport: opens advertise their dictionary
+    StatsBoard stats_board;
+    std::unique_ptr<Scheduler> sched;
+    std::shared_ptr<Strand> broadcast_strand; // sends stay in order and off the merge path
+    std::deque<Backlogged, TaggedAllocator<Backlogged, MEM_QUEUES>> backlog; // broadcast strand only
+    MemoryCharge backlog_held{MEM_QUEUES};                                   // what its entries point to
+    bool pumping = false;
+    std::unique_ptr<Reactor> loop;
+    std::unique_ptr<Transport> transport;
+    int inotify_fd = -1;
+};
+
+} // namespace synctext
@@ -0,0 +1,56 @@
+// Overflow storage for queues that must not grow without limit in RAM.
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace synctext
+{
+
+// -------------------- Spill Log --------------------
+// A FIFO of byte records in an append-only file, mapped into memory. The
+// file is unlinked as soon as it is created, so nothing is left behind if
+// the process dies. It grows SPILL_GROW_BYTES at a time, reserved with
+// posix_fallocate first so a full disk fails an append instead of raising
+// SIGBUS on a write through the mapping. Space already read back is
+// punched out of the file as the head moves, and the file is truncated
+// whenever the log empties.
+//
+// Pages written here are file-backed: the kernel writes them out and
+// drops them under memory pressure rather than the process being killed.
+// Not thread safe; the owner locks.
+class SpillLog
+{
+public:
+    explicit SpillLog(std::string dir);
+    ~SpillLog();
+    SpillLog(const SpillLog &) = delete;
+    SpillLog &operator=(const SpillLog &) = delete;
+
+    // false if the file can't be created or grown: keep the record in memory
+    bool append(const void *data, size_t len);
+
+    bool empty() const { return records == 0; }
+    size_t size() const { return records; }
+    size_t bytes() const { return tail - head; } // on disk, headers included
+
+    // The oldest record, valid until the next append or pop. !empty()
+    std::string_view front() const;
+    void pop();
+
+private:
+    bool reserve(size_t len);
+    void reset();
+
+    std::string dir;
+    int fd = -1;
+    char *base = nullptr;
+    size_t mapped = 0;   // file size and mapping length
+    size_t head = 0;     // offset of the oldest record
+    size_t tail = 0;     // offset just past the newest
+    size_t released = 0; // bytes before this were punched out
+    size_t records = 0;
+};
+
+} // namespace synctext
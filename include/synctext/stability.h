@@ -0,0 +1,63 @@
+// Version vectors and the causally stable frontier used to collect tombstones.
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// site -> seq: every op from that site up to seq has been integrated here.
+// Absent sites count as 0.
+typedef std::map<uint32_t, uint32_t> VersionVector;
+
+inline uint32_t version_of(const VersionVector &vv, uint32_t site)
+{
+    auto it = vv.find(site);
+    return it == vv.end() ? 0 : it->second;
+}
+
+inline void witness(VersionVector &vv, uint32_t site, uint32_t seq)
+{
+    uint32_t &cur = vv[site];
+    if (seq > cur)
+        cur = seq;
+}
+
+// seen holds the highest seq integrated per site; ops still pending (waiting
+// for a line that hasn't arrived) hold their site back to just below them.
+VersionVector integrated_frontier(const VersionVector &seen, const UpdateObject *first, const UpdateObject *last);
+
+// Pointwise minimum.
+VersionVector meet(const VersionVector &a, const VersionVector &b);
+
+// -------------------- Stable Frontier --------------------
+// Peers publish their integrated frontier (their own site: every op they
+// have made, sent or not). A peer's frontier is confirmed here once we have
+// integrated every op it had made when publishing it, so nothing it did
+// before then is still in flight to us. The meet of all confirmed
+// frontiers is causally stable: an op under it has been integrated by
+// everyone, and any op that could still refer to what it deleted has
+// already arrived.
+class StableFrontier
+{
+public:
+    // Updates the confirmed frontier of each peer from what it published,
+    // given what we have integrated. Peers absent from published are
+    // forgotten.
+    void observe(const std::vector<std::pair<uint32_t, VersionVector>> &published, const VersionVector &ours);
+
+    // Meet of ours and every confirmed peer frontier; empty while some
+    // published peer has never been confirmed.
+    VersionVector stable(const VersionVector &ours) const;
+
+private:
+    std::map<uint32_t, VersionVector> confirmed; // site -> frontier
+    std::vector<uint32_t> unconfirmed;
+};
+
+} // namespace synctext
@@ -0,0 +1,78 @@
+// Per-process statistics in a shared-memory segment other processes can read.
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "synctext/memory.h"
+#include "synctext/perf.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+struct MemoryCounters
+{
+    char name[16]; // mem_tag_name
+    uint64_t live, peak, allocations;
+};
+
+struct StageCounters
+{
+    char name[16]; // perf_stage_name
+    uint64_t invocations, wall_ns;
+    uint64_t counts[PERF_COUNTERS];
+};
+
+// STATS_SHM_PREFIX + user id, one per session. seq is a seqlock, as in
+// presence.h.
+struct StatsSegment
+{
+    std::atomic<uint32_t> seq;
+    int32_t pid;
+    int64_t updated_ms;
+    uint32_t tags; // entries of memory in use
+    MemoryCounters memory[MEM_TAGS];
+    uint32_t profiling; // profiling() in the writer
+    uint32_t counters;  // perf_counters() in the writer
+    StageCounters stages[PERF_STAGES];
+};
+
+struct StatsSnapshot
+{
+    int pid = 0;
+    long long updated_ms = 0;
+    std::vector<std::pair<std::string, MemoryUsage>> memory; // by subsystem
+    bool profiling = false;
+    uint32_t counters = 0;
+    std::vector<std::pair<std::string, StageStats>> stages; // empty unless profiling
+};
+
+// -------------------- Stats Board --------------------
+// The writer's side. publish() copies the current counters in; it is a
+// few stores, and a call that finds another in progress returns at once.
+class StatsBoard
+{
+public:
+    StatsBoard() = default;
+    StatsBoard(const StatsBoard &) = delete;
+    StatsBoard &operator=(const StatsBoard &) = delete;
+    ~StatsBoard(); // removes the segment
+
+    // Creates (or takes over) user_id's segment; false if shm is unavailable.
+    bool open(const std::string &user_id);
+    void publish(); // no-op if not open
+
+private:
+    StatsSegment *seg = nullptr;
+    std::string name;
+    std::mutex m;
+};
+
+// A consistent copy of user_id's segment; false if there is none or the
+// process that wrote it has exited.
+bool read_stats(const std::string &user_id, StatsSnapshot &out);
+
+} // namespace synctext
@@ -0,0 +1,94 @@
+// Op text too long for UpdateObject's fields: streamed beside the ops in
+// FRAME_TEXT frames and assembled where the merge picks it up.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/memory.h"
+#include "synctext/stability.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// The whole new text of one of our ops with new_len set.
+struct OpText
+{
+    uint32_t seq; // of the op
+    std::string text;
+};
+
+// Payload of a FRAME_TEXT frame; len bytes of text follow it.
+struct TextChunk
+{
+    char user_id[32]; // sender
+    uint32_t seq;     // of the op the text belongs to
+    uint32_t total;   // bytes in the whole text
+    uint32_t offset;  // of this chunk in it
+};
+
+// The frame carrying text.text from offset on, at most STREAM_CHUNK_BYTES
+// of it; offset moves past what it took.
+std::shared_ptr<const std::vector<char>> build_text_frame(const std::string &doc, const std::string &user_id,
+                                                          const OpText &text, size_t &offset);
+
+// -------------------- Text Assembly --------------------
+// Texts being received for one document, keyed by (site, op seq). The
+// first chunk (or the op, whichever comes first) reserves the whole text,
+// and chunks are appended in place, so the buffer a chunk is copied into
+// off the wire is the one that ends up as the line. Ops arriving before
+// their text are held here instead of in the receive buffer. Calls take a
+// short lock: transports add from their threads while merges read.
+class TextAssembly
+{
+public:
+    // A chunk from site arrived. Returns the held ops it completed, now
+    // ready to merge. Chunks out of order or past total are dropped.
+    std::vector<UpdateObject> add(uint32_t site, const TextChunk &chunk, const char *data, size_t len);
+
+    // An op arrived: true if it can merge now (no new_len, or its text is
+    // all here); otherwise it is held until add() completes the text.
+    bool admit(const UpdateObject &u);
+
+    // The whole text of an admitted op, or null. take() moves it out, which
+    // is how an inserted line gets the assembled buffer itself.
+    const std::string *find(const UpdateObject &u) const;
+    std::string take(const UpdateObject &u);
+
+    // The op is merged (or lost to LWW): forget its text.
+    void drop(const UpdateObject &u);
+
+    // seen, held back to just below each op still waiting for its text
+    VersionVector hold_back(VersionVector seen) const;
+
+    size_t pending() const; // texts not complete yet
+    size_t bytes() const;   // held, complete or not
+
+private:
+    struct Stream
+    {
+        std::string text;
+        uint32_t total = 0;
+        std::vector<UpdateObject> held;
+    };
+
+    static uint64_t key(const UpdateObject &u);
+    static uint64_t key(uint32_t site, uint32_t seq) { return (uint64_t)site << 32 | seq; }
+
+    void release(const Stream &s) { reserved.set(reserved.bytes() - s.text.capacity()); }
+
+    mutable std::mutex m;
+    std::unordered_map<uint64_t, Stream, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                       TaggedAllocator<std::pair<const uint64_t, Stream>, MEM_DOCUMENT>>
+        streams;
+    MemoryCharge reserved{MEM_DOCUMENT}; // the texts' buffers; a taken one is the document's line
+
+};
+
+} // namespace synctext
@@ -0,0 +1,44 @@
+// How batches leave and reach a Session.
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+class Session;
+
+// A transport delivers every decoded batch to Session::deliver (text
+// frames to Session::deliver_text) and sends what Session::broadcast hands
+// it. send() and send_text() are called from one thread at a time (the
+// caller's in sync sessions, the broadcast strand in async ones).
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    // Creates the local endpoint and begins receiving. Throws
+    // std::system_error if the endpoint can't be created.
+    virtual void start() = 0;
+
+    // Stops receiving and joins any listener thread; send() keeps working.
+    virtual void stop() = 0;
+
+    // Frames are flagged with the lane; transports that queue frames let
+    // interactive ones pass queued bulk ones.
+    virtual void send(const std::string &doc, const std::vector<UpdateObject> &ops, Lane lane) = 0;
+
+    // Sends one FRAME_TEXT frame (see text_stream.h; always bulk) to every
+    // peer. Waits, up to STREAM_STALL_MS, while a peer has no room for it,
+    // so a large paste paces itself to the slowest peer instead of filling
+    // queues ahead of later batches.
+    virtual void send_text(const std::shared_ptr<const std::vector<char>> &frame) = 0;
+};
+
+std::unique_ptr<Transport> make_transport(Session &session);
+
+} // namespace synctext
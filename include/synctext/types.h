@@ -0,0 +1,159 @@
+// Shared constants, wire structs and lock-free helpers used across libsynctext.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace synctext
+{
+
+// -------------------- Constants --------------------
+inline const char *REGISTRY_SHM = "/sync_registry";
+inline const int MAX_USERS = 5;
+inline const int MERGE_THRESHOLD = 5;
+inline const int MERGE_FLUSH_MS = 500; // async sessions: merge fewer pending updates after this long
+inline const int GC_INTERVAL_MS = 5000;  // tombstone collection: publish versions and compact this often
+inline const size_t GC_CHUNK = 256;      // tombstones examined per compaction step
+inline const int MAX_VERSION_DOCS = 8;   // documents whose version vector a user publishes in the registry
+inline const int MAX_VERSION_SITES = 2 * MAX_USERS;
+
+// Wire batches (see codec.h)
+inline const char *DICT_SHM_PREFIX = "/sync_dict_"; // + document name
+inline const char *PRESENCE_SHM_PREFIX = "/sync_presence_"; // + document name
+inline const char *DEFAULT_DOC = "doc"; // single-document mode syncs <user_id>_doc.txt
+inline const int MAX_PRESENCE = 16;
+inline const long long PRESENCE_ACTIVE_MS = 10000; // cursor counts as "editing here" this long
+inline const uint32_t BATCH_MAGIC = 0x53594e43; // "SYNC"
+inline const uint16_t FRAME_COMPRESSED = 1;
+inline const uint16_t FRAME_HELLO = 2;            // stream handshake
+inline const uint16_t FRAME_TEXT = 4;             // op text too long for its fields (see text_stream.h)
+inline const uint16_t FRAME_BULK = 8;             // the frame travels in LANE_BULK
+inline const uint32_t CAP_COMPRESS = 1;           // peer can decode compressed batches
+inline const size_t COMPRESS_MIN_BYTES = 1024;    // smaller batches are sent raw
+inline const size_t DICT_MAX_BYTES = 4096;
+inline const size_t MAX_FRAME_BYTES = 16 << 20;   // larger stream frames drop the connection
+inline const size_t SEQPACKET_MAX_FRAME = 64 << 10; // batches are split into messages up to this size
+inline const size_t BULK_MIN_LINES = 4; // lines one find-and-replace must rewrite to be sent as a "bulk" op
+
+// Large pastes (see text_stream.h)
+inline const size_t STREAM_CHUNK_BYTES = 4000;      // text per FRAME_TEXT frame: with headers, one PIPE_BUF write
+inline const size_t STREAM_BATCH_OPS = 4096;        // larger batches leave as slices of this many ops
+inline const size_t STREAM_WINDOW_BYTES = 1 << 20;  // stream transports: queued for a peer before text frames wait
+inline const int STREAM_STALL_MS = 2000;            // a peer with no room for a text frame this long misses it
+inline const size_t STREAM_READ_BYTES = 256 << 10;  // read from one connection before serving the others
+
+// Receive path (see inbound.h)
+inline const size_t INBOUND_QUANTUM = 64;     // ops a peer merges per round before the next peer's turn
+inline const size_t INBOUND_MERGE_OPS = 1024; // async sessions: queued ops one merge takes, at least; more wait a strand turn
+
+// Priority lanes: bulk traffic yields to interactive edits wherever it queues,
+// though never to later ones from the same peer
+enum Lane
+{
+    LANE_INTERACTIVE, // batches of a few ops, as typing produces
+    LANE_BULK,        // larger batches and their slices, bulk ops, streamed text
+    LANES
+};
+inline const size_t INTERACTIVE_MAX_OPS = 64;       // larger batches travel as bulk
+inline const size_t BULK_INFLIGHT_BYTES = 64 << 10; // stream transports: bulk written ahead of later interactive frames
+
+// Bounded memory (see spill.h)
+inline const size_t SPILL_GROW_BYTES = 64 << 20;   // a spill file grows, reserved on disk, this much at a time
+inline const size_t SPILL_RELEASE_BYTES = 1 << 20; // read-back space punched out of a spill file at once
+
+// Stats segment (see stats.h)
+inline const char *STATS_SHM_PREFIX = "/sync_stats_"; // + user id
+inline const int STATS_INTERVAL_MS = 1000;            // async sessions: republish this often
+
+// -------------------- Data Structures --------------------
+// Stable identity of a line (see line_index.h): the site that inserted it
+// and a per-document Lamport counter.
+struct LineId
+{
+    uint32_t site;
+    uint32_t seq;
+};
+
+// A "bulk" op is a find-and-replace over the lines from line_id to after,
+// both included: every occurrence of old_content in a line the sender had
+// seen as it is becomes new_content. The sender's base version vector
+// follows the terminators of old_content and new_content. start_col is the
+// number of lines it rewrote on the sender. See pack_bulk in merge.h.
+//
+// Text longer than its field is cut at a character boundary and its full
+// length recorded in old_len or new_len (0: the field holds all of it). An
+// op with new_len set is merged once the whole text has arrived in
+// FRAME_TEXT frames; old text is only needed for its length, except by undo,
+// which keeps it whole beside the op.
+struct UpdateObject
+{
+    char op_type[10]; // "replace", "insert", "delete" or "bulk"
+    int line;         // position on the sender when the op was made; informational
+    LineId line_id;   // line the op targets; insert: the new line; bulk: the first line
+    LineId after;     // insert: the line it goes after; delete: the line it followed; bulk: the last line
+    uint32_t seq;     // Lamport time of the op on its site; insert: line_id.seq
+    int start_col;
+    int end_col;
+    uint32_t old_len;
+    uint32_t new_len;
+    char old_content[256];
+    char new_content[256];
+    char timestamp[32]; // human readable
+    long ts;            // epoch seconds for comparison
+    char user_id[32];
+};
+
+// One framed batch of UpdateObjects. The payload is either the raw array or
+// its compressed form (FRAME_COMPRESSED), decoded against dict_id.
+struct BatchHeader
+{
+    uint32_t magic;
+    char doc[32]; // document name; identical on every peer
+    uint16_t flags;
+    uint16_t count;
+    uint32_t dict_id;
+    uint32_t raw_len;
+    uint32_t payload_len;
+};
+
+enum TransportKind
+{
+    TRANSPORT_FIFO,     // named pipes + shm registry (default)
+    TRANSPORT_TCP,      // stream sockets, listen on host:port
+    TRANSPORT_UNIX,     // stream sockets, listen on /path/to.sock
+    TRANSPORT_SEQPACKET // Unix SOCK_SEQPACKET + shm registry, one message per frame
+};
+
+inline long long now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// -------------------- Helper: multi-writer copy-on-write vectors --------------------
+// For buffers that several threads append to: retry the copy until our
+// snapshot is the one replaced, and take everything with one exchange.
+template <typename V>
+void cow_append(std::shared_ptr<V> &slot, const typename V::value_type *first, const typename V::value_type *last)
+{
+    auto cur = std::atomic_load(&slot);
+    std::shared_ptr<V> next;
+    do
+    {
+        next = std::make_shared<V>(*cur);
+        next->insert(next->end(), first, last);
+    } while (!std::atomic_compare_exchange_weak(&slot, &cur, next));
+}
+
+template <typename V>
+std::shared_ptr<V> cow_take(std::shared_ptr<V> &slot)
+{
+    return std::atomic_exchange(&slot, std::make_shared<V>());
+}
+
+} // namespace synctext
@@ -0,0 +1,80 @@
+// Per-user undo and redo: bounded stacks of local edits and their inverses.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "synctext/line_index.h"
+#include "synctext/memory.h"
+#include "synctext/text_stream.h"
+#include "synctext/types.h"
+#include "synctext/utf8.h"
+
+namespace synctext
+{
+
+inline const size_t UNDO_DEPTH = 64;     // edits remembered per stack
+inline const size_t UNDO_MAX_OPS = 4096; // ops held per stack; the oldest edits go first
+
+// One local edit: the ops one diff produced, and the whole text of those
+// whose fields cut it short (old_len or new_len set), by op seq.
+struct UndoEdit
+{
+    std::vector<UpdateObject> ops;
+    std::vector<OpText> old_text, new_text;
+
+    size_t bytes() const;
+};
+
+// -------------------- Undo History --------------------
+// One entry per local edit (the ops one diff produced). Undoing an entry
+// moves its inverse to the redo stack and the other way round; a new
+// local edit clears redo. Both stacks are rings of UNDO_DEPTH entries, so
+// push and pop are O(1) and the oldest entry is overwritten when full.
+class UndoHistory
+{
+public:
+    UndoHistory();
+
+    void record(UndoEdit edit);
+
+    bool can_undo() const { return done.count > 0; }
+    bool can_redo() const { return undone.count > 0; }
+
+    // Pops the latest edit; the caller pushes its inverse back with
+    // undone_as / redone_as.
+    UndoEdit take_undo() { return done.pop(); }
+    UndoEdit take_redo() { return undone.pop(); }
+    void undone_as(UndoEdit inverse) { undone.push(std::move(inverse)); }
+    void redone_as(UndoEdit inverse) { done.push(std::move(inverse)); }
+
+private:
+    struct Ring
+    {
+        std::vector<UndoEdit> slots;
+        size_t head = 0, count = 0, ops = 0;
+        MemoryCharge held{MEM_DOCUMENT}; // the ops and texts, as the document's
+
+        void push(UndoEdit edit);
+        UndoEdit pop();
+        void drop_oldest();
+        void clear();
+    };
+
+    Ring done, undone;
+};
+
+// Ops that revert edit on doc as it is now, applied to doc and index and
+// stamped like diff_lines output. Each op is transformed against what
+// happened since: lines are found by id wherever they moved, a deleted line
+// comes back after the nearest surviving line before it, and a replace is
+// reverted where its text now sits in the line. Ops whose line or text is
+// gone are skipped. Text too long for an op's fields is carried whole in
+// the returned edit, as diff_lines does; its new_text is what peers need
+// streamed. Columns count unit, as in diff_lines.
+UndoEdit invert_edit(const UndoEdit &edit, std::vector<std::string> &doc, LineIndex &index, uint32_t site,
+                     const std::string &user_id, ColumnUnit unit = COLUMNS_BYTES);
+
+} // namespace synctext
@@ -0,0 +1,113 @@
+// UTF-8 text: validation, code-point boundaries and the unit columns are
+// counted in.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "synctext/memory.h"
+#include "synctext/types.h"
+
+namespace synctext
+{
+
+// What UpdateObject::start_col / end_col count. Every peer must use the
+// same unit; content fields are always UTF-8 bytes.
+enum ColumnUnit
+{
+    COLUMNS_BYTES,
+    COLUMNS_CODE_POINTS, // default
+    COLUMNS_UTF16        // code units, as editors built on UTF-16 strings count them
+};
+
+inline const size_t COLUMN_CACHE_LINES = 4096; // tables kept per document before the cache is cleared
+
+// True if s is well-formed UTF-8 (no overlongs, surrogates or code points
+// past U+10FFFF). ASCII is skipped 16 bytes at a time.
+bool utf8_valid(const char *s, size_t n);
+inline bool utf8_valid(const std::string &s) { return utf8_valid(s.data(), s.size()); }
+
+// Length of the longest prefix of s that fits in max bytes without cutting
+// a code point.
+size_t utf8_fit(const char *s, size_t n, size_t max);
+
+// Copies text into a NUL-terminated wire field, truncated at a code-point
+// boundary.
+template <size_t N>
+void copy_content(char (&field)[N], const std::string &text)
+{
+    size_t n = utf8_fit(text.data(), text.size(), N - 1);
+    text.copy(field, n);
+    field[n] = '\0';
+}
+
+// Fills a text field; text that does not fit is cut and its length kept
+// in len (UpdateObject's old_len or new_len).
+template <size_t N>
+void set_text(char (&field)[N], uint32_t &len, const std::string &text)
+{
+    copy_content(field, text);
+    len = text.size() < N ? 0 : text.size();
+}
+
+// Columns s spans. A malformed byte counts as one column in every unit.
+size_t column_width(const char *s, size_t n, ColumnUnit unit);
+inline size_t column_width(const std::string &s, ColumnUnit unit) { return column_width(s.data(), s.size(), unit); }
+
+// -------------------- Column Table --------------------
+// Column <-> byte conversion for one line in O(1). ASCII lines, and any
+// line when columns are bytes, need no table; others keep the byte offset
+// of every column and the column of every byte.
+class ColumnTable
+{
+public:
+    ColumnTable() = default;
+    ColumnTable(const std::string &line, ColumnUnit unit);
+
+    // Byte where column col starts; the line length past the end. A column
+    // inside a character (the second half of a UTF-16 surrogate pair)
+    // maps to the character's first byte.
+    size_t to_byte(size_t col) const;
+
+    // Column of the character holding byte; the width past the end.
+    size_t to_col(size_t byte) const;
+
+    size_t width() const { return identity ? bytes : starts.size() - 1; }
+    size_t length() const { return bytes; }
+
+private:
+    bool identity = true;
+    size_t bytes = 0;
+    std::vector<uint32_t, TaggedAllocator<uint32_t, MEM_DOCUMENT>> starts;  // per column, then the line length
+    std::vector<uint32_t, TaggedAllocator<uint32_t, MEM_DOCUMENT>> columns; // per byte, then the width
+};
+
+// -------------------- Column Cache --------------------
+// Column tables of a document's lines by line id, so every op on a line
+// after the first converts in O(1). Whoever changes a line's text
+// invalidates its id; a table whose length no longer matches is rebuilt
+// regardless.
+class ColumnCache
+{
+public:
+    explicit ColumnCache(ColumnUnit unit = COLUMNS_CODE_POINTS) : columns(unit) {}
+
+    void reset(ColumnUnit unit);
+    ColumnUnit unit() const { return columns; }
+
+    const ColumnTable &table(LineId id, const std::string &line);
+    void invalidate(LineId id) { tables.erase(key(id)); }
+
+private:
+    static uint64_t key(LineId id) { return (uint64_t)id.site << 32 | id.seq; }
+
+    ColumnUnit columns;
+    std::unordered_map<uint64_t, ColumnTable, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                       TaggedAllocator<std::pair<const uint64_t, ColumnTable>, MEM_DOCUMENT>>
+        tables;
+};
+
+} // namespace synctext
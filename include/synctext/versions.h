@@ -0,0 +1,121 @@
+// Version history: every state of a document as a persistent tree of lines.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "synctext/memory.h"
+
+namespace synctext
+{
+
+inline const size_t VERSIONS_KEPT = 4096; // default SessionConfig::versions_kept; 0 keeps all
+
+// -------------------- Line Tree --------------------
+// An immutable sequence of lines: a randomized balanced tree whose nodes
+// are never modified once built. splice copies only the O(log n) nodes on
+// the paths it cuts and shares everything else with the tree it came
+// from, so keeping every version costs O(changed lines + log n) each.
+class LineTree
+{
+public:
+    LineTree() = default;
+    static LineTree build(const std::vector<std::string> &lines);
+
+    size_t size() const;
+    std::string_view at(size_t pos) const; // O(log n); pos < size()
+    // count lines from pos (fewer at the end), all of them by default;
+    // O(log n + count).
+    std::vector<std::string> lines(size_t pos = 0, size_t count = SIZE_MAX) const;
+
+    // A tree with the count lines at pos replaced by with; this one is
+    // unchanged.
+    LineTree splice(size_t pos, size_t count, const std::vector<std::string> &with) const;
+
+private:
+    struct Node;
+    typedef std::shared_ptr<const Node> Ptr;
+    typedef std::basic_string<char, std::char_traits<char>, TaggedAllocator<char, MEM_DOCUMENT>> Line;
+    struct Node
+    {
+        Line line;
+        size_t size;
+        Ptr left, right;
+    };
+
+    explicit LineTree(Ptr root) : root(std::move(root)) {}
+    static size_t size_of(const Ptr &n) { return n ? n->size : 0; }
+    static Ptr make(std::string_view line, Ptr left, Ptr right);
+    static Ptr build(const std::vector<std::string> &lines, size_t lo, size_t hi);
+    static Ptr join(const Ptr &a, const Ptr &b);
+    static void split(const Ptr &t, size_t k, Ptr &a, Ptr &b); // a: first k lines
+
+    Ptr root;
+};
+
+// -------------------- Changed Lines --------------------
+// Where a merge or a local edit touched a document, recorded as it goes:
+// lines [first, end) of the result may differ from the version before,
+// and every line outside them is unchanged, at the same distance from the
+// start or from the end. Positions are those of the document at the time.
+struct ChangedLines
+{
+    bool any = false;
+    size_t first = 0, end = 0;
+
+    void insert(size_t pos);  // a line now at pos
+    void erase(size_t pos);   // the line that was at pos
+    void replace(size_t pos); // rewritten in place
+};
+
+enum VersionLookup
+{
+    VERSION_FOUND,
+    VERSION_TRIMMED, // it existed, but is older than the oldest retained one
+    VERSION_UNKNOWN, // never made: past the latest, or before the file was opened
+};
+
+struct Version
+{
+    uint64_t number;
+    long long time_ms;
+    LineTree lines;
+};
+
+// -------------------- Version Log --------------------
+// The retained versions of one document, numbered from 0 (the file as
+// opened): the last keep of them, or all with keep 0. Lookups copy out a
+// Version handle under a short lock, so readers on any thread see a
+// consistent state without stalling merges.
+class VersionLog
+{
+public:
+    void reset(const std::vector<std::string> &lines, long long time_ms, size_t keep = VERSIONS_KEPT);
+
+    // Records lines, the latest version with changed applied, as the next
+    // version if they differ from it. Only the changed lines are compared
+    // and copied; the rest, and lines the two share, are shared in the tree.
+    // Returns the latest version number.
+    uint64_t commit(const std::vector<std::string> &lines, const ChangedLines &changed, long long time_ms);
+
+    // Version v, or the last version at or before time_ms; out is set
+    // only if it is VERSION_FOUND.
+    VersionLookup at_version(uint64_t v, Version &out) const;
+    VersionLookup at_time(long long time_ms, Version &out) const;
+
+    uint64_t latest() const;
+    size_t retained() const;
+
+private:
+    mutable std::mutex m;
+    std::deque<Version> kept; // oldest first, consecutive numbers
+    size_t keep = VERSIONS_KEPT;
+};
+
+} // namespace synctext
@@ -0,0 +1,303 @@
+#include "synctext/blame.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace synctext
+{
+
+BlameIndex::BlameIndex()
+{
+    intern(""); // user 0: before tracking began
+}
+
+BlameIndex::~BlameIndex()
+{
+    destroy(root);
+}
+
+// -------------------- Treap Helpers --------------------
+void BlameIndex::update(Node *n)
+{
+    n->size = n->lines + size_of(n->left) + size_of(n->right);
+}
+
+BlameIndex::Node *BlameIndex::join(Node *a, Node *b)
+{
+    if (!a || !b)
+        return a ? a : b;
+    if (a->prio > b->prio)
+    {
+        a->right = join(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = join(a, b->left);
+    update(b);
+    return b;
+}
+
+void BlameIndex::split(Node *t, size_t k, Node *&a, Node *&b)
+{
+    if (!t)
+    {
+        a = b = nullptr;
+        return;
+    }
+    size_t left = size_of(t->left);
+    if (k <= left)
+    {
+        split(t->left, k, a, t->left);
+        b = t;
+        update(b);
+    }
+    else if (k >= left + t->lines)
+    {
+        split(t->right, k - left - t->lines, t->right, b);
+        a = t;
+        update(a);
+    }
+    else
+    {
+        // inside a block of whole lines: cut it in two. The tail keeps the
+        // priority so it can sit above t's right subtree.
+        uint32_t keep = k - left;
+        Node *rest = make(t->lines - keep, t->by);
+        rest->prio = t->prio;
+        rest->right = t->right;
+        t->right = nullptr;
+        t->lines = keep;
+        update(t);
+        update(rest);
+        a = t;
+        b = rest;
+    }
+}
+
+BlameIndex::Node *BlameIndex::edge(Node *t, bool rightmost)
+{
+    while (t && (rightmost ? t->right : t->left))
+        t = rightmost ? t->right : t->left;
+    return t;
+}
+
+// Grows the first or last run by delta lines.
+void BlameIndex::resize(Node *t, bool rightmost, long delta)
+{
+    for (Node *x = t; x; x = rightmost ? x->right : x->left)
+    {
+        x->size += delta;
+        if (!(rightmost ? x->right : x->left))
+            x->lines += delta;
+    }
+}
+
+BlameIndex::Node *BlameIndex::make(uint32_t lines, Author by)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    nodes++;
+    return new (alloc.allocate(1)) Node{lines, by, {}, rng, lines, nullptr, nullptr};
+}
+
+void BlameIndex::destroy(Node *t)
+{
+    vector<Node *> stack;
+    if (t)
+        stack.push_back(t);
+    while (!stack.empty())
+    {
+        Node *x = stack.back();
+        stack.pop_back();
+        if (x->left)
+            stack.push_back(x->left);
+        if (x->right)
+            stack.push_back(x->right);
+        x->~Node();
+        alloc.deallocate(x, 1);
+        nodes--;
+    }
+}
+
+// Joins a and b, folding b's first run into a's last one if they are whole
+// lines by the same author.
+BlameIndex::Node *BlameIndex::join_merging(Node *a, Node *b)
+{
+    Node *last = edge(a, true), *first = edge(b, false);
+    if (last && first && last->cols.empty() && first->cols.empty() && last->by == first->by)
+    {
+        Node *head, *tail;
+        split(b, first->lines, head, tail);
+        resize(a, true, head->lines);
+        destroy(head);
+        b = tail;
+    }
+    return join(a, b);
+}
+
+uint32_t BlameIndex::intern(const string &user_id)
+{
+    auto it = user_ids.find(user_id);
+    if (it != user_ids.end())
+        return it->second;
+    users.push_back(user_id);
+    user_ids[user_id] = users.size() - 1;
+    return users.size() - 1;
+}
+
+// -------------------- Blame Index --------------------
+void BlameIndex::reset(size_t n)
+{
+    lock_guard<mutex> lock(m);
+    destroy(root);
+    root = n ? make(n, {0, 0}) : nullptr;
+}
+
+void BlameIndex::insert_lines(size_t pos, size_t count, const string &user_id, long ts)
+{
+    if (count == 0)
+        return;
+    lock_guard<mutex> lock(m);
+    Node *a, *b;
+    split(root, min(pos, size_of(root)), a, b);
+    root = join_merging(join_merging(a, make(count, {intern(user_id), ts})), b);
+}
+
+void BlameIndex::erase_lines(size_t pos, size_t count)
+{
+    lock_guard<mutex> lock(m);
+    Node *a, *rest, *gone, *b;
+    split(root, pos, a, rest);
+    split(rest, count, gone, b);
+    destroy(gone);
+    root = join_merging(a, b);
+}
+
+void BlameIndex::replace(size_t pos, size_t col, size_t erased, size_t inserted, const string &user_id, long ts)
+{
+    lock_guard<mutex> lock(m);
+    if (pos >= size_of(root) || (erased == 0 && inserted == 0))
+        return;
+    Node *a, *rest, *line, *b;
+    split(root, pos, a, rest);
+    split(rest, 1, line, b);
+    if (line->cols.empty())
+        line->cols.push_back({TO_END, line->by});
+
+    // rebuild the column runs: [0, col) kept, the new text, then what
+    // follows the erased range
+    Author by{intern(user_id), ts};
+    ColRuns out;
+    auto put = [&](size_t len, Author who) {
+        if (len == 0)
+            return;
+        uint32_t n = len >= TO_END ? TO_END : (uint32_t)len;
+        if (!out.empty() && out.back().by == who)
+            out.back().len = n == TO_END ? TO_END : out.back().len + n;
+        else
+            out.push_back({n, who});
+    };
+    size_t at = 0, cut = col + erased;
+    bool placed = false;
+    for (auto &run : line->cols)
+    {
+        size_t end = run.len == TO_END ? SIZE_MAX : at + run.len;
+        if (at < col)
+            put(min(end, col) - at, run.by);
+        if (!placed && end >= col)
+        {
+            put(inserted, by);
+            placed = true;
+        }
+        if (end > cut)
+            put(end == SIZE_MAX ? SIZE_MAX : end - max(at, cut), run.by);
+        at = end;
+    }
+    line->cols.swap(out);
+
+    // one author left: back to a whole-line run
+    bool uniform = true;
+    for (auto &run : line->cols)
+        uniform = uniform && run.by == line->cols[0].by;
+    if (uniform)
+    {
+        line->by = line->cols[0].by;
+        ColRuns().swap(line->cols);
+    }
+    root = join_merging(join_merging(a, line), b);
+}
+
+void BlameIndex::collect(const Node *t, size_t base, size_t lo, size_t hi, vector<BlameSpan> &out) const
+{
+    if (!t)
+        return;
+    size_t start = base + size_of(t->left), end = start + t->lines;
+    if (lo < start)
+        collect(t->left, base, lo, hi, out);
+    if (lo < end && start < hi)
+    {
+        if (t->cols.empty())
+        {
+            size_t first = max(start, lo);
+            out.push_back({users[t->by.user], t->by.ts, first, 0, string::npos, min(end, hi) - first});
+        }
+        else
+        {
+            size_t col = 0;
+            for (auto &run : t->cols)
+            {
+                size_t len = run.len == TO_END ? string::npos : run.len;
+                out.push_back({users[run.by.user], run.by.ts, start, col, len, 1});
+                col += run.len == TO_END ? 0 : run.len;
+            }
+        }
+    }
+    if (hi > end)
+        collect(t->right, end, lo, hi, out);
+}
+
+vector<BlameSpan> BlameIndex::blame(size_t line, size_t count) const
+{
+    lock_guard<mutex> lock(m);
+    vector<BlameSpan> out;
+    collect(root, 0, line, line + count, out);
+    return out;
+}
+
+size_t BlameIndex::lines() const
+{
+    lock_guard<mutex> lock(m);
+    return size_of(root);
+}
+
+size_t BlameIndex::run_count() const
+{
+    lock_guard<mutex> lock(m);
+    return nodes;
+}
+
+size_t BlameIndex::memory_bytes() const
+{
+    lock_guard<mutex> lock(m);
+    size_t bytes = sizeof(*this) + nodes * sizeof(Node);
+    vector<const Node *> stack;
+    if (root)
+        stack.push_back(root);
+    while (!stack.empty())
+    {
+        const Node *x = stack.back();
+        stack.pop_back();
+        bytes += x->cols.capacity() * sizeof(ColRun);
+        if (x->left)
+            stack.push_back(x->left);
+        if (x->right)
+            stack.push_back(x->right);
+    }
+    for (auto &u : users)
+        bytes += u.capacity();
+    return bytes;
+}
+
+} // namespace synctext
@@ -0,0 +1,144 @@
+#include "synctext/channel.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "synctext/codec.h"
+#include "synctext/types.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Pipe --------------------
+PipeChannel::PipeChannel()
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+        throw system_error(errno, generic_category(), "pipe");
+    rfd = fds[0];
+    wfd = fds[1];
+}
+
+PipeChannel::~PipeChannel()
+{
+    close(rfd);
+    close(wfd);
+}
+
+bool PipeChannel::send(const char *frame, size_t len)
+{
+    // both ends are ours, so the free space is known and write never blocks
+    int capacity = fcntl(wfd, F_GETPIPE_SZ), queued = 0;
+    ioctl(rfd, FIONREAD, &queued);
+    if (capacity == -1 || (size_t)(capacity - queued) < len)
+        return false;
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = write(wfd, frame + sent, len - sent);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+ssize_t PipeChannel::receive(char *buf, size_t cap)
+{
+    int queued = 0;
+    if (ioctl(rfd, FIONREAD, &queued) == -1 || (size_t)queued < sizeof(BatchHeader))
+        return 0;
+    BatchHeader hdr;
+    if (cap < sizeof(hdr) || read_full(rfd, &hdr, sizeof(hdr)) != sizeof(hdr))
+        return -1;
+    size_t len = sizeof(hdr) + hdr.payload_len;
+    if (hdr.magic != BATCH_MAGIC || len > cap)
+        return -1;
+    memcpy(buf, &hdr, sizeof(hdr));
+    if (read_full(rfd, buf + sizeof(hdr), hdr.payload_len) != (ssize_t)hdr.payload_len)
+        return -1;
+    return len;
+}
+
+// -------------------- Socket --------------------
+SocketChannel::SocketChannel()
+{
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1)
+        throw system_error(errno, generic_category(), "socketpair");
+}
+
+SocketChannel::~SocketChannel()
+{
+    close(fds[0]);
+    close(fds[1]);
+}
+
+bool SocketChannel::send(const char *frame, size_t len)
+{
+    ssize_t n;
+    do
+        n = ::send(fds[0], frame, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    while (n == -1 && errno == EINTR);
+    return n == (ssize_t)len;
+}
+
+ssize_t SocketChannel::receive(char *buf, size_t cap)
+{
+    ssize_t n;
+    do
+        n = recv(fds[1], buf, cap, MSG_DONTWAIT | MSG_TRUNC);
+    while (n == -1 && errno == EINTR);
+    if (n == -1)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    return (size_t)n > cap ? -1 : n;
+}
+
+// -------------------- Shared-Memory Ring --------------------
+ShmRingChannel::ShmRingChannel(const char *name)
+{
+    mapped = sizeof(RingControl) + RING_BYTES;
+    void *ptr;
+    if (!name)
+        ptr = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    else
+    {
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd != -1)
+            created = name;
+        else if (errno == EEXIST)
+            fd = shm_open(name, O_RDWR, 0666);
+        // both sides size it, so neither can map past the end of the object
+        if (fd == -1 || ftruncate(fd, mapped) == -1)
+        {
+            int saved = errno;
+            if (fd != -1)
+                close(fd);
+            throw system_error(saved, generic_category(), "shm_open ring");
+        }
+        ptr = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if (ptr == MAP_FAILED)
+        throw system_error(errno, generic_category(), "mmap ring");
+    // a fresh mapping is zero-filled: head == tail == 0
+    ctl = (RingControl *)ptr;
+    data = (char *)ptr + sizeof(RingControl);
+}
+
+ShmRingChannel::~ShmRingChannel()
+{
+    munmap(ctl, mapped);
+    if (!created.empty())
+        shm_unlink(created.c_str());
+}
+
+} // namespace synctext
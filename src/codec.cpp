@@ -0,0 +1,302 @@
+#include "synctext/codec.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "synctext/memory.h"
+#include "synctext/perf.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Batch Framing & Compression --------------------
+// LZ4-style block codec: each sequence is a token (literal length << 4 |
+// match length - 4), the literals, and a 16-bit back offset. Matches may
+// reach into a preset dictionary that precedes the data in the window.
+const size_t LZ_MIN_MATCH = 4;
+const int LZ_HASH_BITS = 12;
+
+static uint32_t lz_hash4(const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void lz_put_length(vector<char> &out, size_t len)
+{
+    while (len >= 255)
+    {
+        out.push_back((char)255);
+        len -= 255;
+    }
+    out.push_back((char)len);
+}
+
+static void lz_emit(vector<char> &out, const char *lit, size_t lit_len, size_t offset, size_t match_len)
+{
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t token = (uint8_t)((min(lit_len, (size_t)15) << 4) | min(ml, (size_t)15));
+    out.push_back((char)token);
+    if (lit_len >= 15)
+        lz_put_length(out, lit_len - 15);
+    out.insert(out.end(), lit, lit + lit_len);
+    if (!match_len)
+        return; // final sequence carries literals only
+    out.push_back((char)(offset & 0xFF));
+    out.push_back((char)(offset >> 8));
+    if (ml >= 15)
+        lz_put_length(out, ml - 15);
+}
+
+vector<char> lz_compress(const vector<char> &dict, const char *src, size_t len)
+{
+    vector<char> win(dict);
+    win.insert(win.end(), src, src + len);
+    const size_t base = dict.size();
+    const size_t end = win.size();
+
+    vector<int> table(1 << LZ_HASH_BITS, -1);
+    for (size_t p = 0; p + LZ_MIN_MATCH <= base; ++p)
+        table[lz_hash4(&win[p])] = (int)p;
+
+    vector<char> out;
+    out.reserve(len / 2 + 16);
+    size_t anchor = base, p = base;
+    while (p + LZ_MIN_MATCH <= end)
+    {
+        uint32_t h = lz_hash4(&win[p]);
+        int cand = table[h];
+        table[h] = (int)p;
+        if (cand >= 0 && p - cand <= 0xFFFF && memcmp(&win[cand], &win[p], LZ_MIN_MATCH) == 0)
+        {
+            size_t m = LZ_MIN_MATCH;
+            while (p + m < end && win[cand + m] == win[p + m])
+                m++;
+            lz_emit(out, &win[anchor], p - anchor, p - cand, m);
+            p += m;
+            anchor = p;
+        }
+        else
+            p++;
+    }
+    lz_emit(out, win.data() + anchor, end - anchor, 0, 0);
+    return out;
+}
+
+static bool lz_get_length(const char *src, size_t len, size_t &ip, size_t &value)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= len)
+            return false;
+        b = (uint8_t)src[ip++];
+        value += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz_decompress(const vector<char> &dict, const char *src, size_t len, char *dst, size_t raw_len)
+{
+    vector<char> win(dict);
+    win.reserve(dict.size() + raw_len);
+    const size_t limit = dict.size() + raw_len;
+    size_t ip = 0;
+    while (ip < len)
+    {
+        uint8_t token = (uint8_t)src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_get_length(src, len, ip, lit))
+            return false;
+        if (ip + lit > len || win.size() + lit > limit)
+            return false;
+        win.insert(win.end(), src + ip, src + ip + lit);
+        ip += lit;
+        if (ip == len)
+            break;
+
+        if (ip + 2 > len)
+            return false;
+        size_t offset = (uint8_t)src[ip] | ((size_t)(uint8_t)src[ip + 1] << 8);
+        ip += 2;
+        size_t m = token & 15;
+        if (m == 15 && !lz_get_length(src, len, ip, m))
+            return false;
+        m += LZ_MIN_MATCH;
+        if (offset == 0 || offset > win.size() || win.size() + m > limit)
+            return false;
+        size_t from = win.size() - offset;
+        for (size_t k = 0; k < m; ++k)
+            win.push_back(win[from + k]); // overlapping copies repeat the pattern
+    }
+    if (win.size() != limit)
+        return false;
+    memcpy(dst, win.data() + dict.size(), raw_len);
+    return true;
+}
+
+uint32_t fnv1a(const char *p, size_t n)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ (uint8_t)p[i]) * 16777619u;
+    return h ? h : 1;
+}
+
+uint32_t dictionary_id(const string &doc, const vector<char> &bytes)
+{
+    string keyed = doc;
+    keyed.push_back('\0');
+    keyed.append(bytes.begin(), bytes.end());
+    return fnv1a(keyed.data(), keyed.size());
+}
+
+// Builds a dictionary from the document snapshot: 64-byte segments are scored
+// by how often their 4-grams recur, and the best ones are kept. The strongest
+// segments go last so matches against them use the shortest offsets, followed
+// by an empty "replace" UpdateObject so the first op of a batch also matches.
+vector<char> train_dictionary(const vector<string> &lines)
+{
+    const size_t SEGMENT = 64;
+    string text;
+    for (auto &ln : lines)
+        text += ln + "\n";
+
+    unordered_map<uint32_t, int> freq;
+    for (size_t p = 0; p + 4 <= text.size(); ++p)
+        freq[lz_hash4(&text[p])]++;
+
+    vector<pair<long, size_t>> segments; // (score, start)
+    for (size_t s = 0; s < text.size(); s += SEGMENT)
+    {
+        long score = 0;
+        size_t e = min(text.size(), s + SEGMENT);
+        for (size_t p = s; p + 4 <= e; ++p)
+            score += freq[lz_hash4(&text[p])] - 1;
+        segments.push_back({score, s});
+    }
+    sort(segments.begin(), segments.end(), [](const pair<long, size_t> &a, const pair<long, size_t> &b)
+         { return a.first > b.first; });
+
+    UpdateObject skeleton{};
+    strncpy(skeleton.op_type, "replace", sizeof(skeleton.op_type)-1);
+    size_t budget = DICT_MAX_BYTES - sizeof(skeleton);
+
+    vector<size_t> picked;
+    size_t used = 0;
+    for (auto &seg : segments)
+    {
+        size_t n = min(SEGMENT, text.size() - seg.second);
+        if (used + n > budget)
+            break;
+        picked.push_back(seg.second);
+        used += n;
+    }
+
+    vector<char> dict;
+    for (auto it = picked.rbegin(); it != picked.rend(); ++it)
+    {
+        size_t n = min(SEGMENT, text.size() - *it);
+        dict.insert(dict.end(), text.begin() + *it, text.begin() + *it + n);
+    }
+    const char *sk = (const char *)&skeleton;
+    dict.insert(dict.end(), sk, sk + sizeof(skeleton));
+    return dict;
+}
+
+vector<char> build_frame(const string &doc, const char *payload, size_t payload_len, uint16_t count, size_t raw_len,
+                         uint16_t flags, uint32_t dict_id)
+{
+    BatchHeader hdr{};
+    hdr.magic = BATCH_MAGIC;
+    strncpy(hdr.doc, doc.c_str(), sizeof(hdr.doc)-1);
+    hdr.flags = flags;
+    hdr.count = count;
+    hdr.dict_id = (flags & FRAME_COMPRESSED) ? dict_id : 0;
+    hdr.raw_len = raw_len;
+    hdr.payload_len = payload_len;
+
+    vector<char> frame(sizeof(hdr) + payload_len);
+    memcpy(frame.data(), &hdr, sizeof(hdr));
+    memcpy(frame.data() + sizeof(hdr), payload, payload_len);
+    return frame;
+}
+
+shared_ptr<const vector<char>> share_frame(vector<char> frame)
+{
+    size_t bytes = frame.capacity();
+    memory_charge(MEM_QUEUES, bytes);
+    return shared_ptr<const vector<char>>(new vector<char>(std::move(frame)), [bytes](const vector<char> *f)
+                                          { memory_release(MEM_QUEUES, bytes); delete f; });
+}
+
+bool decode_batch(const BatchHeader &hdr, const char *payload, size_t payload_len, vector<UpdateObject> &ops,
+                  const WireDict *dict)
+{
+    PerfScope perf(STAGE_DECODE);
+    if (hdr.raw_len != hdr.count * sizeof(UpdateObject))
+        return false;
+    ops.resize(hdr.count);
+    if (!(hdr.flags & FRAME_COMPRESSED))
+    {
+        if (payload_len != hdr.raw_len)
+            return false;
+        memcpy(ops.data(), payload, hdr.raw_len);
+        return true;
+    }
+    if (!dict || hdr.dict_id != dict->id)
+        return false;
+    return lz_decompress(dict->bytes, payload, payload_len, (char *)ops.data(), hdr.raw_len);
+}
+
+Lane lane_of(const vector<UpdateObject> &ops)
+{
+    if (ops.size() > INTERACTIVE_MAX_OPS)
+        return LANE_BULK;
+    for (auto &u : ops)
+        if (u.new_len || strcmp(u.op_type, "bulk") == 0)
+            return LANE_BULK;
+    return LANE_INTERACTIVE;
+}
+
+shared_ptr<const vector<char>> BatchEncoder::frame_for(bool peer_has_dict)
+{
+    bool wants_packed = dict && peer_has_dict && raw_len >= COMPRESS_MIN_BYTES;
+    if (wants_packed && !tried_packing)
+    {
+        tried_packing = true;
+        vector<char> packed = lz_compress(dict->bytes, raw, raw_len);
+        if (packed.size() < raw_len)
+            packed_frame =
+                share_frame(build_frame(doc, packed.data(), packed.size(), count, raw_len, FRAME_COMPRESSED | lane_flags, dict->id));
+    }
+    if (wants_packed && packed_frame)
+        return packed_frame;
+    if (!raw_frame)
+        raw_frame = share_frame(build_frame(doc, raw, raw_len, count, raw_len, lane_flags));
+    return raw_frame;
+}
+
+ssize_t read_full(int fd, void *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = read(fd, (char *)buf + got, len - got);
+        if (n > 0)
+            got += n;
+        else if (n == -1 && errno == EINTR)
+            continue;
+        else
+            return got ? (ssize_t)got : n;
+    }
+    return got;
+}
+
+} // namespace synctext
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+#include "synctext/registry.h"
+#include "transports.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- FIFO Transport --------------------
+// Every user reads /tmp/pipe_<user_id>; senders find each other in the shm
+// registry and write one frame per batch with a non-blocking open, waiting
+// for room in a full pipe rather than dropping the frame.
+static string pipe_name(const string &user_id)
+{
+    return "/tmp/pipe_" + user_id;
+}
+
+// Writes all of frame, waiting up to STREAM_STALL_MS for the reader. The
+// kernel keeps only writes up to PIPE_BUF whole, and a large frame goes in
+// several, so every writer holds an exclusive lock on the pipe while its
+// frame goes in: a small frame can't land inside a large one.
+static bool write_frame(int fd, const vector<char> &frame)
+{
+    bool locked = flock(fd, LOCK_EX) == 0;
+    auto give_up = chrono::steady_clock::now() + chrono::milliseconds(STREAM_STALL_MS);
+    size_t done = 0;
+    while (done < frame.size())
+    {
+        ssize_t w = write(fd, frame.data() + done, frame.size() - done);
+        if (w > 0)
+        {
+            done += w;
+            continue;
+        }
+        if (w == -1 && errno == EINTR)
+            continue;
+        auto left = chrono::duration_cast<chrono::milliseconds>(give_up - chrono::steady_clock::now());
+        if (w == -1 && errno != EAGAIN)
+            break;
+        if (left.count() <= 0)
+        {
+            errno = EAGAIN;
+            break;
+        }
+        pollfd pfd{fd, POLLOUT, 0};
+        poll(&pfd, 1, left.count());
+    }
+    if (locked)
+        flock(fd, LOCK_UN);
+    return done == frame.size();
+}
+
+static bool frame_start(const BatchHeader &hdr)
+{
+    return hdr.magic == BATCH_MAGIC && hdr.payload_len <= MAX_FRAME_BYTES;
+}
+
+// After a bad header (a frame cut short by a writer that gave up): drops
+// the bytes of hdr before the next BATCH_MAGIC, or before a partial one at
+// its end, and moves the rest to the front. Returns the bytes kept.
+static size_t resync(BatchHeader &hdr)
+{
+    char *raw = (char *)&hdr;
+    size_t at = 1;
+    for (; at < sizeof(hdr); ++at)
+        if (memcmp(raw + at, &BATCH_MAGIC, min(sizeof(BATCH_MAGIC), sizeof(hdr) - at)) == 0)
+            break;
+    memmove(raw, raw + at, sizeof(hdr) - at);
+    return sizeof(hdr) - at;
+}
+
+class FifoTransport : public Transport
+{
+public:
+    explicit FifoTransport(Session &s) : session(s) {}
+
+    ~FifoTransport() override
+    {
+        stop();
+        if (reactor_fd != -1)
+            close(reactor_fd);
+        if (keepalive != -1)
+            close(keepalive);
+    }
+
+    void start() override
+    {
+        // each document's dictionary is published by the session as it opens
+        vector<PeerInfo> users = register_user(session.user_id(), session.config().compress ? CAP_COMPRESS : 0);
+        string active;
+        for (auto &u : users)
+            active += (active.empty() ? "" : ", ") + u.user_id;
+        session.log(LogKind::Notice, "Registered user: " + session.user_id() + "\nActive users: " + active);
+
+        string p = pipe_name(session.user_id());
+        if (mkfifo(p.c_str(), 0666) == -1 && errno != EEXIST)
+            throw system_error(errno, generic_category(), "mkfifo " + p);
+        session.log(LogKind::Info, "Pipe created: " + p);
+
+        if (Reactor *r = session.reactor())
+            listen_loop(*r);
+        else
+            listener = thread(&FifoTransport::listener_thread, this);
+    }
+
+    void stop() override
+    {
+        if (!listener.joinable())
+            return;
+        stopping.store(true);
+        // a writer coming and going wakes a blocked open() or read()
+        int fd = open(pipe_name(session.user_id()).c_str(), O_WRONLY | O_NONBLOCK);
+        if (fd != -1)
+            close(fd);
+        listener.join();
+    }
+
+    void send(const string &doc, const vector<UpdateObject> &ops, Lane lane) override
+    {
+        shared_ptr<const WireDict> dict = session.wire_dict(doc);
+        BatchEncoder enc(doc, ops.data(), ops.size(), dict.get(), lane);
+        for (auto &peer : registered_peers())
+        {
+            if (peer.user_id == session.user_id())
+                continue;
+
+            // compress only for peers that advertised our dictionary of doc
+            bool peer_has_dict = dict && (peer.caps & CAP_COMPRESS) && peer.dict_for(doc) == dict->id;
+            auto frame = enc.frame_for(peer_has_dict);
+
+            string p = pipe_name(peer.user_id);
+            int fd = open(p.c_str(), O_WRONLY | O_NONBLOCK);
+            if (fd != -1)
+            {
+                if (!write_frame(fd, *frame))
+                {
+                    // don't crash on write failure; just report it
+                    session.log(LogKind::Error, "Write failed to " + p + " : " + strerror(errno));
+                }
+                close(fd);
+            }
+        }
+        log_packed(session, enc);
+    }
+
+    void send_text(const shared_ptr<const vector<char>> &frame) override
+    {
+        for (auto &peer : registered_peers())
+        {
+            if (peer.user_id == session.user_id())
+                continue;
+            string p = pipe_name(peer.user_id);
+            int fd = open(p.c_str(), O_WRONLY | O_NONBLOCK);
+            if (fd == -1)
+                continue;
+            if (!write_frame(fd, *frame))
+                session.log(LogKind::Error, "Write failed to " + p + " : " + strerror(errno));
+            close(fd);
+        }
+    }
+
+private:
+    // Hands one frame read off the pipe to the session.
+    void dispatch(const BatchHeader &hdr, const vector<char> &payload, vector<UpdateObject> &batch,
+                  const string &p)
+    {
+        auto dict = session.wire_dict(string(hdr.doc, strnlen(hdr.doc, sizeof(hdr.doc))));
+        if (hdr.flags & FRAME_TEXT)
+            session.deliver_text(hdr, payload.data(), payload.size());
+        else if (decode_batch(hdr, payload.data(), payload.size(), batch, dict.get()))
+            session.deliver(hdr, batch);
+        else
+            session.log(LogKind::Warning, "Dropped undecodable batch on " + p);
+    }
+
+    void listener_thread()
+    {
+        string p = pipe_name(session.user_id());
+        int fd = open(p.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            session.log(LogKind::Error, "open listener " + p + ": " + strerror(errno));
+            return;
+        }
+
+        BatchHeader hdr;
+        size_t have = 0; // of hdr, kept by a resync
+        bool lost = false;
+        vector<char> payload;
+        vector<UpdateObject> batch;
+        while (!stopping.load())
+        {
+            ssize_t n = read_full(fd, (char *)&hdr + have, sizeof(hdr) - have);
+            if (n <= 0)
+            {
+                this_thread::sleep_for(chrono::milliseconds(100));
+                continue;
+            }
+            if (have + n != sizeof(hdr))
+            {
+                session.log(LogKind::Warning, "Dropped malformed frame on " + p);
+                have = 0;
+                continue;
+            }
+            if (!frame_start(hdr))
+            {
+                if (!lost)
+                    session.log(LogKind::Warning, "Dropped malformed frame on " + p + "; skipping to the next one");
+                lost = true;
+                have = resync(hdr);
+                continue;
+            }
+            have = 0;
+            lost = false;
+            payload.resize(hdr.payload_len);
+            if (read_full(fd, payload.data(), payload.size()) != (ssize_t)payload.size())
+            {
+                session.log(LogKind::Warning, "Dropped undecodable batch on " + p);
+                continue;
+            }
+            dispatch(hdr, payload, batch, p);
+        }
+        close(fd);
+    }
+
+    // Async sessions read the FIFO from the reactor instead of a thread.
+    Detached listen_loop(Reactor &r)
+    {
+        string p = pipe_name(session.user_id());
+        reactor_fd = open(p.c_str(), O_RDONLY | O_NONBLOCK);
+        keepalive = open(p.c_str(), O_WRONLY); // reads wait instead of seeing EOF
+        if (reactor_fd == -1 || keepalive == -1)
+        {
+            session.log(LogKind::Error, "open listener " + p + ": " + strerror(errno));
+            co_return;
+        }
+
+        BatchHeader hdr;
+        size_t have = 0; // of hdr, kept by a resync
+        bool lost = false;
+        vector<char> payload;
+        vector<UpdateObject> batch;
+        while (true)
+        {
+            if (!co_await async_read_exact(r, reactor_fd, (char *)&hdr + have, sizeof(hdr) - have))
+                continue;
+            if (!frame_start(hdr))
+            {
+                if (!lost)
+                    session.log(LogKind::Warning, "Dropped malformed frame on " + p + "; skipping to the next one");
+                lost = true;
+                have = resync(hdr);
+                continue;
+            }
+            have = 0;
+            lost = false;
+            payload.resize(hdr.payload_len);
+            if (!co_await async_read_exact(r, reactor_fd, payload.data(), payload.size()))
+            {
+                session.log(LogKind::Warning, "Dropped undecodable batch on " + p);
+                continue;
+            }
+            dispatch(hdr, payload, batch, p);
+        }
+    }
+
+    Session &session;
+    thread listener;
+    atomic<bool> stopping{false};
+    int reactor_fd = -1, keepalive = -1;
+};
+
+unique_ptr<Transport> make_fifo_transport(Session &session)
+{
+    return make_unique<FifoTransport>(session);
+}
+
+} // namespace synctext
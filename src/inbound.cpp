@@ -0,0 +1,276 @@
+#include "synctext/inbound.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "synctext/line_index.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Peer Queues --------------------
+void PeerQueues::set_rates(uint32_t ops_per_sec, const unordered_map<string, uint32_t> &overrides)
+{
+    lock_guard<mutex> lock(m);
+    default_rate = ops_per_sec;
+    rates = overrides;
+    for (auto &kv : peers)
+        kv.second.stats.rate = rate_for(kv.second.stats.user_id);
+}
+
+void PeerQueues::set_ceiling(size_t bytes, const string &dir)
+{
+    lock_guard<mutex> lock(m);
+    ceiling = bytes ? max<size_t>(1, bytes / sizeof(UpdateObject)) : 0;
+    spill_dir = dir;
+    spill_over();
+}
+
+uint32_t PeerQueues::rate_for(const string &user_id) const
+{
+    auto it = rates.find(user_id);
+    return it == rates.end() ? default_rate : it->second;
+}
+
+void PeerQueues::refill(Peer &p, long long now_ms) const
+{
+    if (p.stats.rate == 0)
+        return;
+    double earned = (double)(now_ms - p.refilled_ms) * p.stats.rate / 1000;
+    p.tokens = min<double>(p.stats.rate, p.tokens + earned);
+    p.refilled_ms = now_ms;
+}
+
+void PeerQueues::push(const UpdateObject *begin, const UpdateObject *end, Lane lane)
+{
+    lock_guard<mutex> lock(m);
+    Peer *p = nullptr;
+    const char *last = nullptr;
+    for (const UpdateObject *u = begin; u != end; ++u)
+    {
+        if (!last || strncmp(last, u->user_id, sizeof(u->user_id)) != 0)
+        {
+            string user(u->user_id, strnlen(u->user_id, sizeof(u->user_id)));
+            uint32_t site = site_id(user);
+            p = &peers[site];
+            if (p->stats.user_id.empty())
+            {
+                p->stats.user_id = user;
+                p->stats.rate = rate_for(user); // a full bucket to start: refilled_ms is 0
+            }
+            if (!p->active[lane])
+            {
+                p->active[lane] = true;
+                round[lane].push_back(site);
+            }
+            last = u->user_id;
+        }
+        p->ops[lane].push_back(*u);
+        p->stats.received++;
+        p->stats.queued++;
+        if (lane == LANE_BULK)
+        {
+            p->bulk_in++;
+            p->stats.received_bulk++;
+            p->stats.queued_bulk++;
+        }
+        else if (!p->after_bulk.empty() && p->after_bulk.back().second == p->bulk_in)
+            p->after_bulk.back().first++;
+        else
+            p->after_bulk.emplace_back(1, p->bulk_in);
+        p->stats.max_queued = max(p->stats.max_queued, p->stats.queued);
+        total++;
+    }
+    spill_over();
+}
+
+// Moves the oldest in-memory ops of whichever queue holds the most to its
+// spill log until memory is back under the ceiling. If the disk takes no
+// more, the rest stay in memory.
+void PeerQueues::spill_over()
+{
+    while (ceiling && total - on_disk > ceiling)
+    {
+        Peer *most = nullptr;
+        int lane = 0;
+        for (auto &kv : peers)
+            for (int l = 0; l < LANES; ++l)
+                if (!most || kv.second.ops[l].size() > most->ops[lane].size())
+                {
+                    most = &kv.second;
+                    lane = l;
+                }
+        auto &ops = most->ops[lane];
+        unique_ptr<SpillLog> &log = most->spilled[lane];
+        if (!log)
+            log = make_unique<SpillLog>(spill_dir);
+
+        size_t n = min(ops.size(), total - on_disk - ceiling), moved = 0;
+        for (; moved < n && log->append(&ops[moved], sizeof(UpdateObject)); ++moved)
+        {
+            uint32_t seq = ops[moved].seq;
+            uint32_t &lowest = most->spilled_seq[lane];
+            if (seq > 0 && (lowest == 0 || seq < lowest))
+                lowest = seq;
+        }
+        ops.erase(ops.begin(), ops.begin() + moved);
+        on_disk += moved;
+        most->stats.spilled += moved;
+        if (moved < n)
+            return;
+    }
+}
+
+vector<UpdateObject> PeerQueues::drain(size_t budget, long long now_ms)
+{
+    lock_guard<mutex> lock(m);
+    vector<UpdateObject> out;
+    vector<uint32_t> capped;
+    drain_lane(LANE_INTERACTIVE, budget, now_ms, out, capped);
+    drain_lane(LANE_BULK, out.empty() ? budget : min(budget, out.size() + INBOUND_QUANTUM), now_ms, out, capped);
+    return out;
+}
+
+// Deficit round robin over the lane's peers until out holds budget ops.
+// capped: peers already counted as held back by their cap in this drain.
+void PeerQueues::drain_lane(Lane lane, size_t budget, long long now_ms, vector<UpdateObject> &out,
+                            vector<uint32_t> &capped)
+{
+    deque<uint32_t> &turns = round[lane];
+    size_t idle = 0; // peers in a row that could take nothing
+    while (out.size() < budget && !turns.empty() && idle < turns.size())
+    {
+        uint32_t site = turns.front();
+        turns.pop_front();
+        Peer &p = peers[site];
+        auto &ops = p.ops[lane];
+        SpillLog *disk = p.spilled[lane].get();
+        size_t queued = ops.size() + (disk ? disk->size() : 0);
+        refill(p, now_ms);
+        p.deficit[lane] += INBOUND_QUANTUM;
+        size_t n = min({p.deficit[lane], queued, budget - out.size()});
+        if (lane == LANE_INTERACTIVE)
+        {
+            size_t in_order = 0; // ops with no earlier bulk op of this peer still queued
+            for (auto &run : p.after_bulk)
+            {
+                if (run.second > p.bulk_out)
+                    break;
+                in_order += run.first;
+            }
+            n = min(n, in_order);
+        }
+        bool limited = p.stats.rate && (size_t)p.tokens < n;
+        if (limited)
+            n = (size_t)p.tokens;
+
+        // spilled ops are the oldest: they go first
+        size_t read = disk ? min(n, disk->size()) : 0;
+        for (size_t i = 0; i < read; ++i)
+        {
+            out.emplace_back();
+            memcpy(&out.back(), disk->front().data(), sizeof(UpdateObject));
+            disk->pop();
+        }
+        if (disk && disk->empty())
+            p.spilled_seq[lane] = 0;
+        on_disk -= read;
+        p.stats.spilled -= read;
+        out.insert(out.end(), ops.begin(), ops.begin() + (n - read));
+        ops.erase(ops.begin(), ops.begin() + (n - read));
+        p.deficit[lane] -= n;
+        if (p.stats.rate)
+            p.tokens -= n;
+        p.stats.merged += n;
+        p.stats.queued -= n;
+        if (lane == LANE_BULK)
+        {
+            p.bulk_out += n;
+            p.stats.queued_bulk -= n;
+        }
+        for (size_t left = lane == LANE_INTERACTIVE ? n : 0; left;)
+        {
+            size_t take = min(left, p.after_bulk.front().first);
+            left -= take;
+            if ((p.after_bulk.front().first -= take) == 0)
+                p.after_bulk.pop_front();
+        }
+        total -= n;
+
+        if (queued == n)
+        {
+            p.deficit[lane] = 0;
+            p.active[lane] = false;
+            idle = 0;
+            continue;
+        }
+        idle = n == 0 ? idle + 1 : 0;
+        p.deficit[lane] = min(p.deficit[lane], INBOUND_QUANTUM); // a waiting peer doesn't save up turns
+        if (limited && find(capped.begin(), capped.end(), site) == capped.end())
+        {
+            capped.push_back(site);
+            p.stats.capped++;
+        }
+        turns.push_back(site);
+    }
+}
+
+size_t PeerQueues::size() const
+{
+    lock_guard<mutex> lock(m);
+    return total;
+}
+
+size_t PeerQueues::spilled() const
+{
+    lock_guard<mutex> lock(m);
+    return on_disk;
+}
+
+bool PeerQueues::ready(long long now_ms) const
+{
+    lock_guard<mutex> lock(m);
+    for (auto &turns : round)
+        for (uint32_t site : turns)
+        {
+            const Peer &p = peers.at(site);
+            if (p.stats.rate == 0 || p.tokens + (double)(now_ms - p.refilled_ms) * p.stats.rate / 1000 >= 1)
+                return true;
+        }
+    return false;
+}
+
+VersionVector PeerQueues::hold_back(VersionVector seen) const
+{
+    lock_guard<mutex> lock(m);
+    for (auto &kv : peers)
+    {
+        auto it = seen.find(kv.first);
+        if (it == seen.end())
+            continue;
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            for (auto &u : kv.second.ops[lane])
+                if (u.seq > 0 && u.seq <= it->second)
+                    it->second = u.seq - 1;
+            uint32_t spilled = kv.second.spilled_seq[lane];
+            if (spilled > 0 && spilled <= it->second)
+                it->second = spilled - 1;
+        }
+    }
+    return seen;
+}
+
+vector<PeerStats> PeerQueues::stats() const
+{
+    lock_guard<mutex> lock(m);
+    vector<PeerStats> out;
+    for (auto &kv : peers)
+        out.push_back(kv.second.stats);
+    sort(out.begin(), out.end(), [](const PeerStats &a, const PeerStats &b) { return a.user_id < b.user_id; });
+    return out;
+}
+
+} // namespace synctext
@@ -0,0 +1,286 @@
+#include "synctext/line_index.h"
+
+#include <algorithm>
+
+#include "synctext/codec.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+uint32_t site_id(const string &user_id)
+{
+    uint32_t site = fnv1a(user_id.data(), user_id.size());
+    return site == INITIAL_SITE ? 1 : site;
+}
+
+// -------------------- Treap Helpers --------------------
+void LineIndex::update(Node *n)
+{
+    n->count = 1 + count_of(n->left) + count_of(n->right);
+    n->live = (n->visible ? 1 : 0) + live_of(n->left) + live_of(n->right);
+    if (n->left)
+        n->left->parent = n;
+    if (n->right)
+        n->right->parent = n;
+}
+
+LineIndex::Node *LineIndex::join(Node *a, Node *b)
+{
+    if (!a || !b)
+        return a ? a : b;
+    if (a->prio > b->prio)
+    {
+        a->right = join(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = join(a, b->left);
+    update(b);
+    return b;
+}
+
+void LineIndex::split(Node *t, size_t k, Node *&a, Node *&b)
+{
+    if (!t)
+    {
+        a = b = nullptr;
+        return;
+    }
+    if (count_of(t->left) < k)
+    {
+        split(t->right, k - count_of(t->left) - 1, t->right, b);
+        a = t;
+        update(a);
+        if (b)
+            b->parent = nullptr;
+    }
+    else
+    {
+        split(t->left, k, a, t->left);
+        b = t;
+        update(b);
+        if (a)
+            a->parent = nullptr;
+    }
+}
+
+size_t LineIndex::rank(const Node *n)
+{
+    size_t r = count_of(n->left);
+    for (; n->parent; n = n->parent)
+        if (n == n->parent->right)
+            r += count_of(n->parent->left) + 1;
+    return r;
+}
+
+LineIndex::Node *LineIndex::node_at(size_t k) const
+{
+    Node *n = root;
+    while (n)
+    {
+        size_t left = count_of(n->left);
+        if (k < left)
+            n = n->left;
+        else if (k == left)
+            return n;
+        else
+        {
+            k -= left + 1;
+            n = n->right;
+        }
+    }
+    return nullptr;
+}
+
+LineIndex::Node *LineIndex::make_node(LineId id)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    Node fresh{id, rng, true, DOC_START, DOC_START, nullptr, nullptr, nullptr, 1, 1};
+    Node *n;
+    if (free_nodes.empty())
+    {
+        storage.push_back(fresh);
+        n = &storage.back();
+    }
+    else
+    {
+        n = free_nodes.back();
+        free_nodes.pop_back();
+        *n = fresh;
+    }
+    nodes_by_id[key(id)] = n;
+    if (id.seq > clock)
+        clock = id.seq;
+    return n;
+}
+
+// -------------------- Line Index --------------------
+void LineIndex::reset(size_t n)
+{
+    root = nullptr;
+    storage.clear();
+    free_nodes.clear();
+    graves.clear();
+    nodes_by_id.clear();
+    clock = 0;
+    for (size_t i = 0; i < n; ++i)
+        root = join(root, make_node({INITIAL_SITE, (uint32_t)i + 1}));
+    if (root)
+        root->parent = nullptr;
+}
+
+long LineIndex::insert(LineId after, LineId id)
+{
+    size_t k = 0;
+    if (after != DOC_START)
+    {
+        auto it = nodes_by_id.find(key(after));
+        if (it == nodes_by_id.end())
+            return -1;
+        k = rank(it->second) + 1;
+    }
+    // skip concurrent inserts after the same line that sort first, and
+    // everything inserted after them (their seqs are higher still)
+    size_t total = count_of(root);
+    for (; k < total; ++k)
+    {
+        LineId next = node_at(k)->id;
+        if (next.seq < id.seq || (next.seq == id.seq && next.site < id.site))
+            break;
+    }
+
+    Node *n = make_node(id);
+    Node *a, *b;
+    split(root, k, a, b);
+    root = join(join(a, n), b);
+    root->parent = nullptr;
+    return position(id);
+}
+
+long LineIndex::erase(LineId id, LineId by)
+{
+    auto it = nodes_by_id.find(key(id));
+    if (it == nodes_by_id.end() || !it->second->visible)
+        return -1;
+    long pos = position(id);
+    Node *n = it->second;
+    n->visible = false;
+    n->deleted_by = by;
+    graves.push_back(n);
+    for (; n; n = n->parent)
+        n->live--;
+    return pos;
+}
+
+void LineIndex::changed(LineId id, LineId by)
+{
+    auto it = nodes_by_id.find(key(id));
+    if (it == nodes_by_id.end())
+        return;
+    LineId &last = it->second->changed_by;
+    if (by.seq > last.seq || (by.seq == last.seq && by.site > last.site))
+        last = by;
+}
+
+LineId LineIndex::last_change(LineId id) const
+{
+    auto it = nodes_by_id.find(key(id));
+    if (it == nodes_by_id.end())
+        return DOC_START;
+    return it->second->changed_by == DOC_START ? id : it->second->changed_by;
+}
+
+long LineIndex::position(LineId id) const
+{
+    auto it = nodes_by_id.find(key(id));
+    if (it == nodes_by_id.end() || !it->second->visible)
+        return -1;
+    const Node *n = it->second;
+    size_t pos = live_of(n->left);
+    for (; n->parent; n = n->parent)
+        if (n == n->parent->right)
+            pos += live_of(n->parent->left) + (n->parent->visible ? 1 : 0);
+    return pos;
+}
+
+LineId LineIndex::at(size_t pos) const
+{
+    Node *n = root;
+    while (n)
+    {
+        size_t left = live_of(n->left);
+        if (pos < left)
+            n = n->left;
+        else if (pos == left && n->visible)
+            return n->id;
+        else
+        {
+            pos -= left + (n->visible ? 1 : 0);
+            n = n->right;
+        }
+    }
+    return DOC_START;
+}
+
+LineId LineIndex::visible_before(LineId id) const
+{
+    auto it = nodes_by_id.find(key(id));
+    if (it == nodes_by_id.end())
+        return DOC_START;
+    const Node *n = it->second;
+    size_t before = live_of(n->left);
+    for (; n->parent; n = n->parent)
+        if (n == n->parent->right)
+            before += live_of(n->parent->left) + (n->parent->visible ? 1 : 0);
+    return before == 0 ? DOC_START : at(before - 1);
+}
+
+size_t LineIndex::size() const
+{
+    return live_of(root);
+}
+
+size_t LineIndex::tombstones() const
+{
+    return count_of(root) - live_of(root);
+}
+
+// -------------------- Compaction --------------------
+size_t LineIndex::compact(const VersionVector &stable, size_t budget)
+{
+    size_t dropped = 0;
+    for (size_t seen = min(budget, graves.size()); seen > 0; --seen)
+    {
+        Node *n = graves.front();
+        graves.pop_front();
+        if (version_of(stable, n->deleted_by.site) < n->deleted_by.seq)
+        {
+            graves.push_back(n); // not stable yet
+            continue;
+        }
+        Node *a, *mid, *b;
+        split(root, rank(n), a, b);
+        split(b, 1, mid, b);
+        root = join(a, b);
+        if (root)
+            root->parent = nullptr;
+        nodes_by_id.erase(key(n->id));
+        free_nodes.push_back(n);
+        dropped++;
+    }
+    return dropped;
+}
+
+// Approximate heap cost of one unordered_map entry (node and bucket slot).
+static const size_t MAP_ENTRY_BYTES = 40;
+
+size_t LineIndex::memory_bytes() const
+{
+    return count_of(root) * (sizeof(Node) + MAP_ENTRY_BYTES) + graves.size() * sizeof(Node *);
+}
+
+} // namespace synctext
@@ -0,0 +1,224 @@
+#include "synctext/line_offsets.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Treap Helpers --------------------
+void LineOffsets::update(Node *n)
+{
+    n->count = 1 + count_of(n->left) + count_of(n->right);
+    n->sum = n->len + 1 + sum_of(n->left) + sum_of(n->right);
+}
+
+LineOffsets::Node *LineOffsets::join(Node *a, Node *b)
+{
+    if (!a || !b)
+        return a ? a : b;
+    if (a->prio > b->prio)
+    {
+        a->right = join(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = join(a, b->left);
+    update(b);
+    return b;
+}
+
+void LineOffsets::split(Node *t, size_t k, Node *&a, Node *&b)
+{
+    if (!t)
+    {
+        a = b = nullptr;
+        return;
+    }
+    if (count_of(t->left) < k)
+    {
+        split(t->right, k - count_of(t->left) - 1, t->right, b);
+        a = t;
+        update(a);
+    }
+    else
+    {
+        split(t->left, k, a, t->left);
+        b = t;
+        update(b);
+    }
+}
+
+LineOffsets::Node *LineOffsets::node_at(size_t pos) const
+{
+    Node *n = root;
+    while (n)
+    {
+        size_t left = count_of(n->left);
+        if (pos < left)
+            n = n->left;
+        else if (pos == left)
+            return n;
+        else
+        {
+            pos -= left + 1;
+            n = n->right;
+        }
+    }
+    return nullptr;
+}
+
+LineOffsets::Node *LineOffsets::make_node(size_t len)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    Node fresh{(uint32_t)len, rng, nullptr, nullptr, 1, len + 1};
+    if (free_nodes.empty())
+    {
+        storage.push_back(fresh);
+        return &storage.back();
+    }
+    Node *n = free_nodes.back();
+    free_nodes.pop_back();
+    *n = fresh;
+    return n;
+}
+
+// -------------------- Line Offsets --------------------
+void LineOffsets::reset(const vector<string> &lines)
+{
+    root = nullptr;
+    storage.clear();
+    free_nodes.clear();
+
+    // Cartesian tree in one pass: the right spine lives on a stack, and
+    // every node popped off it is final, so its sums can be taken then
+    vector<Node *> spine;
+    for (auto &line : lines)
+    {
+        Node *n = make_node(line.size());
+        Node *last = nullptr;
+        while (!spine.empty() && spine.back()->prio < n->prio)
+        {
+            last = spine.back();
+            spine.pop_back();
+            update(last);
+        }
+        n->left = last;
+        if (!spine.empty())
+            spine.back()->right = n;
+        spine.push_back(n);
+    }
+    if (!spine.empty())
+        root = spine.front();
+    while (!spine.empty())
+    {
+        update(spine.back());
+        spine.pop_back();
+    }
+}
+
+void LineOffsets::insert(size_t pos, size_t len)
+{
+    Node *a, *b;
+    split(root, pos, a, b);
+    root = join(join(a, make_node(len)), b);
+}
+
+void LineOffsets::erase(size_t pos)
+{
+    Node *a, *rest, *gone, *b;
+    split(root, pos, a, rest);
+    split(rest, 1, gone, b);
+    if (gone)
+        free_nodes.push_back(gone);
+    root = join(a, b);
+}
+
+void LineOffsets::set(size_t pos, size_t len)
+{
+    // walk down to the line, then fix the sums on the way back up
+    vector<Node *> path;
+    for (Node *n = root; n;)
+    {
+        path.push_back(n);
+        size_t left = count_of(n->left);
+        if (pos < left)
+            n = n->left;
+        else if (pos == left)
+        {
+            n->len = len;
+            break;
+        }
+        else
+        {
+            pos -= left + 1;
+            n = n->right;
+        }
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it)
+        update(*it);
+}
+
+size_t LineOffsets::size() const
+{
+    return count_of(root);
+}
+
+size_t LineOffsets::bytes() const
+{
+    return sum_of(root);
+}
+
+size_t LineOffsets::length(size_t pos) const
+{
+    Node *n = node_at(pos);
+    return n ? n->len : 0;
+}
+
+size_t LineOffsets::offset_of(size_t line) const
+{
+    size_t offset = 0;
+    for (Node *n = root; n;)
+    {
+        size_t left = count_of(n->left);
+        if (line <= left)
+            n = n->left;
+        else
+        {
+            offset += sum_of(n->left) + n->len + 1;
+            line -= left + 1;
+            n = n->right;
+        }
+    }
+    return offset;
+}
+
+LinePos LineOffsets::locate(size_t offset) const
+{
+    if (offset >= bytes())
+        return {size(), 0};
+    size_t line = 0;
+    for (Node *n = root; n;)
+    {
+        size_t left = sum_of(n->left);
+        if (offset < left)
+            n = n->left;
+        else if (offset <= left + n->len)
+            return {line + count_of(n->left), offset - left};
+        else
+        {
+            offset -= left + n->len + 1;
+            line += count_of(n->left) + 1;
+            n = n->right;
+        }
+    }
+    return {size(), 0};
+}
+
+size_t LineOffsets::memory_bytes() const
+{
+    return sizeof(*this) + storage.size() * sizeof(Node) + free_nodes.capacity() * sizeof(Node *);
+}
+
+} // namespace synctext
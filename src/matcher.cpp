@@ -0,0 +1,97 @@
+#include "synctext/matcher.h"
+
+#include <deque>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Pattern Set --------------------
+PatternSet::PatternSet(vector<string> list) : patterns(std::move(list))
+{
+    if (patterns.size() < 2)
+        return;
+
+    // trie, with -1 for missing edges
+    next.assign(256, -1);
+    output.assign(1, -1);
+    for (size_t k = 0; k < patterns.size(); ++k)
+    {
+        int32_t state = 0;
+        for (unsigned char c : patterns[k])
+        {
+            if (next[state * 256 + c] < 0)
+            {
+                next[state * 256 + c] = output.size();
+                next.resize(next.size() + 256, -1);
+                output.push_back(-1);
+            }
+            state = next[state * 256 + c];
+        }
+        output[state] = k;
+    }
+
+    // breadth first: fill missing edges from the failure state, which is
+    // shallower and so already complete
+    vector<int32_t> fail(output.size(), 0);
+    more.assign(output.size(), 0);
+    deque<int32_t> queue;
+    for (int c = 0; c < 256; ++c)
+    {
+        int32_t &to = next[c];
+        if (to < 0)
+            to = 0;
+        else
+            queue.push_back(to);
+    }
+    while (!queue.empty())
+    {
+        int32_t state = queue.front();
+        queue.pop_front();
+        int32_t f = fail[state];
+        more[state] = output[f] >= 0 ? f : more[f];
+        for (int c = 0; c < 256; ++c)
+        {
+            int32_t &to = next[state * 256 + c];
+            if (to < 0)
+                to = next[f * 256 + c];
+            else
+            {
+                fail[to] = next[f * 256 + c];
+                queue.push_back(to);
+            }
+        }
+    }
+}
+
+void PatternSet::find(const string &text, vector<PatternMatch> &out) const
+{
+    if (patterns.size() == 1)
+    {
+        const string &p = patterns[0];
+        for (size_t at = text.find(p); at != string::npos; at = text.find(p, at + p.size()))
+            out.push_back({0, at});
+        return;
+    }
+    if (patterns.empty())
+        return;
+
+    vector<size_t> free_from(patterns.size(), 0); // where each pattern's next match may start
+    int32_t state = 0;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        state = next[state * 256 + (unsigned char)text[i]];
+        for (int32_t s = output[state] >= 0 ? state : more[state]; s > 0; s = more[s])
+        {
+            size_t k = output[s], at = i + 1 - patterns[k].size();
+            if (at >= free_from[k])
+            {
+                out.push_back({k, at});
+                free_from[k] = i + 1;
+            }
+        }
+    }
+}
+
+} // namespace synctext
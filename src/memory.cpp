@@ -0,0 +1,96 @@
+#include "synctext/memory.h"
+
+#include <atomic>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Counters --------------------
+struct Counters
+{
+    atomic<uint64_t> live{0}, peak{0}, allocations{0};
+};
+
+static Counters counters[MEM_TAGS];
+
+const char *mem_tag_name(MemTag tag)
+{
+    static const char *names[MEM_TAGS] = {"document", "op queues", "notifications", "merge"};
+    return tag < MEM_TAGS ? names[tag] : "?";
+}
+
+MemoryUsage memory_usage(MemTag tag)
+{
+    MemoryUsage u;
+    u.live = counters[tag].live.load(memory_order_relaxed);
+    u.peak = counters[tag].peak.load(memory_order_relaxed);
+    u.allocations = counters[tag].allocations.load(memory_order_relaxed);
+    return u;
+}
+
+void memory_charge(MemTag tag, size_t bytes)
+{
+    Counters &c = counters[tag];
+    uint64_t live = c.live.fetch_add(bytes, memory_order_relaxed) + bytes;
+    uint64_t peak = c.peak.load(memory_order_relaxed);
+    while (live > peak && !c.peak.compare_exchange_weak(peak, live, memory_order_relaxed))
+        ;
+}
+
+void memory_allocated(MemTag tag, size_t bytes)
+{
+    memory_charge(tag, bytes);
+    counters[tag].allocations.fetch_add(1, memory_order_relaxed);
+}
+
+void memory_release(MemTag tag, size_t bytes)
+{
+    counters[tag].live.fetch_sub(bytes, memory_order_relaxed);
+}
+
+// -------------------- Tagged Resource --------------------
+class TaggedResource : public pmr::memory_resource
+{
+public:
+    explicit TaggedResource(MemTag tag) : tag(tag) {}
+
+private:
+    void *do_allocate(size_t bytes, size_t align) override
+    {
+        void *p = pmr::new_delete_resource()->allocate(bytes, align);
+        memory_allocated(tag, bytes);
+        return p;
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override
+    {
+        memory_release(tag, bytes);
+        pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    MemTag tag;
+};
+
+pmr::memory_resource *tagged_resource(MemTag tag)
+{
+    static TaggedResource resources[MEM_TAGS] = {TaggedResource(MEM_DOCUMENT), TaggedResource(MEM_QUEUES),
+                                                 TaggedResource(MEM_NOTIFY), TaggedResource(MEM_MERGE)};
+    return &resources[tag];
+}
+
+// -------------------- Memory Charge --------------------
+void MemoryCharge::set(size_t bytes)
+{
+    if (bytes > held)
+        memory_charge(tag, bytes - held);
+    else if (bytes < held)
+        memory_release(tag, held - bytes);
+    held = bytes;
+}
+
+} // namespace synctext
@@ -0,0 +1,987 @@
+#include "synctext/merge.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory_resource>
+#include <unordered_map>
+
+#include "synctext/matcher.h"
+#include "synctext/memory.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// Edit distance above which diff_lines stops searching for the shortest
+// script and pairs the remaining lines up by position.
+static const int MAX_DIFF_EDITS = 2048;
+
+// A merge's bookkeeping comes from a pool over MEM_MERGE that is dropped
+// when the merge returns.
+typedef pmr::vector<const UpdateObject *> OpRefs;
+
+static bool is_op(const UpdateObject &u, const char *type)
+{
+    return strncmp(u.op_type, type, sizeof(u.op_type)) == 0;
+}
+
+static string user_of(const UpdateObject &u)
+{
+    return string(u.user_id, strnlen(u.user_id, sizeof(u.user_id)));
+}
+
+// Full byte lengths of an op's texts, which old_len and new_len give when
+// the fields cut them short.
+static size_t old_length(const UpdateObject &u)
+{
+    return u.old_len ? u.old_len : strnlen(u.old_content, sizeof(u.old_content));
+}
+
+static size_t new_length(const UpdateObject &u)
+{
+    return u.new_len ? u.new_len : strnlen(u.new_content, sizeof(u.new_content));
+}
+
+// Text an incoming op writes: its field, or the streamed whole of it.
+static string_view new_text(const LineTracking &track, const UpdateObject &u)
+{
+    if (u.new_len && track.texts)
+        if (const string *whole = track.texts->find(u))
+            return *whole;
+    return {u.new_content, strnlen(u.new_content, sizeof(u.new_content))};
+}
+
+// Column table of line id for reading op columns; scratch holds it when
+// there is no cache.
+static const ColumnTable &columns_of(const LineTracking &track, LineId id, const string &line, ColumnTable &scratch)
+{
+    if (track.columns)
+        return track.columns->table(id, line);
+    scratch = ColumnTable(line, COLUMNS_BYTES);
+    return scratch;
+}
+
+// -------------------- Bulk Replace --------------------
+// Visible positions of the first and last line a bulk op covers; a deleted
+// end line gives way to its visible neighbour inside the range. first >
+// last if nothing is left.
+static pair<long, long> bulk_range(const LineIndex &index, const UpdateObject &u)
+{
+    long first = index.position(u.line_id);
+    if (first < 0)
+    {
+        LineId before = index.visible_before(u.line_id);
+        first = before == DOC_START ? 0 : index.position(before) + 1;
+    }
+    long last = index.position(u.after);
+    if (last < 0)
+    {
+        LineId before = index.visible_before(u.after);
+        last = before == DOC_START ? -1 : index.position(before);
+    }
+    return {first, last};
+}
+
+// The sender's base version rides in the unused ends of a bulk op's text
+// fields, after each terminator: a count, then that many (site, seq) pairs.
+static size_t text_end(const char *field, size_t size)
+{
+    return min(strnlen(field, size) + 1, size);
+}
+
+static bool put_base(UpdateObject &bulk, const VersionVector &base)
+{
+    vector<char> bytes(1);
+    for (auto &kv : base)
+    {
+        if (kv.first == INITIAL_SITE || kv.second == 0)
+            continue;
+        uint32_t pair[2] = {kv.first, kv.second};
+        bytes.insert(bytes.end(), (const char *)pair, (const char *)pair + sizeof(pair));
+    }
+    size_t n = (bytes.size() - 1) / (2 * sizeof(uint32_t));
+    size_t a = text_end(bulk.old_content, sizeof(bulk.old_content));
+    size_t b = text_end(bulk.new_content, sizeof(bulk.new_content));
+    size_t room = sizeof(bulk.old_content) - a;
+    if (n > 255 || bytes.size() > room + sizeof(bulk.new_content) - b)
+        return false;
+    bytes[0] = (char)n;
+    size_t first = min(bytes.size(), room);
+    memcpy(bulk.old_content + a, bytes.data(), first);
+    memcpy(bulk.new_content + b, bytes.data() + first, bytes.size() - first);
+    return true;
+}
+
+static VersionVector bulk_base(const UpdateObject &bulk)
+{
+    size_t a = text_end(bulk.old_content, sizeof(bulk.old_content));
+    size_t b = text_end(bulk.new_content, sizeof(bulk.new_content));
+    string bytes(bulk.old_content + a, sizeof(bulk.old_content) - a);
+    bytes.append(bulk.new_content + b, sizeof(bulk.new_content) - b);
+    VersionVector base;
+    size_t n = bytes.empty() ? 0 : (unsigned char)bytes[0];
+    for (size_t k = 0; k < n && 1 + (k + 1) * 2 * sizeof(uint32_t) <= bytes.size(); ++k)
+    {
+        uint32_t pair[2];
+        memcpy(pair, bytes.data() + 1 + k * sizeof(pair), sizeof(pair));
+        base[pair[0]] = pair[1];
+    }
+    return base;
+}
+
+// One "replace" per occurrence of each bulk op's pattern in the lines it
+// covers, stamped like the bulk op, so they meet other replaces in the
+// merge as if the sender had sent them. All patterns are matched in a
+// single pass over each line. A line is only rewritten if the sender had
+// seen it as it is: the insert that made it and its last rewrite are both
+// in the op's base version.
+static void expand_bulk(const vector<string> &doc, const LineIndex &index, const OpRefs &bulks,
+                        const LineTracking &track, pmr::vector<UpdateObject> &expanded)
+{
+    struct Range
+    {
+        const UpdateObject *op;
+        long first, last;
+        size_t pattern;
+        VersionVector base;
+
+        bool seen(LineId id) const { return id.site == INITIAL_SITE || id.seq <= version_of(base, id.site); }
+    };
+    vector<string> patterns;
+    vector<Range> ranges;
+    for (auto *u : bulks)
+    {
+        string pattern(u->old_content, strnlen(u->old_content, sizeof(u->old_content)));
+        auto [first, last] = bulk_range(index, *u);
+        last = min(last, (long)doc.size() - 1);
+        if (pattern.empty() || first > last)
+            continue;
+        size_t k = find(patterns.begin(), patterns.end(), pattern) - patterns.begin();
+        if (k == patterns.size())
+            patterns.push_back(pattern);
+        ranges.push_back({u, first, last, k, bulk_base(*u)});
+    }
+    sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) { return a.first < b.first; });
+    PatternSet set(patterns);
+
+    vector<PatternMatch> matches;
+    vector<const Range *> active; // ranges holding pos
+    size_t opened = 0;
+    long unvisited = 0;
+    for (auto &range : ranges)
+    {
+        long pos = max(unvisited, range.first);
+        unvisited = max(unvisited, range.last + 1);
+        for (; pos <= range.last; ++pos)
+        {
+            matches.clear();
+            set.find(doc[pos], matches);
+            if (matches.empty())
+                continue;
+            while (opened < ranges.size() && ranges[opened].first <= pos)
+                active.push_back(&ranges[opened++]);
+            erase_if(active, [&](const Range *r) { return r->last < pos; });
+
+            LineId id = index.at(pos);
+            ColumnTable scratch;
+            const ColumnTable &cols = columns_of(track, id, doc[pos], scratch);
+            for (auto &m : matches)
+            {
+                const Range *by = nullptr;
+                for (auto *r : active)
+                    if (r->pattern == m.pattern && r->seen(id) && r->seen(index.last_change(id)))
+                    {
+                        by = r;
+                        break;
+                    }
+                if (!by)
+                    continue;
+                UpdateObject op = *by->op;
+                memset(op.op_type, 0, sizeof(op.op_type));
+                strcpy(op.op_type, "replace");
+                op.line = pos;
+                op.line_id = id;
+                op.after = {};
+                // end_col covers the old text only: matches can be adjacent
+                op.start_col = cols.to_col(m.at);
+                op.end_col = cols.to_col(m.at + patterns[m.pattern].size());
+                expanded.push_back(op);
+            }
+        }
+    }
+}
+
+static bool word_byte(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || (unsigned char)c >= 0x80;
+}
+
+static size_t word_start(const string &s, size_t i)
+{
+    while (i > 0 && word_byte(s[i - 1]))
+        i--;
+    return i;
+}
+
+static size_t word_end(const string &s, size_t i)
+{
+    while (i < s.size() && word_byte(s[i]))
+        i++;
+    return i;
+}
+
+// text with every group's pattern replaced as expand_bulk would: each
+// pattern's leftmost non-overlapping matches, all against the original.
+// mask gets the groups that matched; false if two patterns overlap.
+static bool apply_groups(const string &text, const PatternSet &set, const vector<pair<string, string>> &groups,
+                         string &out, uint64_t &mask)
+{
+    vector<PatternMatch> matches;
+    set.find(text, matches);
+    sort(matches.begin(), matches.end(), [](auto &a, auto &b) { return a.at < b.at; });
+    out.clear();
+    mask = 0;
+    size_t from = 0;
+    for (auto &m : matches)
+    {
+        if (m.at < from)
+            return false;
+        out.append(text, from, m.at - from);
+        out += groups[m.pattern].second;
+        from = m.at + groups[m.pattern].first.size();
+        mask |= 1ull << m.pattern;
+    }
+    out.append(text, from, string::npos);
+    return true;
+}
+
+vector<UpdateObject> pack_bulk(const vector<UpdateObject> &ops, const vector<string> &doc, const LineIndex &index,
+                               const VersionVector &base, ColumnUnit unit)
+{
+    if (ops.size() < BULK_MIN_LINES)
+        return ops;
+    auto key = [](LineId id) { return (uint64_t)id.site << 32 | id.seq; };
+    unordered_map<uint64_t, int> ops_on; // per line
+    for (auto &u : ops)
+        ops_on[key(u.line_id)]++;
+
+    // each replace that is the only op on its line, with the line as it
+    // was before, and guesses at the find-and-replace: the edit widened to
+    // the words around it, and the words where it starts and ends, for
+    // lines it hit more than once
+    struct Edit
+    {
+        size_t op;
+        long pos;
+        string before;
+        uint64_t groups = 0;  // whose pattern is in before
+        uint64_t covered = 0; // whose runs include it
+        bool packed = false;
+    };
+    vector<Edit> edits;
+    map<pair<string, string>, size_t> guessed;
+    for (size_t i = 0; i < ops.size(); ++i)
+    {
+        const UpdateObject &u = ops[i];
+        size_t old_n = strnlen(u.old_content, sizeof(u.old_content));
+        size_t new_n = strnlen(u.new_content, sizeof(u.new_content));
+        if (!is_op(u, "replace") || ops_on[key(u.line_id)] != 1 || u.old_len || u.new_len ||
+            old_n >= sizeof(u.old_content) - 1 || new_n >= sizeof(u.new_content) - 1) // content may have been cut short
+            continue;
+        long pos = index.position(u.line_id);
+        if (pos < 0 || pos >= (long)doc.size())
+            continue;
+        const string &line = doc[pos];
+        size_t sb = ColumnTable(line, unit).to_byte(u.start_col);
+        if (sb + new_n > line.size() || line.compare(sb, new_n, u.new_content, new_n) != 0)
+            continue; // changed again since
+        string old_part(u.old_content, old_n);
+        edits.push_back({i, pos, line.substr(0, sb) + old_part + line.substr(sb + new_n)});
+        const string &before = edits.back().before;
+
+        // before and line share everything outside [sb, sb + old_n) and
+        // [sb, sb + new_n)
+        size_t l = word_start(line, sb), ne = sb + new_n, oe = sb + old_n, r = word_end(line, ne);
+        pair<string, string> guesses[3] = {
+            {before.substr(l, r - ne + oe - l), line.substr(l, r - l)},
+            {before.substr(l, word_end(before, sb) - l), line.substr(l, word_end(line, sb) - l)},
+            {before.substr(word_start(before, oe), r - ne + oe - word_start(before, oe)),
+             line.substr(word_start(line, ne), r - word_start(line, ne))}};
+        for (int k = 0; k < 3; ++k)
+        {
+            auto &[pattern, replacement] = guesses[k];
+            bool again = (k > 0 && guesses[k] == guesses[0]) || (k > 1 && guesses[k] == guesses[1]);
+            if (!again && !pattern.empty() && pattern != replacement && pattern.size() < sizeof(u.old_content) &&
+                replacement.size() < sizeof(u.new_content))
+                guessed[guesses[k]]++;
+        }
+    }
+    sort(edits.begin(), edits.end(), [](const Edit &a, const Edit &b) { return a.pos < b.pos; });
+
+    // find-and-replaces: guesses that explain enough lines, most common
+    // (then shortest) first; a guess the ones before it already explain,
+    // such as a line holding two of them, is not one
+    vector<pair<string, string>> groups;
+    vector<string> patterns;
+    {
+        vector<pair<size_t, const pair<string, string> *>> guesses;
+        for (auto &kv : guessed)
+            if (kv.second >= BULK_MIN_LINES)
+                guesses.push_back({kv.second, &kv.first});
+        sort(guesses.begin(), guesses.end(), [](auto &a, auto &b) {
+            if (a.first != b.first)
+                return a.first > b.first;
+            return a.second->first.size() < b.second->first.size();
+        });
+        string out;
+        uint64_t mask;
+        for (auto &guess : guesses)
+        {
+            auto &[pattern, replacement] = *guess.second;
+            if (groups.size() == 64 || find(patterns.begin(), patterns.end(), pattern) != patterns.end())
+                continue;
+            if (!groups.empty() && apply_groups(pattern, PatternSet(patterns), groups, out, mask) && out == replacement)
+                continue;
+            groups.push_back(*guess.second);
+            patterns.push_back(pattern);
+        }
+    }
+    if (groups.empty())
+        return ops;
+
+    // a line can go in bulk ops if the groups whose pattern it held, applied
+    // the way receivers apply them, turn it into what it is now
+    PatternSet set(patterns);
+    unordered_map<long, size_t> edit_at;
+    string after;
+    for (size_t e = 0; e < edits.size(); ++e)
+    {
+        Edit &edit = edits[e];
+        edit_at[edit.pos] = e;
+        edit.packed = apply_groups(edit.before, set, groups, after, edit.groups) && edit.groups &&
+                      after == doc[edit.pos];
+    }
+
+    // each group covers runs of at least BULK_MIN_LINES of its lines with no
+    // line between that receivers would rewrite wrongly: one holding the
+    // pattern before this batch (or now, if the batch did not edit it) that
+    // is not going in the group's ops. A line left out of one of its
+    // groups' runs goes per line, which can break others' runs, so repeat
+    // until nothing changes.
+    struct Run
+    {
+        size_t group, first, last, lines; // first, last: edits
+    };
+    vector<Run> runs;
+    auto gap_clear = [&](size_t g, long from, long to) {
+        for (long p = from + 1; p < to; ++p)
+        {
+            auto it = edit_at.find(p);
+            if (it != edit_at.end())
+            {
+                // a packed line holding the pattern would be in the run
+                const Edit &edit = edits[it->second];
+                if (!edit.packed && edit.before.find(patterns[g]) != string::npos)
+                    return false;
+            }
+            else if (ops_on.count(key(index.at(p))) || doc[p].find(patterns[g]) != string::npos)
+                return false;
+        }
+        return true;
+    };
+    for (bool changed = true; changed;)
+    {
+        runs.clear();
+        for (auto &edit : edits)
+            edit.covered = 0;
+        for (size_t g = 0; g < groups.size(); ++g)
+        {
+            vector<size_t> members;
+            for (size_t e = 0; e < edits.size(); ++e)
+                if (edits[e].packed && (edits[e].groups >> g & 1))
+                    members.push_back(e);
+            size_t start = 0;
+            for (size_t k = 1; k <= members.size(); ++k)
+            {
+                if (k < members.size() && gap_clear(g, edits[members[k - 1]].pos, edits[members[k]].pos))
+                    continue;
+                if (k - start >= BULK_MIN_LINES)
+                {
+                    runs.push_back({g, members[start], members[k - 1], k - start});
+                    for (size_t t = start; t < k; ++t)
+                        edits[members[t]].covered |= 1ull << g;
+                }
+                start = k;
+            }
+        }
+        changed = false;
+        for (auto &edit : edits)
+            if (edit.packed && edit.covered != edit.groups)
+            {
+                edit.packed = false;
+                changed = true;
+            }
+    }
+    if (runs.empty())
+        return ops;
+
+    // each bulk op takes the place of the latest op it covers; if the base
+    // version does not fit beside a pattern, everything goes line by line
+    vector<bool> packed(ops.size(), false);
+    multimap<size_t, UpdateObject> bulks;
+    for (auto &run : runs)
+    {
+        size_t latest = edits[run.first].op;
+        for (size_t e = run.first; e <= run.last; ++e)
+            if (edits[e].packed && (edits[e].groups >> run.group & 1) && ops[edits[e].op].seq > ops[latest].seq)
+                latest = edits[e].op;
+        UpdateObject bulk = ops[latest];
+        memset(bulk.op_type, 0, sizeof(bulk.op_type));
+        strcpy(bulk.op_type, "bulk");
+        bulk.line = edits[run.first].pos;
+        bulk.line_id = ops[edits[run.first].op].line_id;
+        bulk.after = ops[edits[run.last].op].line_id;
+        bulk.start_col = run.lines;
+        bulk.end_col = 0;
+        memset(bulk.old_content, 0, sizeof(bulk.old_content));
+        memset(bulk.new_content, 0, sizeof(bulk.new_content));
+        copy_content(bulk.old_content, groups[run.group].first);
+        copy_content(bulk.new_content, groups[run.group].second);
+        if (!put_base(bulk, base))
+            return ops;
+        for (size_t e = run.first; e <= run.last; ++e)
+            if (edits[e].packed && (edits[e].groups >> run.group & 1))
+                packed[edits[e].op] = true;
+        bulks.insert({latest, bulk});
+    }
+
+    vector<UpdateObject> wire;
+    for (size_t i = 0; i < ops.size(); ++i)
+    {
+        if (!packed[i])
+            wire.push_back(ops[i]);
+        auto range = bulks.equal_range(i);
+        for (auto it = range.first; it != range.second; ++it)
+            wire.push_back(it->second);
+    }
+    return wire;
+}
+
+// -------------------- Merge & Apply (structure) --------------------
+// Applies incoming inserts and deletes through the index, retrying ops
+// whose line arrives later in the same batch. Replaces on known lines are
+// returned in replaces, along with those bulk ops expand to (held in
+// expanded); ops still unresolved are returned.
+static vector<UpdateObject> apply_structure(vector<string> &doc, LineIndex &index,
+                                            const vector<UpdateObject> &incoming, OpRefs &replaces,
+                                            pmr::vector<UpdateObject> &expanded, const LineTracking &track)
+{
+    pmr::memory_resource *arena = replaces.get_allocator().resource();
+    OpRefs pending(arena), bulks(arena);
+    pending.reserve(incoming.size());
+    for (auto &u : incoming)
+        pending.push_back(&u);
+
+    for (auto &u : incoming)
+        index.witness(u.seq);
+
+    bool progress = true;
+    while (progress && !pending.empty())
+    {
+        progress = false;
+        OpRefs waiting(arena);
+        for (auto *u : pending)
+        {
+            if (is_op(*u, "insert") && !index.contains(u->line_id))
+            {
+                long pos = index.insert(u->after, u->line_id);
+                if (pos < 0)
+                {
+                    waiting.push_back(u);
+                    continue;
+                }
+                pos = min((size_t)pos, doc.size());
+                // a streamed line moves in as the buffer it was assembled in
+                if (u->new_len && track.texts && track.texts->find(*u))
+                    doc.insert(doc.begin() + pos, track.texts->take(*u));
+                else
+                    doc.insert(doc.begin() + pos, string(new_text(track, *u)));
+                if (track.blame)
+                    track.blame->insert_lines(pos, 1, user_of(*u), u->ts);
+                if (track.offsets)
+                    track.offsets->insert(pos, doc[pos].size());
+                if (track.changed)
+                    track.changed->insert(pos);
+                if (track.trigrams)
+                    track.trigrams->set(u->line_id, doc[pos]);
+            }
+            else if (is_op(*u, "insert"))
+                continue; // already have it: our own op coming back, or a duplicate
+            else if (!index.contains(u->line_id) || (is_op(*u, "bulk") && !index.contains(u->after)))
+            {
+                waiting.push_back(u);
+                continue;
+            }
+            else if (is_op(*u, "delete"))
+            {
+                long pos = index.erase(u->line_id, {site_id(user_of(*u)), u->seq});
+                if (pos >= 0 && pos < (long)doc.size())
+                {
+                    doc.erase(doc.begin() + pos);
+                    if (track.columns)
+                        track.columns->invalidate(u->line_id);
+                    if (track.trigrams)
+                        track.trigrams->erase(u->line_id);
+                    if (track.blame)
+                        track.blame->erase_lines(pos, 1);
+                    if (track.offsets)
+                        track.offsets->erase(pos);
+                    if (track.changed)
+                        track.changed->erase(pos);
+                }
+            }
+            else if (is_op(*u, "bulk"))
+                bulks.push_back(u);
+            else
+                replaces.push_back(u);
+            progress = true;
+        }
+        pending.swap(waiting);
+    }
+
+    // bulk ops read the lines as this batch's inserts and deletes left them
+    expand_bulk(doc, index, bulks, track, expanded);
+    for (auto &u : expanded)
+        replaces.push_back(&u);
+
+    vector<UpdateObject> deferred;
+    for (auto *u : pending)
+        deferred.push_back(*u);
+    return deferred;
+}
+
+// -------------------- Merge & Apply (CRDT LWW) --------------------
+bool ranges_overlap(int a1, int b1, int a2, int b2)
+{
+    return !(b1 <= a2 || b2 <= a1);
+}
+
+vector<UpdateObject> merge_updates(vector<string> &doc, LineIndex &index, const vector<UpdateObject> &applied,
+                                   const vector<UpdateObject> &incoming, const LineTracking &track)
+{
+    pmr::unsynchronized_pool_resource arena(tagged_resource(MEM_MERGE));
+    OpRefs replaces(&arena);
+    pmr::vector<UpdateObject> expanded(&arena);
+    vector<UpdateObject> deferred = apply_structure(doc, index, incoming, replaces, expanded, track);
+
+    // our own replaces compete but are already in doc
+    size_t incoming_n = replaces.size();
+    for (auto &u : applied)
+        if (is_op(u, "replace"))
+            replaces.push_back(&u);
+
+    int n = replaces.size();
+    pmr::vector<bool> keep(n, true, &arena);
+
+    // only replaces on the same line compete
+    pmr::unordered_map<uint64_t, pmr::vector<int>> same_line(&arena);
+    for (int i = 0; i < n; ++i)
+        same_line[(uint64_t)replaces[i]->line_id.site << 32 | replaces[i]->line_id.seq].push_back(i);
+
+    for (auto &kv : same_line)
+    {
+        const pmr::vector<int> &line = kv.second;
+        for (size_t x = 0; x < line.size(); ++x)
+        {
+            int i = line[x];
+            if (!keep[i]) continue;
+            const UpdateObject &a = *replaces[i];
+            for (size_t y = x + 1; y < line.size(); ++y)
+            {
+                int j = line[y];
+                if (!keep[j]) continue;
+                const UpdateObject &b = *replaces[j];
+                if (ranges_overlap(a.start_col, a.end_col, b.start_col, b.end_col))
+                {
+                    if (a.ts > b.ts)
+                        keep[j] = false;
+                    else if (a.ts < b.ts)
+                    {
+                        keep[i] = false;
+                        break;
+                    }
+                    else
+                    {
+                        if (strcmp(a.user_id, b.user_id) <= 0)
+                            keep[j] = false;
+                        else
+                        {
+                            keep[i] = false;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    pmr::unordered_map<long, OpRefs> updates_by_line(&arena);
+    for (size_t i = 0; i < incoming_n; ++i)
+    {
+        long line_no = index.position(replaces[i]->line_id);
+        if (keep[i] && line_no >= 0 && line_no < (long)doc.size())
+            updates_by_line[line_no].push_back(replaces[i]);
+    }
+
+    for (auto &kv : updates_by_line)
+    {
+        auto &ops = kv.second;
+        sort(ops.begin(), ops.end(), [](const UpdateObject *a, const UpdateObject *b)
+             { return a->start_col > b->start_col; });
+
+        // right to left, so the columns left of each op still read off the
+        // line as it was
+        LineId id = index.at(kv.first);
+        ColumnTable scratch;
+        const ColumnTable &cols = columns_of(track, id, doc[kv.first], scratch);
+        string base = doc[kv.first];
+        for (auto *op : ops)
+        {
+            // end_col spans the new text too; only old_content is replaced
+            int sc = cols.to_byte(max(0, op->start_col));
+            long ec = sc + (long)old_length(*op);
+            if (sc > (int)base.size()) sc = base.size();
+            if (ec > (long)base.size()) ec = base.size();
+            string_view text = new_text(track, *op);
+            base.replace(sc, ec - sc, text);
+            if (track.blame)
+                track.blame->replace(kv.first, sc, ec - sc, text.size(), user_of(*op), op->ts);
+            index.changed(id, {site_id(user_of(*op)), op->seq});
+        }
+        doc[kv.first] = base;
+        if (track.columns)
+            track.columns->invalidate(id);
+        if (track.trigrams)
+            track.trigrams->set(id, base);
+        if (track.offsets)
+            track.offsets->set(kv.first, base.size());
+        if (track.changed)
+            track.changed->replace(kv.first);
+    }
+    return deferred;
+}
+
+// -------------------- Merge & Apply (sequence) --------------------
+vector<UpdateObject> merge_sequence(vector<string> &doc, LineIndex &index, const vector<UpdateObject> &,
+                                    const vector<UpdateObject> &incoming, const LineTracking &track)
+{
+    pmr::unsynchronized_pool_resource arena(tagged_resource(MEM_MERGE));
+    OpRefs replaces(&arena);
+    pmr::vector<UpdateObject> expanded(&arena);
+    vector<UpdateObject> deferred = apply_structure(doc, index, incoming, replaces, expanded, track);
+
+    pmr::unordered_map<long, OpRefs> ops_by_line(&arena);
+    for (auto *u : replaces)
+    {
+        long line_no = index.position(u->line_id);
+        if (line_no >= 0 && line_no < (long)doc.size())
+            ops_by_line[line_no].push_back(u);
+    }
+
+    for (auto &kv : ops_by_line)
+    {
+        const string &base = doc[kv.first];
+        int len = base.size();
+        LineId id = index.at(kv.first);
+        ColumnTable scratch;
+        const ColumnTable &cols = columns_of(track, id, base, scratch);
+        auto &ops = kv.second;
+        sort(ops.begin(), ops.end(), [](const UpdateObject *a, const UpdateObject *b) {
+            if (a->ts != b->ts)
+                return a->ts < b->ts;
+            return strcmp(a->user_id, b->user_id) < 0;
+        });
+
+        // deleted[c]: some op removed base column c; inserts[c]: text that
+        // goes before column c (c == len appends)
+        vector<bool> deleted(len, false);
+        vector<string> inserts(len + 1);
+        for (auto *op : ops)
+        {
+            int sc = cols.to_byte(max(0, op->start_col));
+            int ec = min((long)sc + (long)old_length(*op), (long)len);
+            for (int c = sc; c < ec; ++c)
+                deleted[c] = true;
+            inserts[sc].append(new_text(track, *op));
+            index.changed(id, {site_id(user_of(*op)), op->seq});
+        }
+
+        string merged;
+        merged.reserve(len);
+        for (int c = 0; c <= len; ++c)
+        {
+            merged += inserts[c];
+            if (c < len && !deleted[c])
+                merged += base[c];
+        }
+        if (track.blame)
+        {
+            size_t head = 0, tail = 0;
+            while (head < base.size() && head < merged.size() && base[head] == merged[head])
+                head++;
+            while (tail < base.size() - head && tail < merged.size() - head &&
+                   base[base.size() - 1 - tail] == merged[merged.size() - 1 - tail])
+                tail++;
+            track.blame->replace(kv.first, head, base.size() - head - tail, merged.size() - head - tail,
+                           user_of(*ops.back()), ops.back()->ts);
+        }
+        if (track.offsets)
+            track.offsets->set(kv.first, merged.size());
+        if (track.changed)
+            track.changed->replace(kv.first);
+        if (track.columns)
+            track.columns->invalidate(id);
+        if (track.trigrams)
+            track.trigrams->set(id, merged);
+        doc[kv.first] = std::move(merged);
+    }
+    return deferred;
+}
+
+// -------------------- Change Detection (line diff) --------------------
+bool myers_matches(const vector<string> &a, const vector<string> &b, int max_d, vector<pair<int, int>> &matches)
+{
+    int n = a.size(), m = b.size(), offset = n + m + 1;
+    vector<int> v(2 * offset + 1, 0);
+    vector<vector<int>> trace; // trace[d][k + d]: furthest x on diagonal k after d edits
+
+    int d_end = -1;
+    for (int d = 0; d <= min(n + m, max_d) && d_end < 0; ++d)
+    {
+        for (int k = -d; k <= d; k += 2)
+        {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1]
+                                                                                  : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y])
+                x++, y++;
+            v[offset + k] = x;
+            if (x >= n && y >= m)
+                d_end = d;
+        }
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+    }
+    if (d_end < 0)
+        return false;
+
+    int x = n, y = m;
+    for (int d = d_end; d > 0; --d)
+    {
+        const vector<int> &prev = trace[d - 1]; // prev[k + d - 1]
+        int k = x - y;
+        int prev_k = (k == -d || (k != d && prev[k - 1 + d - 1] < prev[k + 1 + d - 1])) ? k + 1 : k - 1;
+        int prev_x = prev[prev_k + d - 1], prev_y = prev_x - prev_k;
+        while (x > prev_x && y > prev_y)
+            matches.push_back({--x, --y});
+        x = prev_x;
+        y = prev_y;
+    }
+    while (x > 0 && y > 0)
+        matches.push_back({--x, --y});
+    reverse(matches.begin(), matches.end());
+    return true;
+}
+
+void track_local(const LineTracking &track, const vector<UpdateObject> &ops, const vector<string> &doc,
+                 const LineIndex &index)
+{
+    for (auto &u : ops)
+    {
+        if (is_op(u, "insert"))
+        {
+            if (track.blame)
+                track.blame->insert_lines(u.line, 1, user_of(u), u.ts);
+            if (track.offsets)
+                track.offsets->insert(u.line, 0);
+            if (track.changed)
+                track.changed->insert(u.line);
+        }
+        else if (is_op(u, "delete"))
+        {
+            if (track.blame)
+                track.blame->erase_lines(u.line, 1);
+            if (track.offsets)
+                track.offsets->erase(u.line);
+            if (track.changed)
+                track.changed->erase(u.line);
+        }
+        else if (u.line >= 0 && u.line < (int)doc.size())
+        {
+            if (track.changed)
+                track.changed->replace(u.line);
+            if (!track.blame)
+                continue;
+            ColumnTable cols(doc[u.line], track.columns ? track.columns->unit() : COLUMNS_BYTES);
+            track.blame->replace(u.line, cols.to_byte(u.start_col), old_length(u), new_length(u), user_of(u), u.ts);
+        }
+    }
+    // ops carry truncated text, so lengths come from the lines themselves,
+    // found by id once every op is in
+    for (auto &u : ops)
+    {
+        if (track.columns)
+            track.columns->invalidate(u.line_id);
+        long pos = index.position(u.line_id);
+        bool present = !is_op(u, "delete") && pos >= 0 && pos < (long)doc.size();
+        if (track.offsets && present)
+            track.offsets->set(pos, doc[pos].size());
+        if (track.trigrams && present)
+            track.trigrams->set(u.line_id, doc[pos]);
+        else if (track.trigrams)
+            track.trigrams->erase(u.line_id);
+    }
+}
+
+void stamp(UpdateObject &upd, const char *type, int line, const string &user_id)
+{
+    strncpy(upd.op_type, type, sizeof(upd.op_type)-1);
+    upd.line = line;
+    strncpy(upd.user_id, user_id.c_str(), sizeof(upd.user_id)-1);
+    time_t now = time(nullptr);
+    upd.ts = (long)now;
+    strncpy(upd.timestamp, ctime(&now), sizeof(upd.timestamp)-1);
+    if (strlen(upd.timestamp)) upd.timestamp[strcspn(upd.timestamp, "\n")] = '\0';
+}
+
+// New text cut short goes whole to long_text to be streamed; with nowhere
+// to go it stays cut.
+static void keep_long_text(UpdateObject &upd, string text, vector<OpText> *long_text)
+{
+    if (upd.new_len == 0)
+        return;
+    if (long_text)
+        long_text->push_back({upd.seq, std::move(text)});
+    else
+        upd.new_len = 0;
+}
+
+// One "replace" for a line edited in place, trimmed to the differing
+// middle, whose new text is left in new_part.
+static bool replace_op(const string &old_line, const string &new_line, UpdateObject &upd, ColumnUnit unit,
+                       string &old_part, string &new_part)
+{
+    int start_col = 0;
+    int minlen = min((int)old_line.size(), (int)new_line.size());
+    while (start_col < minlen && old_line[start_col] == new_line[start_col]) start_col++;
+
+    int old_end = (int)old_line.size();
+    int new_end = (int)new_line.size();
+    while (old_end - 1 >= start_col && new_end - 1 >= start_col &&
+           old_line[old_end - 1] == new_line[new_end - 1])
+    {
+        old_end--; new_end--;
+    }
+
+    // widen to whole characters: the shared prefix and suffix are the same
+    // bytes on both sides, so one check covers both lines
+    auto cont = [](char c) { return ((unsigned char)c & 0xc0) == 0x80; };
+    while (start_col > 0 && start_col < (int)old_line.size() && cont(old_line[start_col])) start_col--;
+    while (start_col > 0 && start_col < (int)new_line.size() && cont(new_line[start_col])) start_col--;
+    while (old_end < (int)old_line.size() && cont(old_line[old_end]))
+    {
+        old_end++; new_end++;
+    }
+
+    old_part = (start_col < old_end) ? old_line.substr(start_col, old_end - start_col) : string("");
+    new_part = (start_col < new_end) ? new_line.substr(start_col, new_end - start_col) : string("");
+    if (old_part == new_part) return false;
+
+    upd.start_col = column_width(old_line.data(), start_col, unit);
+    upd.end_col = upd.start_col + max(column_width(old_part, unit), column_width(new_part, unit));
+    set_text(upd.old_content, upd.old_len, old_part);
+    set_text(upd.new_content, upd.new_len, new_part);
+    return true;
+}
+
+vector<UpdateObject> diff_lines(const vector<string> &old_lines, const vector<string> &new_lines, LineIndex &index,
+                                uint32_t site, const string &user_id, ColumnUnit unit, vector<OpText> *long_text,
+                                vector<OpText> *old_text)
+{
+    int old_n = (int)old_lines.size();
+    int new_n = (int)new_lines.size();
+
+    // common prefix and suffix first: most saves touch a few lines
+    int prefix = 0;
+    while (prefix < old_n && prefix < new_n && old_lines[prefix] == new_lines[prefix]) prefix++;
+    int suffix = 0;
+    while (suffix < old_n - prefix && suffix < new_n - prefix &&
+           old_lines[old_n - 1 - suffix] == new_lines[new_n - 1 - suffix]) suffix++;
+
+    vector<string> old_mid(old_lines.begin() + prefix, old_lines.end() - suffix);
+    vector<string> new_mid(new_lines.begin() + prefix, new_lines.end() - suffix);
+    vector<pair<int, int>> matches;
+    if (!myers_matches(old_mid, new_mid, MAX_DIFF_EDITS, matches))
+        matches.clear(); // too far apart: pair the middle up line by line
+    matches.push_back({(int)old_mid.size(), (int)new_mid.size()});
+
+    // walk the hunks between matches; index positions track new_lines
+    // up to the hunk being emitted
+    vector<UpdateObject> ops;
+    int i = 0, j = 0;
+    for (auto &match : matches)
+    {
+        int deleted = match.first - i, inserted = match.second - j;
+        int paired = min(deleted, inserted);
+        for (int t = 0; t < paired; ++t)
+        {
+            int pos = prefix + j + t;
+            UpdateObject upd{};
+            string old_part, new_part;
+            if (!replace_op(old_mid[i + t], new_mid[j + t], upd, unit, old_part, new_part))
+                continue;
+            upd.line_id = index.at(pos);
+            upd.seq = index.next_id(site).seq;
+            stamp(upd, "replace", pos, user_id);
+            index.changed(upd.line_id, {site, upd.seq});
+            if (upd.old_len && old_text)
+                old_text->push_back({upd.seq, std::move(old_part)});
+            keep_long_text(upd, std::move(new_part), long_text);
+            ops.push_back(upd);
+        }
+        int pos = prefix + j + paired;
+        for (int t = paired; t < deleted; ++t)
+        {
+            UpdateObject upd{};
+            upd.line_id = index.at(pos);
+            upd.after = pos == 0 ? DOC_START : index.at(pos - 1);
+            set_text(upd.old_content, upd.old_len, old_mid[i + t]);
+            stamp(upd, "delete", pos, user_id);
+            upd.seq = index.next_id(site).seq;
+            if (upd.old_len && old_text)
+                old_text->push_back({upd.seq, old_mid[i + t]});
+            index.erase(upd.line_id, {site, upd.seq});
+            ops.push_back(upd);
+        }
+        for (int t = paired; t < inserted; ++t, ++pos)
+        {
+            UpdateObject upd{};
+            upd.after = pos == 0 ? DOC_START : index.at(pos - 1);
+            upd.line_id = index.next_id(site);
+            upd.seq = upd.line_id.seq;
+            set_text(upd.new_content, upd.new_len, new_mid[j + t]);
+            stamp(upd, "insert", pos, user_id);
+            keep_long_text(upd, new_mid[j + t], long_text);
+            index.insert(upd.after, upd.line_id);
+            ops.push_back(upd);
+        }
+        i = match.first + 1;
+        j = match.second + 1;
+    }
+    return ops;
+}
+
+} // namespace synctext
@@ -0,0 +1,193 @@
+#include "synctext/perf.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Totals --------------------
+struct Totals
+{
+    atomic<uint64_t> invocations{0}, wall_ns{0};
+    atomic<uint64_t> counts[PERF_COUNTERS] = {};
+};
+
+static Totals totals[PERF_STAGES];
+static atomic<bool> enabled{false};
+static atomic<uint32_t> available{0};
+
+const char *perf_stage_name(PerfStage stage)
+{
+    static const char *names[PERF_STAGES] = {"scan", "merge", "broadcast", "decode"};
+    return stage < PERF_STAGES ? names[stage] : "?";
+}
+
+const char *perf_counter_name(PerfCounter counter)
+{
+    static const char *names[PERF_COUNTERS] = {"cycles", "instructions", "cache misses", "branch misses",
+                                               "cpu ns", "page faults"};
+    return counter < PERF_COUNTERS ? names[counter] : "?";
+}
+
+StageStats stage_stats(PerfStage stage)
+{
+    StageStats s;
+    s.invocations = totals[stage].invocations.load(memory_order_relaxed);
+    s.wall_ns = totals[stage].wall_ns.load(memory_order_relaxed);
+    for (int c = 0; c < PERF_COUNTERS; ++c)
+        s.counts[c] = totals[stage].counts[c].load(memory_order_relaxed);
+    return s;
+}
+
+bool profiling()
+{
+    return enabled.load(memory_order_relaxed);
+}
+
+uint32_t perf_counters()
+{
+    return available.load(memory_order_relaxed);
+}
+
+// -------------------- Counter Group --------------------
+// One perf_event group per thread, counting that thread in user space
+// (what perf_event_paranoid 2 allows), read in a single read(). CPU time
+// comes from the thread's clock instead, so it includes time in the kernel.
+struct Event
+{
+    PerfCounter counter;
+    uint32_t type;
+    uint64_t config;
+};
+
+static const Event EVENTS[] = {
+    {PERF_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_CACHE_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_PAGE_FAULTS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+static const size_t EVENT_COUNT = sizeof(EVENTS) / sizeof(EVENTS[0]);
+
+struct CounterGroup
+{
+    bool tried = false;
+    int fds[EVENT_COUNT];
+    PerfCounter order[EVENT_COUNT]; // counter at each position of a group read
+    size_t n = 0;
+
+    ~CounterGroup()
+    {
+        for (size_t i = 0; i < n; ++i)
+            close(fds[i]);
+    }
+
+    void open()
+    {
+        tried = true;
+        uint32_t opened = 1u << PERF_CPU_NS;
+        for (auto &e : EVENTS)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = e.type;
+            attr.config = e.config;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // the first counter that opens leads; one with no PMU behind it
+            // (ENOENT, as in most VMs) is left out
+            int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, n ? fds[0] : -1, PERF_FLAG_FD_CLOEXEC);
+            if (fd == -1)
+                continue;
+            fds[n] = fd;
+            order[n++] = e.counter;
+            opened |= 1u << e.counter;
+        }
+        available.fetch_or(opened, memory_order_relaxed);
+    }
+
+    // Counts so far, scaled up if the PMU multiplexed the group.
+    void read(uint64_t counts[PERF_COUNTERS])
+    {
+        if (!tried)
+            open();
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        counts[PERF_CPU_NS] = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+        uint64_t buf[3 + EVENT_COUNT]; // nr, time enabled, time running, values
+        if (n == 0 || ::read(fds[0], buf, sizeof(buf)) < (ssize_t)((3 + n) * sizeof(uint64_t)))
+            return;
+        uint64_t time_enabled = buf[1], time_running = buf[2];
+        for (size_t i = 0; i < n && i < buf[0]; ++i)
+            counts[order[i]] = time_running && time_running < time_enabled
+                                   ? (uint64_t)((double)buf[3 + i] * time_enabled / time_running)
+                                   : buf[3 + i];
+    }
+};
+
+static thread_local CounterGroup group;
+static thread_local PerfScope *innermost = nullptr;
+
+uint32_t enable_profiling()
+{
+    enabled.store(true, memory_order_relaxed);
+    if (!group.tried)
+        group.open();
+    return perf_counters();
+}
+
+static void read_now(PerfScope::Reading &r)
+{
+    memset(r.counts, 0, sizeof(r.counts));
+    group.read(r.counts);
+    r.wall_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// -------------------- Perf Scope --------------------
+PerfScope::PerfScope(PerfStage stage) : stage(stage)
+{
+    if (!profiling())
+        return;
+    active = true;
+    read_now(start);
+    outer = innermost;
+    if (outer)
+        outer->charge(start); // its share so far; it resumes when we end
+    innermost = this;
+}
+
+PerfScope::~PerfScope()
+{
+    if (!active)
+        return;
+    Reading now;
+    read_now(now);
+    charge(now);
+    totals[stage].invocations.fetch_add(1, memory_order_relaxed);
+    innermost = outer;
+    if (outer)
+        outer->start = now;
+}
+
+void PerfScope::charge(const Reading &now)
+{
+    Totals &t = totals[stage];
+    t.wall_ns.fetch_add(now.wall_ns - start.wall_ns, memory_order_relaxed);
+    for (int c = 0; c < PERF_COUNTERS; ++c)
+        if (now.counts[c] > start.counts[c])
+            t.counts[c].fetch_add(now.counts[c] - start.counts[c], memory_order_relaxed);
+    start = now;
+}
+
+} // namespace synctext
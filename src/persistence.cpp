@@ -0,0 +1,56 @@
+#include "synctext/persistence.h"
+
+#include <fstream>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- File Utilities --------------------
+vector<string> read_file(const string &filename)
+{
+    ifstream file(filename);
+    vector<string> lines;
+    string line;
+    while (getline(file, line))
+        lines.push_back(line);
+    return lines;
+}
+
+FileStamp file_stamp(const string &filename)
+{
+    FileStamp stamp;
+    struct stat st;
+    if (stat(filename.c_str(), &st) == 0)
+    {
+        stamp.mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        stamp.size = st.st_size;
+        stamp.ino = st.st_ino;
+    }
+    return stamp;
+}
+
+void write_initial_file(const string &filename)
+{
+    const char *INITIAL_DOC[] = {
+        "Hello World",
+        "This is a collaborative editor",
+        "Welcome to SyncText",
+        "Edit this document and see real-time updates"};
+    ofstream file(filename);
+    for (auto &line : INITIAL_DOC)
+        file << line << "\n";
+    file.close();
+}
+
+void write_file_from_lines(const string &filename, const vector<string> &lines)
+{
+    ofstream file(filename, ios::trunc);
+    for (auto &ln : lines)
+        file << ln << "\n";
+    file.close();
+}
+
+} // namespace synctext
@@ -0,0 +1,129 @@
+#include "synctext/presence.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Presence (shm seqlock table) --------------------
+static bool pid_alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+PresenceBoard::~PresenceBoard()
+{
+    if (!table)
+        return;
+    if (slot != -1)
+        table->slots[slot].owner_pid.store(0, memory_order_release);
+    munmap(table, sizeof(PresenceTable));
+}
+
+bool PresenceBoard::open(const string &document, const string &user_id)
+{
+    if (table)
+        return slot != -1;
+    int shm_fd = shm_open((PRESENCE_SHM_PREFIX + document).c_str(), O_CREAT | O_RDWR, 0666);
+    if (shm_fd == -1)
+        return false;
+    int sized = ftruncate(shm_fd, sizeof(PresenceTable));
+    void *ptr = mmap(0, sizeof(PresenceTable), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    ::close(shm_fd);
+    if (sized == -1 || ptr == MAP_FAILED)
+        return false;
+    table = (PresenceTable *)ptr;
+
+    // claim a free slot, or one whose owner has died
+    int32_t me = getpid();
+    for (int i = 0; i < MAX_PRESENCE && slot == -1; ++i)
+    {
+        PresenceSlot &s = table->slots[i];
+        int32_t owner = s.owner_pid.load(memory_order_acquire);
+        if ((owner == 0 || !pid_alive(owner)) &&
+            s.owner_pid.compare_exchange_strong(owner, me, memory_order_acq_rel))
+            slot = i;
+    }
+    if (slot == -1)
+        return false;
+
+    PresenceSlot &s = table->slots[slot];
+    uint32_t seq = s.seq.load(memory_order_relaxed) | 1;
+    s.seq.store(seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    strncpy(s.user_id, user_id.c_str(), sizeof(s.user_id)-1);
+    s.user_id[sizeof(s.user_id)-1] = '\0';
+    s.line = s.sel_line = {0, 0};
+    s.col = s.sel_col = -1; // no cursor until the first edit
+    s.updated_ms = now_ms();
+    s.seq.store(seq + 1, memory_order_release);
+    return true;
+}
+
+void PresenceBoard::publish(LineId line, int col, LineId sel_line, int sel_col)
+{
+    if (!table || slot == -1)
+        return;
+    PresenceSlot &s = table->slots[slot];
+    uint32_t seq = s.seq.load(memory_order_relaxed);
+    s.seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s.line = line;
+    s.col = col;
+    s.sel_line = sel_line;
+    s.sel_col = sel_col;
+    s.updated_ms = now_ms();
+    s.seq.store(seq + 2, memory_order_release);
+}
+
+vector<Presence> PresenceBoard::read() const
+{
+    vector<Presence> out;
+    if (!table)
+        return out;
+    for (int i = 0; i < MAX_PRESENCE; ++i)
+    {
+        if (i == slot)
+            continue;
+        PresenceSlot &s = table->slots[i];
+        int32_t owner = s.owner_pid.load(memory_order_acquire);
+        if (owner == 0 || !pid_alive(owner))
+            continue;
+
+        Presence p;
+        uint32_t before, after;
+        do
+        {
+            before = s.seq.load(memory_order_acquire);
+            if (before & 1)
+            {
+                this_thread::yield();
+                after = before + 1;
+                continue;
+            }
+            char uid[sizeof(s.user_id)];
+            memcpy(uid, s.user_id, sizeof(uid));
+            p.line = s.line;
+            p.col = s.col;
+            p.sel_line = s.sel_line;
+            p.sel_col = s.sel_col;
+            p.updated_ms = s.updated_ms;
+            atomic_thread_fence(memory_order_acquire);
+            after = s.seq.load(memory_order_relaxed);
+            p.user_id = string(uid, strnlen(uid, sizeof(uid)));
+        } while (before != after);
+        if (p.col >= 0)
+            out.push_back(p);
+    }
+    return out;
+}
+
+} // namespace synctext
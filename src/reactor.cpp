@@ -0,0 +1,132 @@
+#include "synctext/reactor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Coroutine Reactor --------------------
+Reactor::Reactor()
+{
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ep == -1 || wake_fd == -1)
+    {
+        int saved = errno;
+        if (ep != -1)
+            close(ep);
+        if (wake_fd != -1)
+            close(wake_fd);
+        throw system_error(saved, generic_category(), "reactor");
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(ep, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+Reactor::~Reactor()
+{
+    close(ep);
+    close(wake_fd);
+}
+
+void Reactor::post(coroutine_handle<> h)
+{
+    void *addr = h.address();
+    cow_append(ready, &addr, &addr + 1);
+    uint64_t one = 1;
+    (void)!write(wake_fd, &one, sizeof(one)); // EAGAIN: a wakeup is already pending
+}
+
+void Reactor::wait_fd(int fd, uint32_t events, coroutine_handle<> h)
+{
+    epoll_event ev{};
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = h.address();
+    if (epoll_ctl(ep, registered.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) == 0)
+        registered[fd] = true;
+    else
+        post(h); // not pollable; let the caller retry and see the error
+}
+
+void Reactor::stop()
+{
+    stopping.store(true);
+    uint64_t one = 1;
+    (void)!write(wake_fd, &one, sizeof(one));
+}
+
+void Reactor::run()
+{
+    epoll_event events[64];
+    while (!stopping.load())
+    {
+        int timeout = -1;
+        if (!timers.empty())
+        {
+            auto wait = timers.begin()->first - chrono::steady_clock::now();
+            timeout = max(0, (int)chrono::ceil<chrono::milliseconds>(wait).count());
+        }
+        int n = epoll_wait(ep, events, 64, timeout);
+        for (int i = 0; i < n; ++i)
+        {
+            if (!events[i].data.ptr)
+            {
+                uint64_t count;
+                while (read(wake_fd, &count, sizeof(count)) > 0)
+                    ;
+                continue;
+            }
+            coroutine_handle<>::from_address(events[i].data.ptr).resume();
+        }
+        auto woken = cow_take(ready); // keep the snapshot alive for the loop
+        for (void *addr : *woken)
+            coroutine_handle<>::from_address(addr).resume();
+
+        auto now = chrono::steady_clock::now();
+        while (!timers.empty() && timers.begin()->first <= now)
+        {
+            auto h = timers.begin()->second;
+            timers.erase(timers.begin());
+            h.resume();
+        }
+    }
+}
+
+Co<ssize_t> async_read(Reactor &r, int fd, void *buf, size_t len)
+{
+    while (true)
+    {
+        ssize_t n = read(fd, buf, len);
+        if (n >= 0)
+            co_return n;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            co_return -1;
+        co_await FdReady{r, fd, EPOLLIN};
+    }
+}
+
+Co<bool> async_read_exact(Reactor &r, int fd, void *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = co_await async_read(r, fd, (char *)buf + got, len - got);
+        if (n <= 0)
+            co_return false;
+        got += n;
+    }
+    co_return true;
+}
+
+} // namespace synctext
@@ -0,0 +1,263 @@
+#include "synctext/registry.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Shared Memory (Registry) --------------------
+static string user_of(const UserInfo &u)
+{
+    return string(u.user_id, strnlen(u.user_id, sizeof(u.user_id)));
+}
+
+static bool alive(const UserInfo &u)
+{
+    return u.pid > 0 && (kill(u.pid, 0) == 0 || errno == EPERM);
+}
+
+// Calls read(slot) for each of u's document slots until it sees them
+// without a writer in between; read must start over on every call.
+template <typename F>
+static void read_slots(const UserInfo &u, F &&read)
+{
+    uint32_t before, after;
+    do
+    {
+        before = u.vseq.load(memory_order_acquire);
+        if (before & 1)
+        {
+            this_thread::yield();
+            after = before + 1;
+            continue;
+        }
+        read(nullptr);
+        for (int d = 0; d < MAX_VERSION_DOCS; d++)
+            read(&u.docs[d]);
+        atomic_thread_fence(memory_order_acquire);
+        after = u.vseq.load(memory_order_relaxed);
+    } while (before != after);
+}
+
+static vector<PeerInfo> snapshot(const Registry *registry)
+{
+    vector<PeerInfo> peers;
+    for (int i = 0; i < registry->user_count && i < MAX_USERS; i++)
+    {
+        const UserInfo &u = registry->users[i];
+        PeerInfo peer{user_of(u), u.caps, u.pid, {}};
+        read_slots(u, [&](const DocSlot *slot) {
+            if (!slot)
+                peer.dicts.clear();
+            else if (slot->doc[0] && slot->dict_id)
+                peer.dicts[string(slot->doc, strnlen(slot->doc, sizeof(slot->doc)))] = slot->dict_id;
+        });
+        peers.push_back(move(peer));
+    }
+    return peers;
+}
+
+vector<PeerInfo> register_user(const string &user_id, uint32_t caps)
+{
+    int shm_fd = shm_open(REGISTRY_SHM, O_CREAT | O_RDWR, 0666);
+    if (shm_fd == -1)
+        throw system_error(errno, generic_category(), "shm_open registry");
+
+    if (ftruncate(shm_fd, sizeof(Registry)) == -1)
+    {
+        int saved = errno;
+        close(shm_fd);
+        throw system_error(saved, generic_category(), "ftruncate registry");
+    }
+    void *ptr = mmap(0, sizeof(Registry), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (ptr == MAP_FAILED)
+        throw system_error(errno, generic_category(), "mmap registry");
+
+    Registry *registry = (Registry *)ptr;
+    if (registry->user_count < 0 || registry->user_count > MAX_USERS)
+        registry->user_count = 0;
+
+    UserInfo *self = nullptr;
+    for (int i = 0; i < registry->user_count; i++)
+    {
+        if (strcmp(registry->users[i].user_id, user_id.c_str()) == 0)
+            self = &registry->users[i];
+    }
+
+    if (!self && registry->user_count < MAX_USERS)
+    {
+        self = &registry->users[registry->user_count];
+        strncpy(self->user_id, user_id.c_str(), sizeof(self->user_id)-1);
+        self->user_id[sizeof(self->user_id)-1] = '\0';
+        registry->user_count++;
+    }
+
+    // (re)advertise what we can decode so senders negotiate per peer
+    if (self)
+    {
+        self->caps = caps;
+        self->pid = getpid();
+
+        // a new process starts from its file: what the last one published is void
+        uint32_t seq = self->vseq.load(memory_order_relaxed) | 1;
+        self->vseq.store(seq, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memset(self->docs, 0, sizeof(self->docs));
+        self->vseq.store(seq + 1, memory_order_release);
+    }
+
+    vector<PeerInfo> peers = snapshot(registry);
+    munmap(ptr, sizeof(Registry));
+    return peers;
+}
+
+vector<PeerInfo> registered_peers()
+{
+    vector<PeerInfo> peers;
+    int shm_fd = shm_open(REGISTRY_SHM, O_RDONLY, 0666);
+    if (shm_fd == -1)
+        return peers;
+    void *ptr = mmap(0, sizeof(Registry), PROT_READ, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (ptr == MAP_FAILED)
+        return peers;
+    peers = snapshot((const Registry *)ptr);
+    munmap(ptr, sizeof(Registry));
+    return peers;
+}
+
+string registered_user_for_pid(pid_t pid)
+{
+    for (auto &peer : registered_peers())
+        if (peer.pid == pid)
+            return peer.user_id;
+    return "";
+}
+
+// -------------------- Version Vectors --------------------
+// Each user rewrites only its own versions, under its vseq seqlock.
+static Registry *map_registry(bool writable)
+{
+    int shm_fd = shm_open(REGISTRY_SHM, writable ? O_RDWR : O_RDONLY, 0666);
+    if (shm_fd == -1)
+        return nullptr;
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *ptr = mmap(0, sizeof(Registry), prot, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    return ptr == MAP_FAILED ? nullptr : (Registry *)ptr;
+}
+
+// The slot doc has, or a free one it can take; null if user_id is not
+// registered or all are taken.
+static DocSlot *doc_slot(Registry *registry, const string &user_id, const string &doc, UserInfo *&self)
+{
+    self = nullptr;
+    for (int i = 0; i < registry->user_count && i < MAX_USERS; i++)
+        if (user_of(registry->users[i]) == user_id)
+            self = &registry->users[i];
+    DocSlot *slot = nullptr;
+    for (int i = 0; self && i < MAX_VERSION_DOCS && !slot; i++)
+        if (strncmp(self->docs[i].doc, doc.c_str(), sizeof(self->docs[i].doc)) == 0)
+            slot = &self->docs[i];
+    for (int i = 0; self && i < MAX_VERSION_DOCS && !slot; i++)
+        if (self->docs[i].doc[0] == '\0')
+            slot = &self->docs[i];
+    return slot;
+}
+
+// Rewrites user_id's slot for doc under its seqlock.
+template <typename F>
+static bool write_slot(const string &user_id, const string &doc, F &&write)
+{
+    Registry *registry = map_registry(true);
+    if (!registry)
+        return false;
+
+    UserInfo *self;
+    DocSlot *slot = doc_slot(registry, user_id, doc, self);
+    if (slot)
+    {
+        uint32_t seq = self->vseq.load(memory_order_relaxed);
+        self->vseq.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        if (strncmp(slot->doc, doc.c_str(), sizeof(slot->doc)) != 0)
+        {
+            memset(slot, 0, sizeof(*slot));
+            strncpy(slot->doc, doc.c_str(), sizeof(slot->doc) - 1);
+        }
+        write(*slot);
+        self->vseq.store(seq + 2, memory_order_release);
+    }
+    munmap(registry, sizeof(Registry));
+    return slot != nullptr;
+}
+
+bool publish_versions(const string &user_id, const string &doc, const VersionVector &vv)
+{
+    return write_slot(user_id, doc, [&](DocSlot &slot) {
+        slot.n = 0;
+        for (auto &kv : vv)
+        {
+            if (slot.n == (uint32_t)MAX_VERSION_SITES)
+                break;
+            slot.sites[slot.n++] = {kv.first, kv.second};
+        }
+    });
+}
+
+bool publish_dictionary(const string &user_id, const string &doc, uint32_t dict_id)
+{
+    return write_slot(user_id, doc, [&](DocSlot &slot) { slot.dict_id = dict_id; });
+}
+
+bool dictionary_in_use(const string &user_id, const string &doc, uint32_t dict_id)
+{
+    for (auto &peer : registered_peers())
+    {
+        if (peer.user_id == user_id || peer.dict_for(doc) != dict_id || peer.pid <= 0)
+            continue;
+        if (kill(peer.pid, 0) == 0 || errno == EPERM)
+            return true;
+    }
+    return false;
+}
+
+vector<pair<string, VersionVector>> registered_versions(const string &user_id, const string &doc)
+{
+    vector<pair<string, VersionVector>> out;
+    Registry *registry = map_registry(false);
+    if (!registry)
+        return out;
+
+    for (int i = 0; i < registry->user_count && i < MAX_USERS; i++)
+    {
+        const UserInfo &u = registry->users[i];
+        string peer = user_of(u);
+        if (peer == user_id || !alive(u))
+            continue; // gone: it has nothing left in flight
+
+        VersionVector vv;
+        read_slots(u, [&](const DocSlot *slot) {
+            if (!slot)
+                vv.clear();
+            else if (strncmp(slot->doc, doc.c_str(), sizeof(slot->doc)) == 0)
+                for (uint32_t k = 0; k < slot->n && k < (uint32_t)MAX_VERSION_SITES; k++)
+                    vv[slot->sites[k].site] = slot->sites[k].seq;
+        });
+        out.push_back({peer, vv});
+    }
+    munmap(registry, sizeof(Registry));
+    return out;
+}
+
+} // namespace synctext
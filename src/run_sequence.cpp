@@ -0,0 +1,456 @@
+#include "synctext/run_sequence.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace synctext
+{
+
+// Approximate heap cost of one std::map node (three links, colour, key,
+// value) for memory_bytes().
+static const size_t MAP_NODE_BYTES = 48;
+
+RunSequence::RunSequence()
+{
+    first = new Leaf();
+    first->leaf = true;
+    root = first;
+}
+
+RunSequence::~RunSequence()
+{
+    vector<Node *> stack{root};
+    while (!stack.empty())
+    {
+        Node *x = stack.back();
+        stack.pop_back();
+        if (x->leaf)
+        {
+            delete (Leaf *)x;
+            continue;
+        }
+        Inner *in = (Inner *)x;
+        for (int i = 0; i < in->n; ++i)
+            stack.push_back(in->child[i]);
+        delete in;
+    }
+}
+
+// -------------------- Run Helpers --------------------
+bool RunSequence::follows(const Run &a, const Run &b)
+{
+    return a.site == b.site && a.seq + a.len == b.seq && a.text_off + a.len == b.text_off &&
+           a.deleted == b.deleted && b.origin == CharId{a.site, a.seq + a.len - 1};
+}
+
+bool RunSequence::sorts_before(CharId a, CharId b)
+{
+    return a.seq > b.seq || (a.seq == b.seq && a.site > b.site);
+}
+
+// -------------------- B-tree --------------------
+void RunSequence::refresh(Node *node)
+{
+    for (Node *x = node; x; x = x->parent)
+    {
+        size_t total = 0, live = 0;
+        if (x->leaf)
+        {
+            Leaf *leaf = (Leaf *)x;
+            for (int i = 0; i < leaf->n; ++i)
+            {
+                total += leaf->runs[i].len;
+                if (!leaf->runs[i].deleted)
+                    live += leaf->runs[i].len;
+            }
+        }
+        else
+        {
+            Inner *in = (Inner *)x;
+            for (int i = 0; i < in->n; ++i)
+            {
+                total += in->child[i]->total;
+                live += in->child[i]->live;
+            }
+        }
+        x->total = total;
+        x->live = live;
+    }
+}
+
+void RunSequence::insert_child(Inner *parent, Node *after, Node *child)
+{
+    if (!parent)
+    {
+        Inner *grown = new Inner();
+        grown->leaf = false;
+        grown->n = 2;
+        grown->child[0] = after;
+        grown->child[1] = child;
+        after->parent = child->parent = grown;
+        root = grown;
+        inners++;
+        refresh(grown);
+        return;
+    }
+
+    int idx = std::find(parent->child, parent->child + parent->n, after) - parent->child;
+    if (parent->n == FANOUT)
+    {
+        Inner *sibling = new Inner();
+        sibling->leaf = false;
+        inners++;
+        int half = FANOUT / 2;
+        for (int i = half; i < parent->n; ++i)
+        {
+            sibling->child[i - half] = parent->child[i];
+            parent->child[i]->parent = sibling;
+        }
+        sibling->n = parent->n - half;
+        parent->n = half;
+        refresh(sibling); // no parent yet: counts itself only
+        refresh(parent);
+        insert_child(parent->parent, parent, sibling);
+        if (idx >= half)
+        {
+            parent = sibling;
+            idx -= half;
+        }
+    }
+    for (int i = parent->n; i > idx + 1; --i)
+        parent->child[i] = parent->child[i - 1];
+    parent->child[idx + 1] = child;
+    child->parent = parent;
+    parent->n++;
+    refresh(parent);
+}
+
+RunSequence::Pos RunSequence::insert_run(Leaf *leaf, int slot, const Run &run)
+{
+    if (leaf->n == LEAF_RUNS)
+    {
+        Leaf *sibling = new Leaf();
+        sibling->leaf = true;
+        leaves++;
+        int half = LEAF_RUNS / 2;
+        for (int i = half; i < leaf->n; ++i)
+        {
+            sibling->runs[i - half] = leaf->runs[i];
+            by_site[leaf->runs[i].site][leaf->runs[i].seq] = sibling;
+        }
+        sibling->n = leaf->n - half;
+        leaf->n = half;
+        sibling->next = leaf->next;
+        leaf->next = sibling;
+        refresh(sibling);
+        refresh(leaf);
+        insert_child(leaf->parent, leaf, sibling);
+        if (slot > half)
+        {
+            leaf = sibling;
+            slot -= half;
+        }
+    }
+    for (int i = leaf->n; i > slot; --i)
+        leaf->runs[i] = leaf->runs[i - 1];
+    leaf->runs[slot] = run;
+    leaf->n++;
+    by_site[run.site][run.seq] = leaf;
+    runs++;
+    refresh(leaf);
+    return {leaf, slot, 0};
+}
+
+void RunSequence::split_run(Pos at, uint32_t k)
+{
+    Run &r = at.leaf->runs[at.slot];
+    Run tail = r;
+    tail.seq += k;
+    tail.len -= k;
+    tail.text_off += k;
+    tail.origin = {r.site, r.seq + k - 1};
+    r.len = k;
+    insert_run(at.leaf, at.slot + 1, tail);
+}
+
+void RunSequence::coalesce(Leaf *leaf, int slot)
+{
+    // fold runs[i] into runs[i - 1]
+    auto join = [&](int i) {
+        if (i <= 0 || i >= leaf->n || !follows(leaf->runs[i - 1], leaf->runs[i]))
+            return;
+        leaf->runs[i - 1].len += leaf->runs[i].len;
+        by_site[leaf->runs[i].site].erase(leaf->runs[i].seq);
+        for (int j = i; j + 1 < leaf->n; ++j)
+            leaf->runs[j] = leaf->runs[j + 1];
+        leaf->n--;
+        runs--;
+    };
+    join(slot + 1);
+    join(slot);
+}
+
+// -------------------- Lookup --------------------
+RunSequence::Pos RunSequence::locate(size_t pos) const
+{
+    Node *x = root;
+    while (!x->leaf)
+    {
+        Inner *in = (Inner *)x;
+        int i = 0;
+        for (; i + 1 < in->n && pos >= in->child[i]->live; ++i)
+            pos -= in->child[i]->live;
+        x = in->child[i];
+    }
+    Leaf *leaf = (Leaf *)x;
+    for (int i = 0; i < leaf->n; ++i)
+    {
+        const Run &r = leaf->runs[i];
+        if (r.deleted)
+            continue;
+        if (pos < r.len)
+            return {leaf, i, (uint32_t)pos};
+        pos -= r.len;
+    }
+    return {leaf, leaf->n, 0};
+}
+
+bool RunSequence::find(CharId id, Pos &at) const
+{
+    auto site = by_site.find(id.site);
+    if (site == by_site.end())
+        return false;
+    auto it = site->second.upper_bound(id.seq);
+    if (it == site->second.begin())
+        return false;
+    --it;
+    Leaf *leaf = it->second;
+    for (int i = 0; i < leaf->n; ++i)
+    {
+        const Run &r = leaf->runs[i];
+        if (r.site == id.site && r.seq == it->first)
+        {
+            if (id.seq - r.seq >= r.len)
+                return false;
+            at = {leaf, i, id.seq - r.seq};
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RunSequence::contains(CharId id) const
+{
+    Pos at;
+    return find(id, at);
+}
+
+long RunSequence::position(CharId id) const
+{
+    Pos at;
+    if (!find(id, at) || at.leaf->runs[at.slot].deleted)
+        return -1;
+    size_t pos = at.off;
+    for (int i = 0; i < at.slot; ++i)
+        if (!at.leaf->runs[i].deleted)
+            pos += at.leaf->runs[i].len;
+    for (Node *x = at.leaf; x->parent; x = x->parent)
+        for (int i = 0; x->parent->child[i] != x; ++i)
+            pos += x->parent->child[i]->live;
+    return pos;
+}
+
+string RunSequence::text() const
+{
+    string out;
+    out.reserve(size());
+    for (Leaf *leaf = first; leaf; leaf = leaf->next)
+        for (int i = 0; i < leaf->n; ++i)
+            if (!leaf->runs[i].deleted)
+                out.append(arena, leaf->runs[i].text_off, leaf->runs[i].len);
+    return out;
+}
+
+size_t RunSequence::size() const
+{
+    return root->live;
+}
+
+size_t RunSequence::total() const
+{
+    return root->total;
+}
+
+size_t RunSequence::memory_bytes() const
+{
+    return sizeof(*this) + leaves * sizeof(Leaf) + inners * sizeof(Inner) + arena.capacity() +
+           runs * MAP_NODE_BYTES + by_site.size() * (sizeof(std::map<uint32_t, Leaf *>) + MAP_NODE_BYTES);
+}
+
+// -------------------- Edits --------------------
+CharId RunSequence::insert(size_t pos, const string &text, uint32_t site, CharId *origin)
+{
+    CharId id{site, clock + 1};
+    if (text.empty())
+        return id;
+    clock += text.size();
+    Run run{site, id.seq, (uint32_t)text.size(), (uint32_t)arena.size(), DOC_START, false};
+    arena += text;
+
+    if (origin)
+        *origin = DOC_START;
+    if (pos == 0 || size() == 0)
+    {
+        insert_run(first, 0, run);
+        return id;
+    }
+
+    // a new id sorts before everything else after its origin, so it goes
+    // directly behind the origin character
+    Pos at = locate(min(pos, size()) - 1);
+    const Run &left = at.leaf->runs[at.slot];
+    run.origin = {left.site, left.seq + at.off};
+    if (origin)
+        *origin = run.origin;
+    if (at.off + 1 < left.len)
+    {
+        split_run(at, at.off + 1);
+        find(run.origin, at);
+    }
+    Run &prev = at.leaf->runs[at.slot];
+    if (follows(prev, run))
+    {
+        prev.len += run.len; // typing on: the common case
+        refresh(at.leaf);
+        return id;
+    }
+    insert_run(at.leaf, at.slot + 1, run);
+    return id;
+}
+
+bool RunSequence::integrate(CharId origin, CharId id, const string &text)
+{
+    if (text.empty() || contains(id))
+        return true;
+
+    Pos at{first, 0, 0};
+    if (origin != DOC_START)
+    {
+        if (!find(origin, at))
+            return false;
+        const Run &r = at.leaf->runs[at.slot];
+        if (at.off + 1 < r.len && !sorts_before({r.site, r.seq + at.off + 1}, id))
+        {
+            split_run(at, at.off + 1);
+            find(origin, at);
+        }
+        // insertion point is right after the origin's run (slot may be n)
+        at.slot++;
+        at.off = 0;
+    }
+
+    // skip concurrent inserts after the same origin that sort first; their
+    // descendants have higher seqs and are skipped with them
+    while (true)
+    {
+        Pos probe = at;
+        if (probe.slot == probe.leaf->n)
+        {
+            if (!probe.leaf->next)
+                break;
+            probe = {probe.leaf->next, 0, 0};
+        }
+        const Run &r = probe.leaf->runs[probe.slot];
+        if (!sorts_before({r.site, r.seq}, id))
+            break;
+        at = probe;
+        at.slot++;
+    }
+
+    clock = max(clock, id.seq + (uint32_t)text.size() - 1);
+    Run run{id.site, id.seq, (uint32_t)text.size(), (uint32_t)arena.size(), origin, false};
+    arena += text;
+    if (at.slot > 0 && follows(at.leaf->runs[at.slot - 1], run))
+    {
+        at.leaf->runs[at.slot - 1].len += run.len;
+        refresh(at.leaf);
+        return true;
+    }
+    insert_run(at.leaf, at.slot, run);
+    return true;
+}
+
+void RunSequence::mark_deleted(Pos at, uint32_t len, CharSpan *span)
+{
+    Run &r = at.leaf->runs[at.slot];
+    r.deleted = true;
+    if (span)
+        *span = {{r.site, r.seq}, len};
+    refresh(at.leaf);
+    coalesce(at.leaf, at.slot);
+}
+
+vector<CharSpan> RunSequence::erase(size_t pos, size_t len)
+{
+    vector<CharSpan> spans;
+    if (pos >= size())
+        return spans;
+    len = min(len, size() - pos);
+    while (len > 0)
+    {
+        // deleted characters leave the visible text, so pos stays put
+        Pos at = locate(pos);
+        if (at.off > 0)
+        {
+            split_run(at, at.off);
+            at = locate(pos);
+        }
+        uint32_t cnt = min<size_t>(len, at.leaf->runs[at.slot].len);
+        if (cnt < at.leaf->runs[at.slot].len)
+        {
+            split_run(at, cnt);
+            at = locate(pos);
+        }
+        CharSpan span;
+        mark_deleted(at, cnt, &span);
+        if (!spans.empty() && spans.back().id.site == span.id.site &&
+            spans.back().id.seq + spans.back().len == span.id.seq)
+            spans.back().len += cnt;
+        else
+            spans.push_back(span);
+        len -= cnt;
+    }
+    return spans;
+}
+
+bool RunSequence::erase_ids(CharId id, uint32_t len)
+{
+    while (len > 0)
+    {
+        Pos at;
+        if (!find(id, at))
+            return false;
+        const Run &r = at.leaf->runs[at.slot];
+        uint32_t cnt = min(len, r.len - at.off);
+        if (!r.deleted)
+        {
+            if (at.off > 0)
+            {
+                split_run(at, at.off);
+                find(id, at);
+            }
+            if (cnt < at.leaf->runs[at.slot].len)
+            {
+                split_run(at, cnt);
+                find(id, at);
+            }
+            mark_deleted(at, cnt, nullptr);
+        }
+        id.seq += cnt;
+        len -= cnt;
+    }
+    return true;
+}
+
+} // namespace synctext
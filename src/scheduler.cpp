@@ -0,0 +1,227 @@
+#include "synctext/scheduler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Work-Stealing Scheduler --------------------
+static thread_local Scheduler *current_scheduler = nullptr;
+static thread_local int current_worker = -1;
+
+bool WorkDeque::push(Task *task)
+{
+    int64_t b = bottom.load(memory_order_relaxed);
+    int64_t t = top.load(memory_order_acquire);
+    if (b - t >= CAPACITY)
+        return false;
+    slots[b & (CAPACITY - 1)].store(task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    bottom.store(b + 1, memory_order_relaxed);
+    return true;
+}
+
+Task *WorkDeque::pop()
+{
+    int64_t b = bottom.load(memory_order_relaxed) - 1;
+    bottom.store(b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = top.load(memory_order_relaxed);
+    if (t > b)
+    {
+        bottom.store(b + 1, memory_order_relaxed);
+        return nullptr;
+    }
+    Task *task = slots[b & (CAPACITY - 1)].load(memory_order_relaxed);
+    if (t == b)
+    {
+        // last item: race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            task = nullptr;
+        bottom.store(b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+Task *WorkDeque::steal()
+{
+    int64_t t = top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = bottom.load(memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+    Task *task = slots[t & (CAPACITY - 1)].load(memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+        return nullptr;
+    return task;
+}
+
+Scheduler::Scheduler(unsigned n)
+{
+    n = max(1u, n);
+    for (unsigned i = 0; i < n; ++i)
+        deques.push_back(make_unique<WorkDeque>());
+    for (unsigned i = 0; i < n; ++i)
+        workers.emplace_back([this, i] { run(i); });
+}
+
+Scheduler::~Scheduler()
+{
+    stopping.store(true);
+    {
+        lock_guard<mutex> lock(idle_m);
+    }
+    idle_cv.notify_all();
+    for (auto &w : workers)
+        w.join();
+
+    // tasks that never ran
+    for (auto &d : deques)
+        while (Task *task = d->steal())
+            delete task;
+    for (Task *task : injected)
+        delete task;
+}
+
+void Scheduler::submit(function<void()> fn)
+{
+    Task *task = new Task{std::move(fn)};
+    if (current_scheduler != this || !deques[current_worker]->push(task))
+    {
+        lock_guard<mutex> lock(inject_m);
+        injected.push_back(task);
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (sleeping.load(memory_order_relaxed) > 0)
+    {
+        {
+            lock_guard<mutex> lock(idle_m);
+        }
+        idle_cv.notify_one();
+    }
+}
+
+Task *Scheduler::find_work(unsigned self, uint32_t &rng)
+{
+    if (Task *task = deques[self]->pop())
+        return task;
+    {
+        lock_guard<mutex> lock(inject_m);
+        if (!injected.empty())
+        {
+            Task *task = injected.front();
+            injected.pop_front();
+            return task;
+        }
+    }
+    size_t n = deques.size();
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    for (size_t k = 0, start = rng % n; k < n; ++k)
+    {
+        size_t victim = (start + k) % n;
+        if (victim == self)
+            continue;
+        if (Task *task = deques[victim]->steal())
+        {
+            steals.fetch_add(1, memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool Scheduler::has_visible_work()
+{
+    {
+        lock_guard<mutex> lock(inject_m);
+        if (!injected.empty())
+            return true;
+    }
+    for (auto &d : deques)
+        if (d->top.load() < d->bottom.load())
+            return true;
+    return false;
+}
+
+void Scheduler::run(unsigned self)
+{
+    current_scheduler = this;
+    current_worker = self;
+    uint32_t rng = 2463534242u + self * 7919u;
+    int idle_spins = 0;
+    while (!stopping.load(memory_order_relaxed))
+    {
+        if (Task *task = find_work(self, rng))
+        {
+            idle_spins = 0;
+            task->fn();
+            delete task;
+            continue;
+        }
+        if (++idle_spins < 64)
+        {
+            this_thread::yield();
+            continue;
+        }
+
+        // park; the timeout bounds any missed wakeup
+        unique_lock<mutex> lock(idle_m);
+        sleeping.fetch_add(1, memory_order_seq_cst);
+        if (!has_visible_work() && !stopping.load())
+            idle_cv.wait_for(lock, chrono::milliseconds(10));
+        sleeping.fetch_sub(1, memory_order_seq_cst);
+        idle_spins = 0;
+    }
+}
+
+// -------------------- Strand --------------------
+Strand::Strand(Scheduler &s) : sched(s)
+{
+    Node *stub = new Node();
+    head.store(stub);
+    tail = stub;
+}
+
+Strand::~Strand()
+{
+    while (tail)
+    {
+        Node *next = tail->next.load();
+        delete tail;
+        tail = next;
+    }
+}
+
+void Strand::post(function<void()> fn)
+{
+    Node *node = new Node();
+    node->fn = std::move(fn);
+    Node *prev = head.exchange(node, memory_order_acq_rel);
+    prev->next.store(node, memory_order_release);
+    if (pending.fetch_add(1, memory_order_acq_rel) == 0)
+        sched.submit([self = shared_from_this()] { self->drain(); });
+}
+
+void Strand::drain()
+{
+    const int BUDGET = 64; // then requeue so one busy document can't hog a worker
+    for (int i = 0; i < BUDGET; ++i)
+    {
+        Node *next;
+        while (!(next = tail->next.load(memory_order_acquire)))
+            this_thread::yield(); // a producer is between exchange and link
+        delete tail;
+        tail = next;
+        function<void()> fn = std::move(next->fn);
+        fn();
+        if (pending.fetch_sub(1, memory_order_acq_rel) == 1)
+            return;
+    }
+    sched.submit([self = shared_from_this()] { self->drain(); });
+}
+
+} // namespace synctext
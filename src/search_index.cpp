@@ -0,0 +1,246 @@
+#include "synctext/search_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace synctext
+{
+
+static const size_t SWEEP_MIN = 4096; // stale postings or slots before a sweep is worth it
+
+static uint32_t trigram(const char *p)
+{
+    return (uint32_t)(unsigned char)p[0] << 16 | (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+// Distinct trigrams of s, sorted.
+static void trigrams_of(const string &s, vector<uint32_t> &out)
+{
+    out.clear();
+    for (size_t i = 0; i + 3 <= s.size(); ++i)
+        out.push_back(trigram(s.data() + i));
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+// First element of [from, end) not below v: gallops from `from`, so walking
+// a sorted list with rising v costs O(log gap) per step.
+static const uint32_t *gallop(const uint32_t *from, const uint32_t *end, uint32_t v)
+{
+    size_t step = 1;
+    while (end - from > (ptrdiff_t)step && from[step] < v)
+    {
+        from += step;
+        step *= 2;
+    }
+    return lower_bound(from, end - from > (ptrdiff_t)step ? from + step + 1 : end, v);
+}
+
+static uint64_t elapsed_ns(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// Every match of needle in line, appended to hits.
+static void find_all(const string &needle, const string &line, size_t pos, vector<SearchHit> &hits,
+                     size_t max_hits)
+{
+    for (size_t at = line.find(needle); at != string::npos && hits.size() < max_hits;
+         at = line.find(needle, at + 1))
+        hits.push_back({pos, at});
+}
+
+vector<SearchHit> scan_lines(const string &needle, const vector<string> &lines, size_t max_hits)
+{
+    vector<SearchHit> hits;
+    for (size_t i = 0; i < lines.size() && hits.size() < max_hits; ++i)
+        find_all(needle, lines[i], i, hits, max_hits);
+    return hits;
+}
+
+// -------------------- Trigram Index --------------------
+void TrigramIndex::reset(const vector<string> &lines, const LineIndex &index)
+{
+    postings.clear();
+    slots.clear();
+    slot_of.clear();
+    live_postings = stale_postings = retired = 0;
+    updates = update_ns = 0;
+    for (size_t i = 0; i < lines.size(); ++i)
+        set(index.at(i), lines[i]);
+}
+
+void TrigramIndex::set(LineId id, const string &line)
+{
+    auto start = chrono::steady_clock::now();
+    static thread_local vector<uint32_t> grams;
+    trigrams_of(line, grams);
+
+    auto [it, fresh] = slot_of.try_emplace(key(id), (uint32_t)slots.size());
+    if (!fresh)
+    {
+        retire(it->second);
+        it->second = slots.size();
+    }
+    uint32_t slot = slots.size();
+    slots.push_back({id, (uint32_t)grams.size(), true});
+    for (uint32_t g : grams)
+        postings[g].push_back(slot);
+    live_postings += grams.size();
+
+    sweep();
+    updates++;
+    update_ns += elapsed_ns(start);
+}
+
+void TrigramIndex::erase(LineId id)
+{
+    auto start = chrono::steady_clock::now();
+    auto it = slot_of.find(key(id));
+    if (it == slot_of.end())
+        return;
+    retire(it->second);
+    slot_of.erase(it);
+    sweep();
+    updates++;
+    update_ns += elapsed_ns(start);
+}
+
+// Its postings stay in the lists until the next sweep.
+void TrigramIndex::retire(uint32_t slot)
+{
+    Slot &s = slots[slot];
+    live_postings -= s.trigrams;
+    stale_postings += s.trigrams;
+    s.used = false;
+    retired++;
+}
+
+// Drops retired slots and their postings once they outweigh live ones, so
+// the work is paid for by the updates that made them.
+void TrigramIndex::sweep()
+{
+    bool postings_due = stale_postings > live_postings && stale_postings > SWEEP_MIN;
+    bool slots_due = retired > slot_of.size() && retired > SWEEP_MIN; // lines too short for trigrams
+    if (!postings_due && !slots_due)
+        return;
+
+    // live slots keep their order, so the lists stay sorted
+    vector<uint32_t> renumber(slots.size(), UINT32_MAX);
+    uint32_t n = 0;
+    for (size_t i = 0; i < slots.size(); ++i)
+        if (slots[i].used)
+        {
+            renumber[i] = n;
+            slots[n++] = slots[i];
+        }
+    slots.resize(n);
+    for (auto &kv : slot_of)
+        kv.second = renumber[kv.second];
+
+    for (auto it = postings.begin(); it != postings.end();)
+    {
+        auto &list = it->second;
+        size_t kept = 0;
+        for (uint32_t slot : list)
+            if (renumber[slot] != UINT32_MAX)
+                list[kept++] = renumber[slot];
+        list.resize(kept);
+        if (list.empty())
+            it = postings.erase(it);
+        else
+            ++it;
+    }
+    stale_postings = retired = 0;
+}
+
+vector<SearchHit> TrigramIndex::search(const string &needle, const vector<string> &lines, const LineIndex &index,
+                                       size_t max_hits) const
+{
+    if (needle.size() < 3)
+        return scan_lines(needle, lines, max_hits);
+
+    vector<uint32_t> grams;
+    trigrams_of(needle, grams);
+    vector<const SlotList *> lists;
+    for (uint32_t g : grams)
+    {
+        auto it = postings.find(g);
+        if (it == postings.end())
+            return {};
+        lists.push_back(&it->second);
+    }
+    sort(lists.begin(), lists.end(), [](auto *a, auto *b) { return a->size() < b->size(); });
+
+    // slots of [first, last) of the rarest list that are in every list
+    auto intersect = [&](size_t first, size_t last, vector<uint32_t> &out) {
+        size_t at = out.size();
+        for (size_t i = first; i < last; ++i)
+            if (slots[(*lists[0])[i]].used)
+                out.push_back((*lists[0])[i]);
+        for (size_t k = 1; k < lists.size() && out.size() > at; ++k)
+        {
+            const uint32_t *from = lists[k]->data(), *end = from + lists[k]->size();
+            size_t kept = at;
+            for (size_t i = at; i < out.size(); ++i)
+            {
+                from = gallop(from, end, out[i]);
+                if (from == end)
+                    break;
+                if (*from == out[i])
+                    out[kept++] = out[i];
+            }
+            out.resize(kept);
+        }
+    };
+
+    // Ordering c candidates costs c lookups; a scan stops after reading
+    // about lines * max_hits / c lines, so past scan_above it is cheaper.
+    // Intersecting a long rarest list costs as much again, so a sample of
+    // it estimates c first.
+    double scan_above = max((double)max_hits, sqrt((double)lines.size() * max_hits / SEARCH_LOOKUP_COST));
+    size_t rarest = lists[0]->size();
+    size_t sample = rarest > scan_above ? min(rarest, SEARCH_SAMPLE) : rarest;
+    vector<uint32_t> candidates;
+    intersect(0, sample, candidates);
+    if ((double)candidates.size() * rarest / sample > scan_above)
+        return scan_lines(needle, lines, max_hits);
+    intersect(sample, rarest, candidates);
+    if (candidates.size() > scan_above)
+        return scan_lines(needle, lines, max_hits);
+
+    vector<size_t> positions;
+    positions.reserve(candidates.size());
+    for (uint32_t slot : candidates)
+    {
+        long pos = index.position(slots[slot].id);
+        if (pos >= 0 && (size_t)pos < lines.size())
+            positions.push_back(pos);
+    }
+    sort(positions.begin(), positions.end());
+
+    vector<SearchHit> hits;
+    for (size_t i = 0; i < positions.size() && hits.size() < max_hits; ++i)
+        find_all(needle, lines[positions[i]], positions[i], hits, max_hits);
+    return hits;
+}
+
+SearchStats TrigramIndex::stats() const
+{
+    size_t bytes = sizeof(*this) + slots.capacity() * sizeof(Slot);
+    // unordered_map nodes: key, value and a next pointer, plus a bucket each
+    bytes += postings.size() * (sizeof(uint32_t) + sizeof(SlotList) + 2 * sizeof(void *));
+    bytes += slot_of.size() * (sizeof(uint64_t) + sizeof(uint32_t) + 3 * sizeof(void *));
+    size_t entries = 0;
+    for (auto &kv : postings)
+    {
+        entries += kv.second.size();
+        bytes += kv.second.capacity() * sizeof(uint32_t);
+    }
+    return {slot_of.size(), postings.size(), entries, bytes, updates, update_ns};
+}
+
+} // namespace synctext
@@ -0,0 +1,358 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "synctext/registry.h"
+#include "synctext/text_stream.h"
+#include "transports.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- SEQPACKET Transport --------------------
+// Unix SOCK_SEQPACKET sockets at /tmp/sock_<user_id>, discovered through the
+// shm registry like the FIFOs. Every frame is one message, so the kernel
+// keeps boundaries and there are no partial reads or interleaved writers.
+// Receivers enable SO_PASSCRED and check each sender's pid against the
+// registry entry for the user_id its ops claim, and take at most
+// STREAM_READ_BYTES from one sender before serving the next.
+static string seqpacket_name(const string &user_id)
+{
+    return "/tmp/sock_" + user_id;
+}
+
+static int seqpacket_connect(const string &target)
+{
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    sockaddr_un sa{};
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, seqpacket_name(target).c_str(), sizeof(sa.sun_path)-1);
+    if (connect(fd, (sockaddr *)&sa, sizeof(sa)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    int sndbuf = 4 * SEQPACKET_MAX_FRAME;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    return fd;
+}
+
+struct SeqpacketPeer
+{
+    int fd = -1;
+    pid_t pid = 0;
+    string user; // registry identity of pid, resolved on first message
+};
+
+class SeqpacketTransport : public Transport
+{
+public:
+    explicit SeqpacketTransport(Session &s) : session(s) {}
+
+    ~SeqpacketTransport() override
+    {
+        stop();
+        for (auto &kv : conns)
+            close(kv.second);
+        for (auto &kv : accepted)
+            close(kv.first);
+        for (int fd : {lfd, ep})
+            if (fd != -1)
+                close(fd);
+    }
+
+    void start() override
+    {
+        // each document's dictionary is published by the session as it opens
+        vector<PeerInfo> users = register_user(session.user_id(), session.config().compress ? CAP_COMPRESS : 0);
+        string active;
+        for (auto &u : users)
+            active += (active.empty() ? "" : ", ") + u.user_id;
+        session.log(LogKind::Notice, "Registered user: " + session.user_id() + "\nActive users: " + active);
+
+        path = seqpacket_name(session.user_id());
+        unlink(path.c_str());
+        lfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        sockaddr_un sa{};
+        sa.sun_family = AF_UNIX;
+        strncpy(sa.sun_path, path.c_str(), sizeof(sa.sun_path)-1);
+        ep = epoll_create1(EPOLL_CLOEXEC);
+        if (lfd == -1 || ep == -1 || bind(lfd, (sockaddr *)&sa, sizeof(sa)) == -1 || listen(lfd, SOMAXCONN) == -1)
+            throw system_error(errno, generic_category(), "listen " + path);
+        session.log(LogKind::Info, "Socket created: " + path);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr; // listening socket
+        epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+        listener = thread(&SeqpacketTransport::listener_thread, this);
+    }
+
+    void stop() override
+    {
+        if (!listener.joinable())
+            return;
+        stopping.store(true);
+        listener.join();
+    }
+
+    void send(const string &doc, const vector<UpdateObject> &ops, Lane lane) override
+    {
+        shared_ptr<const WireDict> dict = session.wire_dict(doc);
+        vector<BatchEncoder> chunks; // one message per chunk
+        for (size_t at = 0; at < ops.size(); at += SEQPACKET_OPS_PER_FRAME)
+            chunks.emplace_back(doc, ops.data() + at, min(SEQPACKET_OPS_PER_FRAME, ops.size() - at), dict.get(), lane);
+
+        for (auto &peer : registered_peers())
+        {
+            if (peer.user_id == session.user_id())
+                continue;
+
+            // compress only for peers that advertised our dictionary of doc
+            bool peer_has_dict = dict && (peer.caps & CAP_COMPRESS) && peer.dict_for(doc) == dict->id;
+            vector<shared_ptr<const vector<char>>> frames;
+            for (auto &chunk : chunks)
+                frames.push_back(chunk.frame_for(peer_has_dict));
+            send_frames(peer.user_id, frames, STREAM_STALL_MS);
+        }
+        for (auto &chunk : chunks)
+            log_packed(session, chunk);
+    }
+
+    void send_text(const shared_ptr<const vector<char>> &frame) override
+    {
+        for (auto &peer : registered_peers())
+            if (peer.user_id != session.user_id())
+                send_frames(peer.user_id, {frame}, STREAM_STALL_MS);
+    }
+
+private:
+    // Sends all frames of a batch with one sendmmsg where possible. A broken
+    // cached connection is redialled once; a socket that stays full for
+    // wait_ms drops the rest, like the FIFO write.
+    void send_frames(const string &target, const vector<shared_ptr<const vector<char>>> &frames, int wait_ms)
+    {
+        vector<iovec> iov(frames.size());
+        vector<mmsghdr> msgs(frames.size());
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            iov[i].iov_base = (void *)frames[i]->data();
+            iov[i].iov_len = frames[i]->size();
+            msgs[i] = mmsghdr{};
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        size_t sent = 0;
+        bool redialled = false;
+        auto give_up = chrono::steady_clock::now() + chrono::milliseconds(wait_ms);
+        while (sent < frames.size())
+        {
+            auto it = conns.find(target);
+            if (it == conns.end())
+            {
+                int fd = seqpacket_connect(target);
+                if (fd == -1)
+                    return; // peer not listening (yet)
+                it = conns.emplace(target, fd).first;
+            }
+
+            int n = sendmmsg(it->second, msgs.data() + sent, frames.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                sent += n;
+                continue;
+            }
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                auto left = chrono::duration_cast<chrono::milliseconds>(give_up - chrono::steady_clock::now());
+                if (left.count() > 0)
+                {
+                    pollfd pfd{it->second, POLLOUT, 0};
+                    poll(&pfd, 1, left.count());
+                    continue;
+                }
+                session.log(LogKind::Warning, "Peer " + target + " is not draining; dropped " +
+                                                  to_string(frames.size() - sent) + " frame(s)");
+                return;
+            }
+            close(it->second);
+            conns.erase(it);
+            if (redialled)
+            {
+                session.log(LogKind::Error, "Write failed to " + seqpacket_name(target) + " : " + strerror(errno));
+                return;
+            }
+            redialled = true;
+        }
+    }
+
+    void listener_thread()
+    {
+        const int VLEN = 8;
+        vector<char> bufs(VLEN * SEQPACKET_MAX_FRAME);
+        char ctrl[VLEN][CMSG_SPACE(sizeof(ucred))];
+        iovec iov[VLEN];
+        mmsghdr msgs[VLEN];
+        vector<UpdateObject> batch;
+        epoll_event events[32];
+
+        while (!stopping.load())
+        {
+            int n = epoll_wait(ep, events, 32, 200);
+            for (int i = 0; i < n; ++i)
+            {
+                if (!events[i].data.ptr)
+                {
+                    int cfd;
+                    while ((cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+                    {
+                        int one = 1;
+                        setsockopt(cfd, SOL_SOCKET, SO_PASSCRED, &one, sizeof(one));
+                        auto &peer = accepted[cfd];
+                        peer = make_unique<SeqpacketPeer>();
+                        peer->fd = cfd;
+                        epoll_event cev{};
+                        cev.events = EPOLLIN | EPOLLRDHUP;
+                        cev.data.ptr = peer.get();
+                        epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &cev);
+                    }
+                    continue;
+                }
+
+                SeqpacketPeer *peer = (SeqpacketPeer *)events[i].data.ptr;
+                // a peer that hung up may have left its last messages queued:
+                // those are read in full before the socket is closed
+                bool hung_up = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+                bool closed = false, drained = false;
+                size_t taken = 0; // the rest waits for the next epoll_wait
+                while (!closed && !drained && (hung_up || taken < STREAM_READ_BYTES))
+                {
+                    for (int k = 0; k < VLEN; ++k)
+                    {
+                        iov[k].iov_base = bufs.data() + k * SEQPACKET_MAX_FRAME;
+                        iov[k].iov_len = SEQPACKET_MAX_FRAME;
+                        msgs[k] = mmsghdr{};
+                        msgs[k].msg_hdr.msg_iov = &iov[k];
+                        msgs[k].msg_hdr.msg_iovlen = 1;
+                        msgs[k].msg_hdr.msg_control = ctrl[k];
+                        msgs[k].msg_hdr.msg_controllen = sizeof(ctrl[k]);
+                    }
+                    int got = recvmmsg(peer->fd, msgs, VLEN, MSG_DONTWAIT, nullptr);
+                    if (got == -1)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        closed = errno != EAGAIN && errno != EWOULDBLOCK;
+                        drained = true;
+                        break;
+                    }
+
+                    for (int k = 0; k < got && !closed; ++k)
+                    {
+                        msghdr &mh = msgs[k].msg_hdr;
+                        size_t len = msgs[k].msg_len;
+                        taken += len;
+                        if (len == 0)
+                        {
+                            closed = true; // orderly shutdown
+                            break;
+                        }
+                        for (cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm))
+                        {
+                            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_CREDENTIALS)
+                            {
+                                ucred cred;
+                                memcpy(&cred, CMSG_DATA(cm), sizeof(cred));
+                                if (cred.pid != peer->pid)
+                                {
+                                    peer->pid = cred.pid;
+                                    peer->user = registered_user_for_pid(cred.pid);
+                                }
+                            }
+                        }
+
+                        const char *msg = (const char *)iov[k].iov_base;
+                        BatchHeader hdr;
+                        if ((mh.msg_flags & MSG_TRUNC) || len < sizeof(hdr))
+                        {
+                            session.log(LogKind::Warning, "Dropped oversized or short message on " + path);
+                            continue;
+                        }
+                        memcpy(&hdr, msg, sizeof(hdr));
+                        if (hdr.magic == BATCH_MAGIC && (hdr.flags & FRAME_TEXT) &&
+                            sizeof(hdr) + hdr.payload_len == len && hdr.payload_len >= sizeof(TextChunk))
+                        {
+                            TextChunk chunk;
+                            memcpy(&chunk, msg + sizeof(hdr), sizeof(chunk));
+                            if (peer->user.empty() ||
+                                peer->user != string(chunk.user_id, strnlen(chunk.user_id, sizeof(chunk.user_id))))
+                                session.log(LogKind::Error, "Dropped text from pid " + to_string(peer->pid) +
+                                                                ": sender is not the registered owner of its user_id");
+                            else
+                                session.deliver_text(hdr, msg + sizeof(hdr), hdr.payload_len);
+                            continue;
+                        }
+                        auto dict = session.wire_dict(string(hdr.doc, strnlen(hdr.doc, sizeof(hdr.doc))));
+                        if (hdr.magic != BATCH_MAGIC || sizeof(hdr) + hdr.payload_len != len ||
+                            !decode_batch(hdr, msg + sizeof(hdr), hdr.payload_len, batch, dict.get()))
+                        {
+                            session.log(LogKind::Warning, "Dropped undecodable batch on " + path);
+                            continue;
+                        }
+
+                        bool spoofed = peer->user.empty();
+                        for (auto &upd : batch)
+                            if (peer->user != string(upd.user_id, strnlen(upd.user_id, sizeof(upd.user_id))))
+                                spoofed = true;
+                        if (spoofed)
+                        {
+                            session.log(LogKind::Error, "Dropped batch from pid " + to_string(peer->pid) +
+                                                            ": sender is not the registered owner of its user_id");
+                            continue;
+                        }
+                        session.deliver(hdr, batch);
+                    }
+                    drained = got < VLEN;
+                }
+
+                if (closed || (hung_up && drained))
+                {
+                    int fd = peer->fd;
+                    epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+                    close(fd);
+                    accepted.erase(fd);
+                }
+            }
+        }
+    }
+
+    Session &session;
+    string path;
+    int lfd = -1, ep = -1;
+    unordered_map<string, int> conns;                       // connected sockets per target; sender only
+    unordered_map<int, unique_ptr<SeqpacketPeer>> accepted; // by fd; listener thread only
+    thread listener;
+    atomic<bool> stopping{false};
+};
+
+unique_ptr<Transport> make_seqpacket_transport(Session &session)
+{
+    return make_unique<SeqpacketTransport>(session);
+}
+
+} // namespace synctext
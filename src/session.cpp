@@ -0,0 +1,1026 @@
+#include "synctext/session.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "synctext/conflict.h"
+#include "synctext/merge.h"
+#include "synctext/perf.h"
+#include "synctext/persistence.h"
+#include "synctext/registry.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// A document's dictionary, published by the first peer to open it with compression.
+struct DictSegment
+{
+    std::atomic<uint32_t> ready;
+    std::atomic<int32_t> creator; // pid training it; 0 until the creator has mapped it
+    uint32_t dict_id;
+    uint32_t size;
+    char data[DICT_MAX_BYTES];
+};
+
+bool valid_document_name(const string &name)
+{
+    return !name.empty() && name.size() < sizeof(BatchHeader::doc) && name.find('/') == string::npos &&
+           name[0] != '.';
+}
+
+static string document_filename(const string &user_id, const string &name)
+{
+    return user_id + "_" + name + ".txt";
+}
+
+Session::Session(SessionConfig config, SessionHooks callbacks)
+    : cfg(std::move(config)), hooks(std::move(callbacks)), site(site_id(cfg.user_id))
+{
+    if (!hooks.log)
+        hooks.log = [](LogKind, const string &msg) { cerr << msg << endl; };
+}
+
+Session::~Session()
+{
+    stop();
+    if (transport)
+        transport->stop();
+    for (auto &kv : *std::atomic_load(&docs))
+        release_dictionary(*kv.second);
+    sched.reset(); // joins the workers; queued pipeline steps are dropped
+    auto table = std::atomic_load(&docs);
+    for (auto &kv : *table)
+        kv.second->strand.reset();
+    broadcast_strand.reset();
+    loop.reset();
+    if (inotify_fd != -1)
+        ::close(inotify_fd);
+}
+
+void Session::log(LogKind kind, const string &msg) const
+{
+    hooks.log(kind, msg);
+}
+
+void Session::start()
+{
+    if (cfg.async)
+    {
+        sched = make_unique<Scheduler>(cfg.workers ? cfg.workers : thread::hardware_concurrency());
+        broadcast_strand = make_shared<Strand>(*sched);
+        loop = make_unique<Reactor>();
+        auto table = std::atomic_load(&docs);
+        for (auto &kv : *table) // opened before start()
+            kv.second->strand = make_shared<Strand>(*sched);
+    }
+
+    if (cfg.profile)
+    {
+        uint32_t counters = enable_profiling();
+        if (!(counters & (1u << PERF_CYCLES)))
+            log(LogKind::Warning, "[Profile] Hardware counters unavailable (no PMU, or perf_event_paranoid > 2); "
+                                  "stages record time and page faults only.");
+    }
+    if (cfg.stats && !stats_board.open(cfg.user_id))
+        log(LogKind::Warning, "Stats segment unavailable; memory use will not be published.");
+
+    transport = make_transport(*this);
+    transport->start();
+    started.store(true);
+    for (auto &kv : *std::atomic_load(&docs)) // opened before start(); registering cleared them
+        advertise_dictionary(*kv.second);
+
+    if (!cfg.async)
+        return;
+    if (cfg.watch_files)
+    {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1 || inotify_add_watch(inotify_fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+            throw system_error(errno, generic_category(), "inotify");
+        inotify_loop(inotify_fd);
+    }
+    flush_loop();
+    gc_loop();
+    stats_loop();
+}
+
+void Session::run()
+{
+    if (loop)
+        loop->run();
+}
+
+void Session::stop()
+{
+    if (loop)
+        loop->stop();
+}
+
+// -------------------- Wire Dictionary --------------------
+// Each document has its own dictionary, trained from its snapshot by the
+// first peer to open it and published in DICT_SHM_PREFIX + name; later peers
+// load that copy so every decoder of the document agrees on dict_id. A
+// segment whose creator died before finishing it, or that no live peer
+// decodes with any more, is unlinked and trained afresh.
+// Stream transports train locally and send it in the handshake.
+static bool pid_alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+void Session::setup_dictionary(Document &doc)
+{
+    if (cfg.transport == TRANSPORT_TCP || cfg.transport == TRANSPORT_UNIX)
+    {
+        // no shared /dev/shm across containers: each sender ships its own
+        // dictionary in the connection handshake instead
+        doc.dict.bytes = train_dictionary(doc.lines);
+        doc.dict.id = dictionary_id(doc.name, doc.dict.bytes);
+        log(LogKind::Info, "Wire dictionary of " + doc.name + " trained: " + to_string(doc.dict.bytes.size()) +
+                               " bytes");
+        return;
+    }
+
+    string shm = DICT_SHM_PREFIX + doc.name;
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        bool creator = true;
+        int shm_fd = shm_open(shm.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (shm_fd == -1 && errno == EEXIST)
+        {
+            creator = false;
+            shm_fd = shm_open(shm.c_str(), O_RDWR, 0666);
+        }
+        if (shm_fd == -1 || ftruncate(shm_fd, sizeof(DictSegment)) == -1)
+        {
+            log(LogKind::Warning, "shm_open " + shm + ": " + strerror(errno) + "; sending " + doc.name +
+                                      " uncompressed.");
+            if (shm_fd != -1)
+                ::close(shm_fd);
+            return;
+        }
+
+        void *ptr = mmap(0, sizeof(DictSegment), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        ::close(shm_fd);
+        if (ptr == MAP_FAILED)
+        {
+            log(LogKind::Warning, "mmap " + shm + ": " + strerror(errno) + "; sending " + doc.name +
+                                      " uncompressed.");
+            return;
+        }
+        DictSegment *seg = (DictSegment *)ptr;
+
+        if (creator)
+        {
+            seg->creator.store(getpid(), memory_order_relaxed);
+            vector<char> trained = train_dictionary(doc.lines);
+            memcpy(seg->data, trained.data(), trained.size());
+            seg->size = trained.size();
+            seg->dict_id = dictionary_id(doc.name, trained);
+            seg->ready.store(1, memory_order_release);
+        }
+        else
+        {
+            for (int tries = 0; tries < 100 && !seg->ready.load(memory_order_acquire); ++tries)
+            {
+                int32_t pid = seg->creator.load(memory_order_relaxed);
+                if (pid != 0 && !pid_alive(pid))
+                    break;
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+        }
+
+        bool ready = seg->ready.load(memory_order_acquire) && seg->size <= DICT_MAX_BYTES;
+        bool creator_alive = pid_alive(seg->creator.load(memory_order_relaxed));
+        bool stale = ready ? !creator && !creator_alive && !dictionary_in_use(cfg.user_id, doc.name, seg->dict_id)
+                           : !creator_alive;
+        if (ready && !stale)
+        {
+            doc.dict.bytes.assign(seg->data, seg->data + seg->size);
+            doc.dict.id = seg->dict_id;
+            log(LogKind::Info, "Wire dictionary of " + doc.name + " " + (creator ? "trained" : "loaded") + ": " +
+                                   to_string(doc.dict.bytes.size()) + " bytes");
+        }
+        munmap(ptr, sizeof(DictSegment));
+        if (!stale)
+            break;
+        shm_unlink(shm.c_str()); // left by peers that are gone: train our own
+    }
+    if (!doc.dict.id)
+        log(LogKind::Warning, "Wire dictionary of " + doc.name + " unavailable; sending it uncompressed.");
+}
+
+// Tells peers which dictionary decodes doc, once we are registered.
+void Session::advertise_dictionary(const Document &doc)
+{
+    if (doc.dict.id && cfg.transport != TRANSPORT_TCP && cfg.transport != TRANSPORT_UNIX)
+        publish_dictionary(cfg.user_id, doc.name, doc.dict.id);
+}
+
+// Withdraws doc's dictionary, and unlinks its segment once no other live
+// peer decodes with it; whoever opens the document next trains a new one.
+void Session::release_dictionary(const Document &doc)
+{
+    if (!doc.dict.id || cfg.transport == TRANSPORT_TCP || cfg.transport == TRANSPORT_UNIX)
+        return;
+    publish_dictionary(cfg.user_id, doc.name, 0);
+    if (!dictionary_in_use(cfg.user_id, doc.name, doc.dict.id))
+        shm_unlink((DICT_SHM_PREFIX + doc.name).c_str());
+}
+
+shared_ptr<const WireDict> Session::wire_dict(const string &name) const
+{
+    auto doc = find(name);
+    if (!doc || !doc->dict.id)
+        return nullptr;
+    return shared_ptr<const WireDict>(doc, &doc->dict); // keeps a closed document's dictionary alive
+}
+
+// -------------------- Documents --------------------
+// The vector and the text of lines, counting every line's text as if it
+// were on the heap; offsets already sums it.
+static void charge_lines(Document &doc)
+{
+    doc.lines_held.set(doc.lines.capacity() * sizeof(string) + doc.offsets.bytes());
+}
+
+// The stamp is taken before the read, so a write racing it still shows up
+// as a changed stamp later.
+static vector<string> read_document(Document &doc)
+{
+    doc.on_disk = file_stamp(doc.filename);
+    return read_file(doc.filename);
+}
+
+static void write_document(Document &doc)
+{
+    write_file_from_lines(doc.filename, doc.lines);
+    doc.on_disk = file_stamp(doc.filename);
+}
+
+shared_ptr<Document> Session::find(const string &name) const
+{
+    auto table = std::atomic_load(&docs);
+    auto it = table->find(name);
+    return it == table->end() ? nullptr : it->second;
+}
+
+vector<string> Session::documents() const
+{
+    vector<string> names;
+    auto table = std::atomic_load(&docs);
+    for (auto &kv : *table)
+        names.push_back(kv.first);
+    return names;
+}
+
+shared_ptr<Document> Session::open(const string &name)
+{
+    if (auto existing = find(name))
+        return existing;
+    if (!valid_document_name(name))
+    {
+        log(LogKind::Warning, "Invalid document name: " + name);
+        return nullptr;
+    }
+
+    auto doc = make_shared<Document>();
+    doc->name = name;
+    doc->filename = document_filename(cfg.user_id, name);
+    if (access(doc->filename.c_str(), F_OK) == -1)
+        write_initial_file(doc->filename);
+    doc->lines = read_document(*doc);
+    for (size_t i = 0; i < doc->lines.size(); ++i)
+        if (!utf8_valid(doc->lines[i]))
+        {
+            log(LogKind::Warning, doc->filename + " is not valid UTF-8 (line " + to_string(i) +
+                                      "); malformed bytes count as one column each");
+            break;
+        }
+    doc->index.reset(doc->lines.size());
+    doc->versions.reset(doc->lines, now_ms(), cfg.versions_kept);
+    doc->offsets.reset(doc->lines);
+    charge_lines(*doc);
+    doc->columns.reset(cfg.columns);
+    if (cfg.search_index)
+    {
+        doc->trigrams = make_unique<TrigramIndex>();
+        doc->trigrams->reset(doc->lines, doc->index);
+    }
+    doc->blame.reset(doc->lines.size());
+    if (cfg.compress)
+        setup_dictionary(*doc);
+    if (cfg.presence && !doc->presence.open(name, cfg.user_id))
+        log(LogKind::Warning, "Presence table of " + name + " unavailable; cursors will not be shared.");
+    doc->inbound.set_rates(cfg.peer_rate, cfg.peer_rates);
+    doc->inbound.set_ceiling(cfg.memory_ceiling, cfg.spill_dir);
+    if (sched)
+        doc->strand = make_shared<Strand>(*sched);
+
+    auto next = make_shared<DocTable>(*std::atomic_load(&docs));
+    (*next)[name] = doc;
+    std::atomic_store(&docs, shared_ptr<const DocTable>(next));
+    if (started.load())
+        advertise_dictionary(*doc);
+    log(LogKind::Notice, "[Opened] " + name + " (" + doc->filename + ")");
+    return doc;
+}
+
+bool Session::close(const string &name)
+{
+    auto next = make_shared<DocTable>(*std::atomic_load(&docs));
+    auto it = next->find(name);
+    if (it == next->end())
+        return false;
+    auto doc = it->second;
+    next->erase(it);
+    // a task still servicing it keeps its own reference
+    std::atomic_store(&docs, shared_ptr<const DocTable>(next));
+    release_dictionary(*doc);
+    log(LogKind::Notice, "[Closed] " + name);
+    return true;
+}
+
+// -------------------- Merge & Apply --------------------
+// Remote ops are applied to doc.lines, which doc.index describes; our own
+// unsent ops are already there and only take part in LWW.
+void Session::merge_and_apply(Document &doc, const vector<UpdateObject> &local_ops)
+{
+    // the file has edits we haven't diffed yet (it changed since we last read
+    // or wrote it): leave the remote ops queued for the merge that follows
+    // the rescan rather than overwrite them
+    PerfScope perf(STAGE_MERGE);
+    if (file_stamp(doc.filename) != doc.on_disk)
+        return;
+
+    // atomically grab and clear recv buffer (copy-on-write), then take a
+    // fair share of each peer's queue. Async merges take a bounded one so
+    // rescans and other documents get the strand in between. It grows with
+    // the document, since every merge writes all of it: a quarter of its
+    // lines keeps a large paste from rewriting the file per 1024 ops.
+    auto recv_snapshot = cow_take(doc.recv);
+    size_t budget = sched ? max(INBOUND_MERGE_OPS, doc.lines.size() / 4) : SIZE_MAX;
+    vector<UpdateObject> drained = doc.inbound.drain(budget, now_ms());
+    if (doc.spilling && !doc.inbound.spilled())
+        doc.spilling = false;
+    if (recv_snapshot->empty() && drained.empty())
+        return;
+    vector<UpdateObject> incoming;
+    incoming.reserve(recv_snapshot->size() + drained.size());
+    incoming.insert(incoming.end(), recv_snapshot->begin(), recv_snapshot->end());
+    incoming.insert(incoming.end(), drained.begin(), drained.end());
+
+    // merged in place: doc.index changes with it, so a copy couldn't be
+    // thrown away anyway
+    MemoryCharge copied(MEM_MERGE); // the ops
+    copied.set(incoming.capacity() * sizeof(UpdateObject));
+    ChangedLines changed;
+    vector<UpdateObject> deferred = LwwLines::merge(doc.lines, doc.index, local_ops, incoming,
+                                                    {&doc.blame, &doc.offsets, &doc.columns, doc.trigrams.get(), &doc.texts, &changed});
+    for (auto &u : incoming) // deferred ones hold their site back when published
+        witness(doc.seen, site_id(string(u.user_id, strnlen(u.user_id, sizeof(u.user_id)))), u.seq);
+    for (auto &u : incoming) // merged, or lost to LWW: its text is done with
+        if (u.new_len && none_of(deferred.begin(), deferred.end(), [&](const UpdateObject &d)
+                                 { return d.seq == u.seq && strncmp(d.user_id, u.user_id, sizeof(d.user_id)) == 0; }))
+            doc.texts.drop(u);
+    if (!deferred.empty()) // their lines haven't arrived yet
+        cow_append(doc.recv, deferred.data(), deferred.data() + deferred.size());
+    size_t applied = incoming.size() - deferred.size();
+    if (applied == 0)
+        return;
+
+    write_document(doc);
+    charge_lines(doc);
+    doc.versions.commit(doc.lines, changed, now_ms());
+    doc.merges++;
+    if (hooks.merged)
+        hooks.merged(doc, applied);
+    stats_board.publish();
+}
+
+// force: merge whatever is pending, e.g. when the flush timer fires
+void Session::try_merge_if_needed(Document &doc, const vector<UpdateObject> &local_ops_for_merge, bool force)
+{
+    auto recv_snapshot = std::atomic_load(&doc.recv);
+    auto local_snapshot = std::atomic_load(&doc.local);
+
+    size_t total = recv_snapshot->size() + doc.inbound.size() + local_snapshot->size() + local_ops_for_merge.size();
+
+    if (total >= MERGE_THRESHOLD || (force && total > 0))
+    {
+        // unsent local ops stay buffered for the next broadcast
+        vector<UpdateObject> to_merge = local_ops_for_merge;
+        to_merge.insert(to_merge.end(), local_snapshot->begin(), local_snapshot->end());
+        merge_and_apply(doc, to_merge);
+    }
+}
+
+// Hands a decoded batch to the merge engine; shared by every transport.
+void Session::deliver(const BatchHeader &hdr, const vector<UpdateObject> &batch)
+{
+    string name(hdr.doc, strnlen(hdr.doc, sizeof(hdr.doc)));
+    auto doc = find(name);
+    if (!doc)
+    {
+        log(LogKind::Warning, "Dropped " + to_string(batch.size()) + " update(s) for unopened document " + name);
+        return;
+    }
+
+    // ops whose text is still streaming in wait for it in doc->texts
+    const vector<UpdateObject> *ready = &batch;
+    vector<UpdateObject> admitted;
+    if (any_of(batch.begin(), batch.end(), [](const UpdateObject &u) { return u.new_len != 0; }))
+    {
+        for (auto &upd : batch)
+            if (doc->texts.admit(upd))
+                admitted.push_back(upd);
+        ready = &admitted;
+    }
+
+    // interactive batches merge as they come; bulk ones wait for
+    // MERGE_THRESHOLD like before and yield to interactive ones in the queue
+    Lane lane = (hdr.flags & FRAME_BULK) ? LANE_BULK : LANE_INTERACTIVE;
+    doc->inbound.push(ready->data(), ready->data() + ready->size(), lane);
+    if (doc->inbound.spilled() && !doc->spilling.exchange(true))
+        log(LogKind::Warning, "[Spill] " + name + ": more than " + to_string(cfg.memory_ceiling >> 20) +
+                                  " MB of ops waiting to merge; the oldest wait on disk");
+    if (lane == LANE_BULK && hooks.received_bulk)
+        hooks.received_bulk(*doc, batch);
+    else if (hooks.received)
+        for (auto &upd : batch)
+            hooks.received(*doc, upd);
+
+    if (sched)
+        schedule(doc, false, lane == LANE_INTERACTIVE);
+    else
+    {
+        lock_guard<mutex> lock(doc->sync_m);
+        try_merge_if_needed(*doc, {}, lane == LANE_INTERACTIVE);
+    }
+    stats_board.publish();
+}
+
+// Appends a chunk to its text; ops it completes are merged straight away.
+void Session::deliver_text(const BatchHeader &hdr, const char *payload, size_t len)
+{
+    auto doc = find(string(hdr.doc, strnlen(hdr.doc, sizeof(hdr.doc))));
+    TextChunk chunk;
+    if (!doc || len < sizeof(chunk))
+        return;
+    memcpy(&chunk, payload, sizeof(chunk));
+    string from(chunk.user_id, strnlen(chunk.user_id, sizeof(chunk.user_id)));
+    vector<UpdateObject> ready = doc->texts.add(site_id(from), chunk, payload + sizeof(chunk), len - sizeof(chunk));
+    if (ready.empty())
+        return;
+    log(LogKind::Info, "[Streamed] " + to_string(chunk.total) + " bytes from " + from + " assembled");
+
+    cow_append(doc->recv, ready.data(), ready.data() + ready.size());
+    if (sched)
+        schedule(doc, false, true);
+    else
+    {
+        lock_guard<mutex> lock(doc->sync_m);
+        try_merge_if_needed(*doc, {}, true);
+    }
+}
+
+// -------------------- Backlog --------------------
+// Large batches leave STREAM_BATCH_OPS ops a frame, all in LANE_BULK. Sync
+// sessions send every frame inline; async ones queue slices behind any
+// already waiting for the same document, so its ops stay in order (peers
+// publish frontiers assuming a site's ops arrive in order).
+void Session::broadcast(const string &doc, const vector<UpdateObject> &ops)
+{
+    if (ops.empty() || !transport)
+        return;
+    PerfScope perf(STAGE_BROADCAST);
+    if (ops.size() <= STREAM_BATCH_OPS && !backlogged(doc))
+    {
+        transport->send(doc, ops, lane_of(ops));
+        return;
+    }
+    for (size_t at = 0; at < ops.size(); at += STREAM_BATCH_OPS)
+    {
+        vector<UpdateObject> slice(ops.begin() + at, ops.begin() + min(ops.size(), at + STREAM_BATCH_OPS));
+        if (sched)
+        {
+            backlog.push_back({doc, std::move(slice), {}, 0});
+            backlog_held.set(backlog_held.bytes() + backlog.back().heap_bytes());
+        }
+        else
+            transport->send(doc, slice, LANE_BULK);
+    }
+    pump_backlog();
+}
+
+void Session::send_texts(const string &doc, vector<OpText> texts)
+{
+    if (texts.empty() || !transport)
+        return;
+    PerfScope perf(STAGE_BROADCAST);
+    size_t bytes = 0;
+    for (auto &t : texts)
+        bytes += t.text.size();
+    log(LogKind::Notice, "[Streaming] " + to_string(texts.size()) + " long line(s), " + to_string(bytes) + " bytes");
+    for (auto &t : texts)
+    {
+        if (sched)
+        {
+            backlog.push_back({doc, {}, std::move(t), 0});
+            backlog_held.set(backlog_held.bytes() + backlog.back().heap_bytes());
+        }
+        else
+            for (size_t offset = 0; offset < t.text.size();)
+                transport->send_text(build_text_frame(doc, cfg.user_id, t, offset));
+    }
+    pump_backlog();
+}
+
+bool Session::backlogged(const string &doc) const
+{
+    return any_of(backlog.begin(), backlog.end(),
+                  [&](const Backlogged &b) { return !b.ops.empty() && b.doc == doc; });
+}
+
+void Session::pump_backlog()
+{
+    if (backlog.empty() || pumping)
+        return;
+    pumping = true;
+    backlog_pump();
+}
+
+// One frame per turn on the broadcast strand, then back to the end of its
+// queue: batches posted meanwhile, such as our next edits, go out between
+// the frames of a large paste rather than after all of them. Texts take
+// turns frame by frame.
+Detached Session::backlog_pump()
+{
+    while (true)
+    {
+        co_await ResumeOnStrand{*broadcast_strand};
+        if (backlog.empty())
+        {
+            pumping = false;
+            co_return;
+        }
+        PerfScope perf(STAGE_BROADCAST); // until the end of this turn
+        Backlogged next = std::move(backlog.front());
+        backlog.pop_front();
+        backlog_held.set(backlog_held.bytes() - next.heap_bytes());
+        if (!next.ops.empty())
+        {
+            transport->send(next.doc, next.ops, LANE_BULK);
+            continue;
+        }
+        transport->send_text(build_text_frame(next.doc, cfg.user_id, next.text, next.offset));
+        if (next.offset < next.text.text.size())
+        {
+            backlog.push_back(std::move(next));
+            backlog_held.set(backlog_held.bytes() + backlog.back().heap_bytes());
+        }
+    }
+}
+
+// -------------------- Change Detection --------------------
+static string describe_local(const UpdateObject &upd)
+{
+    string line = "Line " + to_string(upd.line);
+    if (strcmp(upd.op_type, "insert") == 0)
+        return line + " inserted, \"" + string(upd.new_content) + "\"";
+    if (strcmp(upd.op_type, "delete") == 0)
+        return line + " deleted, \"" + string(upd.old_content) + "\"";
+    return line + ", \"" + string(upd.old_content) + "\" → \"" + string(upd.new_content) + "\"";
+}
+
+// Diffs current against doc.lines, moving doc.lines and doc.index to it.
+// outgoing: if given, what to send is returned there instead of sent
+void Session::scan(Document &doc, const vector<string> &current, Outgoing *outgoing)
+{
+    PerfScope perf(STAGE_SCAN);
+    vector<OpText> long_text, old_text;
+    vector<UpdateObject> ops =
+        diff_lines(doc.lines, current, doc.index, site, cfg.user_id, cfg.columns, &long_text, &old_text);
+    doc.lines = current;
+    charge_lines(doc);
+    // warn where someone else's cursor is on a line we just edited, since
+    // overlapping edits are resolved by LWW
+    vector<Presence> others = doc.presence.read();
+    long long now = now_ms();
+    for (auto &upd : ops)
+    {
+        log(LogKind::Local, "[Local Change Detected] " + describe_local(upd));
+        for (auto &p : others)
+            if (p.line == upd.line_id && now - p.updated_ms < PRESENCE_ACTIVE_MS)
+                log(LogKind::Warning, "[Heads up] " + p.user_id + " is also editing line " + to_string(upd.line));
+    }
+    // our cursor is wherever we typed last, unless that line is gone
+    auto last = find_if(ops.rbegin(), ops.rend(), [](const UpdateObject &u) { return strcmp(u.op_type, "delete") != 0; });
+    if (last != ops.rend())
+    {
+        int cursor_col = last->start_col + (int)column_width(last->new_content, strlen(last->new_content), cfg.columns);
+        doc.presence.publish(last->line_id, cursor_col, last->line_id, cursor_col);
+    }
+    if (ops.empty())
+    {
+        try_merge_if_needed(doc); // remote ops may have waited for this rescan
+        return;
+    }
+    doc.history.record({ops, std::move(old_text), long_text});
+    for (auto &t : long_text)
+        doc.unsent_text.push_back(std::move(t));
+    ChangedLines changed;
+    track_local({&doc.blame, &doc.offsets, &doc.columns, doc.trigrams.get(), nullptr, &changed}, ops, doc.lines,
+                doc.index);
+    doc.versions.commit(doc.lines, changed, now_ms());
+    queue_local(doc, ops, outgoing);
+    stats_board.publish();
+}
+
+// Buffers our ops and broadcasts once MERGE_THRESHOLD have built up.
+void Session::queue_local(Document &doc, const vector<UpdateObject> &ops, Outgoing *outgoing)
+{
+    for (auto &upd : ops)
+        witness(doc.seen, site, upd.seq);
+
+    // append to the local buffer (copy-on-write)
+    cow_append(doc.local, ops.data(), ops.data() + ops.size());
+
+    if (std::atomic_load(&doc.local)->size() >= MERGE_THRESHOLD)
+    {
+        // broadcast all
+        auto taken = cow_take(doc.local);
+        vector<UpdateObject> to_send(taken->begin(), taken->end());
+        vector<UpdateObject> wire = pack_bulk(to_send, doc.lines, doc.index, integrated(doc), cfg.columns);
+        vector<OpText> texts = std::move(doc.unsent_text);
+        doc.unsent_text.clear();
+        log(LogKind::Notice, "[Broadcasting updates...]");
+        if (wire.size() < to_send.size())
+            log(LogKind::Notice, "[Bulk] " + to_string(to_send.size()) + " ops sent as " + to_string(wire.size()));
+        if (outgoing)
+        {
+            outgoing->batches.push_back(wire);
+            for (auto &t : texts)
+                outgoing->texts.push_back(std::move(t));
+        }
+        else
+        {
+            broadcast(doc.name, wire);
+            send_texts(doc.name, std::move(texts));
+        }
+        try_merge_if_needed(doc, to_send);
+    }
+    else
+    {
+        try_merge_if_needed(doc);
+    }
+}
+
+void Session::file_changed(const shared_ptr<Document> &doc)
+{
+    if (sched)
+    {
+        schedule(doc, true);
+        return;
+    }
+    lock_guard<mutex> lock(doc->sync_m);
+    scan(*doc, read_document(*doc), nullptr);
+}
+
+// -------------------- Undo / Redo --------------------
+void Session::revert(Document &doc, bool redo, Outgoing *outgoing)
+{
+    vector<string> current = read_document(doc);
+    if (current != doc.lines)
+        scan(doc, current, outgoing);
+
+    const char *what = redo ? "Redo" : "Undo";
+    if (!(redo ? doc.history.can_redo() : doc.history.can_undo()))
+    {
+        log(LogKind::Warning, string("[") + what + "] Nothing to " + (redo ? "redo" : "undo") + " in " + doc.name);
+        return;
+    }
+    UndoEdit edit = redo ? doc.history.take_redo() : doc.history.take_undo();
+    UndoEdit inverse = invert_edit(edit, doc.lines, doc.index, site, cfg.user_id, cfg.columns);
+    charge_lines(doc);
+    vector<UpdateObject> ops = inverse.ops;
+    if (ops.empty())
+    {
+        log(LogKind::Warning, string("[") + what + "] The lines it touched have changed since; skipped.");
+        return;
+    }
+    for (auto &t : inverse.new_text)
+        doc.unsent_text.push_back(t);
+    if (redo)
+        doc.history.redone_as(std::move(inverse));
+    else
+        doc.history.undone_as(std::move(inverse));
+
+    ChangedLines changed;
+    track_local({&doc.blame, &doc.offsets, &doc.columns, doc.trigrams.get(), nullptr, &changed}, ops, doc.lines,
+                doc.index);
+    write_document(doc);
+    doc.versions.commit(doc.lines, changed, now_ms());
+    for (auto &upd : ops)
+        log(LogKind::Local, string("[") + what + "] " + describe_local(upd));
+    queue_local(doc, ops, outgoing);
+}
+
+void Session::undo(const shared_ptr<Document> &doc)
+{
+    if (sched)
+    {
+        history_pipeline(doc, false);
+        return;
+    }
+    lock_guard<mutex> lock(doc->sync_m);
+    revert(*doc, false, nullptr);
+}
+
+void Session::redo(const shared_ptr<Document> &doc)
+{
+    if (sched)
+    {
+        history_pipeline(doc, true);
+        return;
+    }
+    lock_guard<mutex> lock(doc->sync_m);
+    revert(*doc, true, nullptr);
+}
+
+// -------------------- Search --------------------
+SearchResult Session::find_in(Document &doc, const string &needle)
+{
+    auto start = chrono::steady_clock::now();
+    SearchResult result{};
+    result.indexed = doc.trigrams && needle.size() >= 3;
+    result.hits = doc.trigrams ? doc.trigrams->search(needle, doc.lines, doc.index) : scan_lines(needle, doc.lines);
+    result.elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    if (doc.trigrams)
+        result.stats = doc.trigrams->stats();
+    for (auto &hit : result.hits)
+        hit.col = doc.columns.table(doc.index.at(hit.line), doc.lines[hit.line]).to_col(hit.col);
+    return result;
+}
+
+void Session::search(const shared_ptr<Document> &doc, const string &needle, function<void(const SearchResult &)> done)
+{
+    if (sched)
+    {
+        search_pipeline(doc, needle, std::move(done));
+        return;
+    }
+    SearchResult result;
+    {
+        lock_guard<mutex> lock(doc->sync_m);
+        result = find_in(*doc, needle);
+    }
+    done(result);
+}
+
+// -------------------- Presence --------------------
+// Positions become line ids here, so the cursor stays on its line as
+// anyone inserts or deletes lines above it.
+void Session::place_cursor(Document &doc, size_t line, int col, size_t sel_line, int sel_col)
+{
+    if (doc.lines.empty())
+        return;
+    size_t last = doc.lines.size() - 1;
+    doc.presence.publish(doc.index.at(min(line, last)), col, doc.index.at(min(sel_line, last)), sel_col);
+}
+
+void Session::set_cursor(const shared_ptr<Document> &doc, size_t line, int col, size_t sel_line, int sel_col)
+{
+    if (!cfg.presence)
+        return;
+    if (sched)
+    {
+        cursor_pipeline(doc, line, col, sel_line, sel_col);
+        return;
+    }
+    lock_guard<mutex> lock(doc->sync_m);
+    place_cursor(*doc, line, col, sel_line, sel_col);
+}
+
+// -------------------- Async Pipeline --------------------
+// listener → merge → persist → broadcast for one document. Rescan, merge
+// and the file write run on the document's strand; sends then hop to the
+// broadcast strand, so the reactor thread never blocks on either.
+Detached Session::document_pipeline(shared_ptr<Document> doc, bool rescan, bool force)
+{
+    co_await ResumeOnStrand{*doc->strand};
+    Outgoing outgoing;
+    if (rescan)
+    {
+        doc->rescan.store(false);
+        scan(*doc, read_document(*doc), &outgoing);
+    }
+    else
+    {
+        doc->remerge.store(false);
+        size_t queued = doc->inbound.size();
+        try_merge_if_needed(*doc, {}, force);
+        if (doc->inbound.size() < queued && doc->inbound.ready(now_ms())) // took a share, more waiting
+            schedule(doc, false, true);
+    }
+    if (outgoing.batches.empty())
+        co_return;
+
+    co_await ResumeOnStrand{*broadcast_strand};
+    for (auto &batch : outgoing.batches)
+        broadcast(doc->name, batch);
+    send_texts(doc->name, std::move(outgoing.texts));
+}
+
+void Session::schedule(const shared_ptr<Document> &doc, bool rescan, bool force)
+{
+    // coalesce: one queued rescan and one queued merge per document
+    if (!(rescan ? doc->rescan : doc->remerge).exchange(true))
+        document_pipeline(doc, rescan, force);
+}
+
+// Maps written files back to open documents.
+Detached Session::inotify_loop(int fd)
+{
+    alignas(inotify_event) char buf[16 * 1024];
+    while (true)
+    {
+        ssize_t len = co_await async_read(*loop, fd, buf, sizeof(buf));
+        if (len <= 0)
+            continue;
+        auto table = std::atomic_load(&docs);
+        for (char *p = buf; p < buf + len;)
+        {
+            inotify_event *e = (inotify_event *)p;
+            if (e->len)
+            {
+                string fname = e->name;
+                for (auto &kv : *table)
+                    if (kv.second->filename == fname)
+                        schedule(kv.second, true);
+            }
+            p += sizeof(inotify_event) + e->len;
+        }
+    }
+}
+
+Detached Session::gc_pipeline(shared_ptr<Document> doc)
+{
+    co_await ResumeOnStrand{*doc->strand};
+    VersionVector stable = observe_peers(*doc);
+    size_t todo = stable.empty() ? 0 : doc->index.tombstones();
+    size_t dropped = 0, bytes = 0;
+    while (todo > 0)
+    {
+        compact_step(*doc, stable, todo, dropped, bytes);
+        if (todo > 0)
+            co_await ResumeOnStrand{*doc->strand}; // merges queued meanwhile go first
+    }
+    report_reclaimed(*doc, dropped, bytes);
+    doc->collect.store(false);
+}
+
+Detached Session::history_pipeline(shared_ptr<Document> doc, bool redo)
+{
+    co_await ResumeOnStrand{*doc->strand};
+    Outgoing outgoing;
+    revert(*doc, redo, &outgoing);
+    if (outgoing.batches.empty())
+        co_return;
+
+    co_await ResumeOnStrand{*broadcast_strand};
+    for (auto &batch : outgoing.batches)
+        broadcast(doc->name, batch);
+    send_texts(doc->name, std::move(outgoing.texts));
+}
+
+Detached Session::search_pipeline(shared_ptr<Document> doc, string needle,
+                                  function<void(const SearchResult &)> done)
+{
+    co_await ResumeOnStrand{*doc->strand};
+    done(find_in(*doc, needle));
+}
+
+Detached Session::cursor_pipeline(shared_ptr<Document> doc, size_t line, int col, size_t sel_line, int sel_col)
+{
+    co_await ResumeOnStrand{*doc->strand};
+    place_cursor(*doc, line, col, sel_line, sel_col);
+}
+
+// Remote updates below MERGE_THRESHOLD would otherwise wait for more
+// traffic; merge them once they have sat for MERGE_FLUSH_MS. Ops held by a
+// peer's rate cap also leave here, as its tokens come back.
+Detached Session::flush_loop()
+{
+    while (true)
+    {
+        co_await SleepFor{*loop, chrono::milliseconds(MERGE_FLUSH_MS)};
+        auto table = std::atomic_load(&docs);
+        for (auto &kv : *table)
+            if (!std::atomic_load(&kv.second->recv)->empty() || kv.second->inbound.size() > 0)
+                schedule(kv.second, false, true);
+    }
+}
+
+Detached Session::gc_loop()
+{
+    while (true)
+    {
+        co_await SleepFor{*loop, chrono::milliseconds(GC_INTERVAL_MS)};
+        auto table = std::atomic_load(&docs);
+        for (auto &kv : *table)
+            collect_garbage(kv.second);
+    }
+}
+
+// Deliveries, merges and rescans publish as they finish; this catches
+// the rest, such as what collection frees.
+Detached Session::stats_loop()
+{
+    while (true)
+    {
+        co_await SleepFor{*loop, chrono::milliseconds(STATS_INTERVAL_MS)};
+        stats_board.publish();
+    }
+}
+
+// -------------------- Tombstone Collection --------------------
+// Publishes our frontier, reads everyone else's and returns what is stable
+// (empty: nothing can go yet).
+VersionVector Session::integrated(Document &doc) const
+{
+    auto pending = std::atomic_load(&doc.recv);
+    return integrated_frontier(doc.texts.hold_back(doc.inbound.hold_back(doc.seen)), pending->data(),
+                               pending->data() + pending->size());
+}
+
+VersionVector Session::observe_peers(Document &doc)
+{
+    VersionVector ours = integrated(doc);
+    publish_versions(cfg.user_id, doc.name, ours);
+    vector<pair<uint32_t, VersionVector>> published;
+    for (auto &peer : registered_versions(cfg.user_id, doc.name))
+        published.push_back({site_id(peer.first), peer.second});
+    doc.frontier.observe(published, ours);
+    return doc.frontier.stable(ours);
+}
+
+void Session::compact_step(Document &doc, const VersionVector &stable, size_t &todo, size_t &dropped,
+                           size_t &bytes)
+{
+    size_t n = min(todo, GC_CHUNK);
+    size_t before = doc.index.memory_bytes();
+    dropped += doc.index.compact(stable, n);
+    size_t after = doc.index.memory_bytes();
+    bytes += before > after ? before - after : 0;
+    todo -= n;
+}
+
+void Session::report_reclaimed(Document &doc, size_t dropped, size_t bytes)
+{
+    if (dropped == 0)
+        return;
+    doc.reclaimed_bytes += bytes;
+    log(LogKind::Info, "[GC] " + doc.name + ": dropped " + to_string(dropped) + " tombstone(s), reclaimed " +
+                           to_string(bytes) + " bytes (" + to_string(doc.reclaimed_bytes) + " in total)");
+}
+
+void Session::collect_garbage(const shared_ptr<Document> &doc)
+{
+    if (cfg.transport == TRANSPORT_TCP || cfg.transport == TRANSPORT_UNIX)
+        return;
+    if (sched)
+    {
+        if (!doc->collect.exchange(true))
+            gc_pipeline(doc);
+        return;
+    }
+
+    VersionVector stable;
+    size_t todo = 0, dropped = 0, bytes = 0;
+    {
+        lock_guard<mutex> lock(doc->sync_m);
+        stable = observe_peers(*doc);
+        if (!stable.empty())
+            todo = doc->index.tombstones();
+    }
+    while (todo > 0)
+    {
+        lock_guard<mutex> lock(doc->sync_m); // dropped between chunks so merges get in
+        compact_step(*doc, stable, todo, dropped, bytes);
+    }
+    lock_guard<mutex> lock(doc->sync_m);
+    report_reclaimed(*doc, dropped, bytes);
+}
+
+} // namespace synctext
@@ -0,0 +1,117 @@
+#include "synctext/spill.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "synctext/types.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// Each record: its length, then the bytes, padded to keep the next header
+// aligned.
+static const size_t RECORD_HEADER = sizeof(uint64_t);
+
+static size_t record_size(size_t len)
+{
+    return (RECORD_HEADER + len + 7) & ~(size_t)7;
+}
+
+// -------------------- Spill Log --------------------
+SpillLog::SpillLog(string dir) : dir(std::move(dir))
+{
+}
+
+SpillLog::~SpillLog()
+{
+    if (base)
+        munmap(base, mapped);
+    if (fd != -1)
+        close(fd);
+}
+
+bool SpillLog::reserve(size_t len)
+{
+    if (tail + len <= mapped)
+        return true;
+    if (fd == -1)
+    {
+        fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (fd == -1) // filesystems without O_TMPFILE
+        {
+            string path = dir + "/synctext-spill-XXXXXX";
+            fd = mkostemp(&path[0], O_CLOEXEC);
+            if (fd == -1)
+                return false;
+            unlink(path.c_str());
+        }
+    }
+
+    size_t size = mapped + (tail + len - mapped + SPILL_GROW_BYTES - 1) / SPILL_GROW_BYTES * SPILL_GROW_BYTES;
+    if (posix_fallocate(fd, mapped, size - mapped) != 0)
+        return false;
+    void *p = base ? mremap(base, mapped, size, MREMAP_MAYMOVE)
+                   : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return false; // the old mapping, if any, is still whole
+    base = (char *)p;
+    mapped = size;
+    return true;
+}
+
+bool SpillLog::append(const void *data, size_t len)
+{
+    if (!reserve(record_size(len)))
+        return false;
+    uint64_t n = len;
+    memcpy(base + tail, &n, RECORD_HEADER);
+    memcpy(base + tail + RECORD_HEADER, data, len);
+    tail += record_size(len);
+    records++;
+    return true;
+}
+
+string_view SpillLog::front() const
+{
+    uint64_t n;
+    memcpy(&n, base + head, RECORD_HEADER);
+    return string_view(base + head + RECORD_HEADER, n);
+}
+
+void SpillLog::pop()
+{
+    head += record_size(front().size());
+    if (--records == 0)
+    {
+        reset();
+        return;
+    }
+    // hand what was read back to the filesystem, whole pages at a time
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t upto = head / page * page;
+    if (upto - released >= SPILL_RELEASE_BYTES &&
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, released, upto - released) == 0)
+        released = upto;
+}
+
+void SpillLog::reset()
+{
+    if (base)
+        munmap(base, mapped);
+    if (ftruncate(fd, 0) == -1)
+    {
+        // the blocks stay allocated until the file is closed; start afresh
+        close(fd);
+        fd = -1;
+    }
+    base = nullptr;
+    mapped = head = tail = released = 0;
+}
+
+} // namespace synctext
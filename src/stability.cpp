@@ -0,0 +1,67 @@
+#include "synctext/stability.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "synctext/line_index.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+VersionVector integrated_frontier(const VersionVector &seen, const UpdateObject *first, const UpdateObject *last)
+{
+    VersionVector vv = seen;
+    for (const UpdateObject *p = first; p != last; ++p)
+    {
+        const UpdateObject &u = *p;
+        uint32_t site = site_id(string(u.user_id, strnlen(u.user_id, sizeof(u.user_id))));
+        auto it = vv.find(site);
+        if (it != vv.end() && u.seq > 0 && u.seq <= it->second)
+            it->second = u.seq - 1;
+    }
+    return vv;
+}
+
+VersionVector meet(const VersionVector &a, const VersionVector &b)
+{
+    VersionVector out;
+    for (auto &kv : a)
+    {
+        uint32_t other = version_of(b, kv.first);
+        if (other > 0)
+            out[kv.first] = min(kv.second, other);
+    }
+    return out;
+}
+
+// -------------------- Stable Frontier --------------------
+void StableFrontier::observe(const vector<pair<uint32_t, VersionVector>> &published, const VersionVector &ours)
+{
+    map<uint32_t, VersionVector> next;
+    unconfirmed.clear();
+    for (auto &peer : published)
+    {
+        uint32_t site = peer.first;
+        if (version_of(ours, site) >= version_of(peer.second, site))
+            next[site] = peer.second;
+        else if (confirmed.count(site))
+            next[site] = confirmed[site]; // still catching up: keep the last one we could vouch for
+        else
+            unconfirmed.push_back(site);
+    }
+    confirmed.swap(next);
+}
+
+VersionVector StableFrontier::stable(const VersionVector &ours) const
+{
+    if (!unconfirmed.empty())
+        return {};
+    VersionVector vv = ours;
+    for (auto &kv : confirmed)
+        vv = meet(vv, kv.second);
+    return vv;
+}
+
+} // namespace synctext
@@ -0,0 +1,161 @@
+#include "synctext/stats.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Stats Segment (shm seqlock) --------------------
+static bool pid_alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+StatsBoard::~StatsBoard()
+{
+    if (!seg)
+        return;
+    munmap(seg, sizeof(StatsSegment));
+    shm_unlink(name.c_str());
+}
+
+bool StatsBoard::open(const string &user_id)
+{
+    if (seg)
+        return true;
+    name = STATS_SHM_PREFIX + user_id;
+    int shm_fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0666);
+    if (shm_fd == -1)
+        return false;
+    int sized = ftruncate(shm_fd, sizeof(StatsSegment));
+    void *ptr = mmap(0, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    ::close(shm_fd);
+    if (sized == -1 || ptr == MAP_FAILED)
+        return false;
+    seg = (StatsSegment *)ptr;
+
+    uint32_t seq = seg->seq.load(memory_order_relaxed) | 1;
+    seg->seq.store(seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    seg->pid = getpid();
+    seg->tags = MEM_TAGS;
+    for (int t = 0; t < MEM_TAGS; ++t)
+    {
+        strncpy(seg->memory[t].name, mem_tag_name((MemTag)t), sizeof(seg->memory[t].name)-1);
+        seg->memory[t].name[sizeof(seg->memory[t].name)-1] = '\0';
+    }
+    for (int s = 0; s < PERF_STAGES; ++s)
+    {
+        strncpy(seg->stages[s].name, perf_stage_name((PerfStage)s), sizeof(seg->stages[s].name)-1);
+        seg->stages[s].name[sizeof(seg->stages[s].name)-1] = '\0';
+    }
+    seg->seq.store(seq + 1, memory_order_release);
+    publish();
+    return true;
+}
+
+void StatsBoard::publish()
+{
+    unique_lock<mutex> lock(m, try_to_lock);
+    if (!seg || !lock.owns_lock())
+        return;
+    MemoryUsage usage[MEM_TAGS];
+    for (int t = 0; t < MEM_TAGS; ++t)
+        usage[t] = memory_usage((MemTag)t);
+    StageStats stages[PERF_STAGES];
+    for (int s = 0; s < PERF_STAGES; ++s)
+        stages[s] = stage_stats((PerfStage)s);
+
+    uint32_t seq = seg->seq.load(memory_order_relaxed);
+    seg->seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (int t = 0; t < MEM_TAGS; ++t)
+    {
+        seg->memory[t].live = usage[t].live;
+        seg->memory[t].peak = usage[t].peak;
+        seg->memory[t].allocations = usage[t].allocations;
+    }
+    seg->profiling = profiling();
+    seg->counters = perf_counters();
+    for (int s = 0; s < PERF_STAGES; ++s)
+    {
+        seg->stages[s].invocations = stages[s].invocations;
+        seg->stages[s].wall_ns = stages[s].wall_ns;
+        memcpy(seg->stages[s].counts, stages[s].counts, sizeof(stages[s].counts));
+    }
+    seg->updated_ms = now_ms();
+    seg->seq.store(seq + 2, memory_order_release);
+}
+
+bool read_stats(const string &user_id, StatsSnapshot &out)
+{
+    int shm_fd = shm_open((STATS_SHM_PREFIX + user_id).c_str(), O_RDONLY, 0);
+    if (shm_fd == -1)
+        return false;
+    void *ptr = mmap(0, sizeof(StatsSegment), PROT_READ, MAP_SHARED, shm_fd, 0);
+    ::close(shm_fd);
+    if (ptr == MAP_FAILED)
+        return false;
+    const StatsSegment &s = *(const StatsSegment *)ptr;
+
+    StatsSegment copy;
+    uint32_t before, after;
+    do
+    {
+        before = s.seq.load(memory_order_acquire);
+        if (before & 1)
+        {
+            this_thread::yield();
+            after = before + 1;
+            continue;
+        }
+        copy.pid = s.pid;
+        copy.updated_ms = s.updated_ms;
+        copy.tags = s.tags;
+        memcpy(copy.memory, s.memory, sizeof(copy.memory));
+        copy.profiling = s.profiling;
+        copy.counters = s.counters;
+        memcpy(copy.stages, s.stages, sizeof(copy.stages));
+        atomic_thread_fence(memory_order_acquire);
+        after = s.seq.load(memory_order_relaxed);
+    } while (before != after);
+    munmap(ptr, sizeof(StatsSegment));
+
+    if (!pid_alive(copy.pid))
+        return false;
+    out.pid = copy.pid;
+    out.updated_ms = copy.updated_ms;
+    out.memory.clear();
+    for (uint32_t t = 0; t < copy.tags && t < (uint32_t)MEM_TAGS; ++t)
+    {
+        const MemoryCounters &c = copy.memory[t];
+        MemoryUsage u;
+        u.live = c.live;
+        u.peak = c.peak;
+        u.allocations = c.allocations;
+        out.memory.push_back({string(c.name, strnlen(c.name, sizeof(c.name))), u});
+    }
+    out.profiling = copy.profiling;
+    out.counters = copy.counters;
+    out.stages.clear();
+    for (int i = 0; out.profiling && i < PERF_STAGES; ++i)
+    {
+        const StageCounters &c = copy.stages[i];
+        StageStats st;
+        st.invocations = c.invocations;
+        st.wall_ns = c.wall_ns;
+        memcpy(st.counts, c.counts, sizeof(st.counts));
+        out.stages.push_back({string(c.name, strnlen(c.name, sizeof(c.name))), st});
+    }
+    return true;
+}
+
+} // namespace synctext
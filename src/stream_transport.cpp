@@ -0,0 +1,707 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+#include "synctext/memory.h"
+#include "synctext/spill.h"
+#include "transports.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Stream Socket Transport (epoll) --------------------
+// TCP or Unix stream sockets for deployments without a shared /tmp or shm.
+// Each process dials every peer (outbound connections carry our batches)
+// and accepts inbound connections on the listen address. One epoll thread
+// owns all sockets; send() only hands it batches via the mailbox. It reads
+// at most STREAM_READ_BYTES from a connection per wakeup, so a peer
+// streaming a large paste doesn't hold up the others.
+// A FRAME_HELLO with an empty doc opens the connection; one naming a
+// document offers (or acks) the dictionary that document is compressed with.
+struct HelloPayload
+{
+    char user_id[32];
+    uint32_t caps;
+    uint32_t dict_id;   // sender: its dictionary; ack: the dictionary accepted
+    uint32_t dict_size; // dictionary bytes that follow (sender only)
+};
+
+struct StreamConn
+{
+    int fd = -1;
+    bool outbound = false;
+    bool connected = false;
+    bool want_out = false; // EPOLLOUT armed
+    bool dead = false;
+    string addr;           // peer address we redial (outbound only)
+    time_t retry_at = 0;
+    size_t failed_dials = 0; // in a row; each redial starts one address further down addr's list
+    string peer_id;
+
+    // receive side
+    vector<char, TaggedAllocator<char, MEM_QUEUES>> in;
+    size_t in_off = 0;
+    map<string, WireDict> peer_dicts; // per document, from the peer's offers (inbound)
+
+    // send side; frames are shared between peers that get the same encoding.
+    // Bulk frames wait in bulk and move to the outbox BULK_INFLIGHT_BYTES
+    // at a time. Every frame here is our own, and a merge only settles
+    // replaces it sees together, so ours must arrive in order: an
+    // interactive frame skips the bulk queue only when nothing waits in it
+    // and the peer is connected. Past SessionConfig::memory_ceiling the
+    // oldest bulk frames wait in spilled, ahead of bulk.
+    deque<shared_ptr<const vector<char>>> outbox;
+    deque<shared_ptr<const vector<char>>> bulk;
+    unique_ptr<SpillLog> spilled;
+    bool spilling = false; // logged
+    size_t out_off = 0;    // bytes of outbox.front() already written
+    uint32_t peer_caps = 0; // from the peer's ack (outbound)
+    map<string, uint32_t> offered, acked_dicts; // per document: dictionary we sent, and the one it took
+};
+
+struct OutgoingBatch
+{
+    string doc;
+    vector<UpdateObject> ops;
+    shared_ptr<const vector<char>> text; // a text frame instead of ops
+    Lane lane;
+};
+
+static bool parse_host_port(const string &addr, string &host, string &port)
+{
+    size_t colon = addr.rfind(':');
+    if (colon == string::npos)
+        return false;
+    host = addr.substr(0, colon);
+    port = addr.substr(colon + 1);
+    return !host.empty() && !port.empty();
+}
+
+// Creates a non-blocking stream socket for addr, then binds+listens or
+// starts connecting. A host name may resolve to several addresses (IPv6
+// and IPv4, say): each is tried in turn, starting skip places down the
+// list, until one binds or starts connecting. Returns -1 on failure
+// (errno set, from the last address tried).
+static int stream_open(TransportKind kind, const string &addr, bool listening, size_t skip = 0)
+{
+    if (kind == TRANSPORT_UNIX)
+    {
+        sockaddr_un sa{};
+        sa.sun_family = AF_UNIX;
+        if (addr.size() >= sizeof(sa.sun_path))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strncpy(sa.sun_path, addr.c_str(), sizeof(sa.sun_path)-1);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            return -1;
+        if (listening)
+        {
+            unlink(addr.c_str());
+            if (bind(fd, (sockaddr *)&sa, sizeof(sa)) == -1 || listen(fd, SOMAXCONN) == -1)
+            {
+                close(fd);
+                return -1;
+            }
+        }
+        else if (connect(fd, (sockaddr *)&sa, sizeof(sa)) == -1 && errno != EINPROGRESS && errno != EAGAIN)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    string host, port;
+    if (!parse_host_port(addr, host, port))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res)
+    {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+    vector<addrinfo *> candidates;
+    for (addrinfo *ai = res; ai; ai = ai->ai_next)
+        candidates.push_back(ai);
+    int fd = -1;
+    for (size_t i = 0; i < candidates.size() && fd == -1; ++i)
+    {
+        addrinfo *ai = candidates[(skip + i) % candidates.size()];
+        fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        bool ok;
+        if (listening)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+        }
+        else
+            ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS;
+        if (!ok)
+        {
+            int saved = errno;
+            close(fd);
+            fd = -1;
+            errno = saved;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+class StreamTransport : public Transport
+{
+public:
+    explicit StreamTransport(Session &s) : session(s), kind(s.config().transport) {}
+
+    ~StreamTransport() override
+    {
+        stop();
+        for (auto *list : {&peers, &inbound})
+            for (auto &c : *list)
+                if (c->fd != -1)
+                    close(c->fd);
+        for (int fd : {lfd, ep, wakeup_fd})
+            if (fd != -1)
+                close(fd);
+    }
+
+    void start() override
+    {
+        const string &addr = session.config().listen_addr;
+        wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ep = epoll_create1(EPOLL_CLOEXEC);
+        if (wakeup_fd == -1 || ep == -1)
+            throw system_error(errno, generic_category(), "epoll");
+        lfd = stream_open(kind, addr, true);
+        if (lfd == -1)
+            throw system_error(errno, generic_category(), "listen " + addr);
+        session.log(LogKind::Info, "Listening on " + addr);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &listen_marker;
+        epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+        ev.data.ptr = &wake_marker;
+        epoll_ctl(ep, EPOLL_CTL_ADD, wakeup_fd, &ev);
+
+        for (auto &peer : session.config().peers)
+        {
+            peers.push_back(make_unique<StreamConn>());
+            peers.back()->outbound = true;
+            peers.back()->addr = peer;
+            dial(*peers.back());
+        }
+        loop_thread = thread(&StreamTransport::event_loop, this);
+    }
+
+    void stop() override
+    {
+        if (!loop_thread.joinable())
+            return;
+        stopping.store(true);
+        wake();
+        loop_thread.join();
+    }
+
+    // Producer side of the mailbox; the event loop takes the whole snapshot.
+    void send(const string &doc, const vector<UpdateObject> &ops, Lane lane) override
+    {
+        OutgoingBatch out{doc, ops, nullptr, lane};
+        cow_append(mailbox, &out, &out + 1);
+        wake();
+    }
+
+    // Waits while some connected peer has STREAM_WINDOW_BYTES unwritten,
+    // then queues the frame regardless: nothing is dropped, but a large
+    // paste can't pile up unbounded ahead of later batches.
+    void send_text(const shared_ptr<const vector<char>> &frame) override
+    {
+        auto give_up = chrono::steady_clock::now() + chrono::milliseconds(STREAM_STALL_MS);
+        while (backlog.load() > STREAM_WINDOW_BYTES && chrono::steady_clock::now() < give_up)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        backlog += frame->size();
+        OutgoingBatch out{"", {}, frame, LANE_BULK};
+        cow_append(mailbox, &out, &out + 1);
+        wake();
+    }
+
+private:
+    void wake()
+    {
+        uint64_t one = 1;
+        if (write(wakeup_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            session.log(LogKind::Error, string("eventfd write: ") + strerror(errno));
+    }
+
+    // The connection's hello (doc empty) carries our caps; a document's
+    // offers the dictionary we compress it with, or acks the peer's offer.
+    shared_ptr<const vector<char>> build_hello(const string &doc, uint32_t dict_id, const WireDict *dict = nullptr)
+    {
+        HelloPayload h{};
+        strncpy(h.user_id, session.user_id().c_str(), sizeof(h.user_id)-1);
+        h.caps = session.config().compress ? CAP_COMPRESS : 0;
+        h.dict_id = dict_id;
+        h.dict_size = dict ? dict->bytes.size() : 0;
+
+        vector<char> body(sizeof(h) + h.dict_size);
+        memcpy(body.data(), &h, sizeof(h));
+        if (h.dict_size)
+            memcpy(body.data() + sizeof(h), dict->bytes.data(), h.dict_size);
+        return share_frame(build_frame(doc, body.data(), body.size(), 0, 0, FRAME_HELLO));
+    }
+
+    void set_events(StreamConn &c, bool want_out)
+    {
+        if (c.want_out == want_out)
+            return;
+        c.want_out = want_out;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | (want_out ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.ptr = &c;
+        epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    // Tops the outbox up from the bulk queue, spilled frames first, while
+    // it holds less than BULK_INFLIGHT_BYTES.
+    void promote_bulk(StreamConn &c)
+    {
+        size_t queued = 0;
+        for (auto &frame : c.outbox)
+            queued += frame->size();
+        queued -= min(queued, c.out_off);
+        while (queued < BULK_INFLIGHT_BYTES)
+        {
+            shared_ptr<const vector<char>> frame;
+            if (c.spilled && !c.spilled->empty())
+            {
+                string_view bytes = c.spilled->front();
+                frame = share_frame(vector<char>(bytes.begin(), bytes.end()));
+                c.spilled->pop();
+                if (c.spilled->empty())
+                    c.spilling = false;
+            }
+            else if (!c.bulk.empty())
+            {
+                frame = std::move(c.bulk.front());
+                c.bulk.pop_front();
+            }
+            else
+                break;
+            queued += frame->size();
+            c.outbox.push_back(std::move(frame));
+        }
+    }
+
+    // Moves the oldest bulk frames queued for c to its spill log while more
+    // than SessionConfig::memory_ceiling is held in memory. A peer that is
+    // offline gets everything through the bulk queue, so this bounds what
+    // waits for it too.
+    void spill_over(StreamConn &c)
+    {
+        const SessionConfig &cfg = session.config();
+        if (!cfg.memory_ceiling)
+            return;
+        size_t held = 0;
+        for (auto *queue : {&c.outbox, &c.bulk})
+            for (auto &frame : *queue)
+                held += frame->size();
+        while (held > cfg.memory_ceiling && !c.bulk.empty())
+        {
+            if (!c.spilled)
+                c.spilled = make_unique<SpillLog>(cfg.spill_dir);
+            const vector<char> &frame = *c.bulk.front();
+            if (!c.spilled->append(frame.data(), frame.size()))
+                break; // no room on disk either: keep it in memory
+            held -= frame.size();
+            c.bulk.pop_front();
+            if (!c.spilling)
+            {
+                c.spilling = true;
+                session.log(LogKind::Warning, "[Spill] more than " + to_string(cfg.memory_ceiling >> 20) + " MB queued for " +
+                                                  c.addr + "; the oldest frames wait on disk");
+            }
+        }
+    }
+
+    // Writes as much of the outbox as the socket takes, several frames per
+    // sendmsg. Returns false if the connection failed.
+    bool flush(StreamConn &c)
+    {
+        const int MAX_IOV = 64;
+        while (true)
+        {
+            promote_bulk(c);
+            if (c.outbox.empty())
+                break;
+            iovec iov[MAX_IOV];
+            int cnt = 0;
+            size_t skip = c.out_off;
+            for (auto it = c.outbox.begin(); it != c.outbox.end() && cnt < MAX_IOV; ++it, skip = 0)
+            {
+                iov[cnt].iov_base = (char *)(*it)->data() + skip;
+                iov[cnt].iov_len = (*it)->size() - skip;
+                cnt++;
+            }
+
+            // sendmsg rather than writev: MSG_NOSIGNAL keeps a closed peer
+            // from raising SIGPIPE in the embedding process
+            msghdr mh{};
+            mh.msg_iov = iov;
+            mh.msg_iovlen = cnt;
+            ssize_t w = sendmsg(c.fd, &mh, MSG_NOSIGNAL);
+            if (w == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    set_events(c, true);
+                    return true;
+                }
+                return false;
+            }
+
+            size_t done = c.out_off + w;
+            while (!c.outbox.empty() && done >= c.outbox.front()->size())
+            {
+                done -= c.outbox.front()->size();
+                c.outbox.pop_front();
+            }
+            c.out_off = done;
+        }
+        set_events(c, false);
+        return true;
+    }
+
+    void close_conn(StreamConn &c)
+    {
+        if (c.fd != -1)
+        {
+            epoll_ctl(ep, EPOLL_CTL_DEL, c.fd, nullptr);
+            close(c.fd);
+            c.fd = -1;
+        }
+        if (!c.outbound)
+        {
+            c.dead = true;
+            return;
+        }
+        if (c.connected)
+            session.log(LogKind::Warning, "Lost connection to " + c.addr + "; retrying");
+        else
+            c.failed_dials++; // refused after connecting began: try the next address
+        // keep queued frames; a partly written one is resent whole after redial
+        c.connected = false;
+        c.want_out = false;
+        c.out_off = 0;
+        c.peer_caps = 0;
+        c.offered.clear();
+        c.acked_dicts.clear();
+        c.in.clear();
+        c.in_off = 0;
+        c.retry_at = time(nullptr) + 1;
+    }
+
+    void dial(StreamConn &c)
+    {
+        c.fd = stream_open(kind, c.addr, false, c.failed_dials);
+        if (c.fd == -1)
+        {
+            c.retry_at = time(nullptr) + 1;
+            return;
+        }
+        c.want_out = true; // connect completion is reported as writable
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.ptr = &c;
+        epoll_ctl(ep, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    // Handles one complete frame; returns false to drop the connection.
+    bool handle_frame(StreamConn &c, const BatchHeader &hdr, const char *payload)
+    {
+        if (hdr.flags & FRAME_HELLO)
+        {
+            HelloPayload h;
+            if (hdr.payload_len < sizeof(h))
+                return false;
+            memcpy(&h, payload, sizeof(h));
+            string doc(hdr.doc, strnlen(hdr.doc, sizeof(hdr.doc)));
+            c.peer_id = string(h.user_id, strnlen(h.user_id, sizeof(h.user_id)));
+            if (c.outbound)
+            {
+                // ack to one of our hellos: now we know what this peer can decode
+                if (doc.empty())
+                    c.peer_caps = h.caps;
+                else
+                    c.acked_dicts[doc] = h.dict_id;
+                return true;
+            }
+            if (doc.empty())
+            {
+                session.log(LogKind::Notice, "Peer connected: " + c.peer_id);
+                c.outbox.push_back(build_hello("", 0));
+                return flush(c);
+            }
+
+            // the peer's dictionary for one document; only open ones are kept
+            uint32_t accepted = 0;
+            if (session.config().compress && session.find(doc) && h.dict_size && h.dict_size <= DICT_MAX_BYTES &&
+                sizeof(h) + h.dict_size == hdr.payload_len)
+            {
+                WireDict &dict = c.peer_dicts[doc];
+                dict.bytes.assign(payload + sizeof(h), payload + sizeof(h) + h.dict_size);
+                dict.id = accepted = h.dict_id;
+            }
+            c.outbox.push_back(build_hello(doc, accepted));
+            return flush(c);
+        }
+
+        if (hdr.flags & FRAME_TEXT)
+        {
+            session.deliver_text(hdr, payload, hdr.payload_len);
+            return true;
+        }
+        vector<UpdateObject> batch;
+        auto dict = c.peer_dicts.find(string(hdr.doc, strnlen(hdr.doc, sizeof(hdr.doc))));
+        if (!decode_batch(hdr, payload, hdr.payload_len, batch, dict == c.peer_dicts.end() ? nullptr : &dict->second))
+        {
+            session.log(LogKind::Warning, "Dropped undecodable batch from " + c.peer_id);
+            return true;
+        }
+        session.deliver(hdr, batch);
+        return true;
+    }
+
+    // Reads what is available and dispatches every complete frame.
+    bool read_conn(StreamConn &c)
+    {
+        char buf[64 * 1024];
+        bool eof = false;
+        size_t taken = 0; // the rest waits for the next epoll_wait
+        while (!eof && taken < STREAM_READ_BYTES)
+        {
+            ssize_t n = read(c.fd, buf, sizeof(buf));
+            if (n > 0)
+            {
+                c.in.insert(c.in.end(), buf, buf + n);
+                taken += n;
+            }
+            else if (n == 0)
+                eof = true; // still dispatch what arrived before the close
+            else if (errno == EINTR)
+                continue;
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            else
+                return false;
+        }
+
+        while (c.in.size() - c.in_off >= sizeof(BatchHeader))
+        {
+            BatchHeader hdr;
+            memcpy(&hdr, c.in.data() + c.in_off, sizeof(hdr));
+            if (hdr.magic != BATCH_MAGIC || hdr.payload_len > MAX_FRAME_BYTES)
+                return false;
+            if (c.in.size() - c.in_off < sizeof(hdr) + hdr.payload_len)
+                break;
+            if (!handle_frame(c, hdr, c.in.data() + c.in_off + sizeof(hdr)))
+                return false;
+            c.in_off += sizeof(hdr) + hdr.payload_len;
+        }
+        if (c.in_off == c.in.size())
+        {
+            c.in.clear();
+            c.in_off = 0;
+        }
+        else if (c.in_off > sizeof(buf))
+        {
+            c.in.erase(c.in.begin(), c.in.begin() + c.in_off);
+            c.in_off = 0;
+        }
+        return !eof;
+    }
+
+    // Takes every queued batch and appends one frame per batch to each peer
+    // (to its bulk queue for bulk ones, any behind them, and any for a peer
+    // that is offline), compressed for peers whose ack accepted our
+    // dictionary of the batch's document. The first batch of a document a
+    // connected peer gets offers it that dictionary.
+    void drain_mailbox()
+    {
+        auto taken = cow_take(mailbox);
+        for (auto &out : *taken)
+        {
+            if (out.text)
+            {
+                for (auto &c : peers)
+                    c->bulk.push_back(out.text);
+                continue;
+            }
+            shared_ptr<const WireDict> dict = session.wire_dict(out.doc);
+            BatchEncoder enc(out.doc, out.ops.data(), out.ops.size(), dict.get(), out.lane);
+            for (auto &c : peers)
+            {
+                if (dict && c->connected && c->offered[out.doc] != dict->id)
+                {
+                    c->offered[out.doc] = dict->id;
+                    c->outbox.push_back(build_hello(out.doc, dict->id, dict.get()));
+                }
+                auto acked = c->acked_dicts.find(out.doc);
+                bool compress = dict && c->connected && (c->peer_caps & CAP_COMPRESS) &&
+                                acked != c->acked_dicts.end() && acked->second == dict->id;
+                bool waiting = !c->bulk.empty() || (c->spilled && !c->spilled->empty());
+                (out.lane == LANE_BULK || !c->connected || waiting ? c->bulk : c->outbox)
+                    .push_back(enc.frame_for(compress));
+            }
+            log_packed(session, enc);
+        }
+        for (auto &c : peers)
+        {
+            if (c->connected && !flush(*c))
+                close_conn(*c);
+            spill_over(*c);
+        }
+    }
+
+    // The most any connected peer has queued and not yet written.
+    void update_backlog()
+    {
+        size_t most = 0;
+        for (auto &c : peers)
+        {
+            if (!c->connected)
+                continue;
+            size_t bytes = 0;
+            for (auto &frame : c->outbox)
+                bytes += frame->size();
+            for (auto &frame : c->bulk)
+                bytes += frame->size();
+            if (c->spilled)
+                bytes += c->spilled->bytes();
+            most = max(most, bytes - min(bytes, c->out_off));
+        }
+        backlog.store(most);
+    }
+
+    void event_loop()
+    {
+        epoll_event events[64];
+        while (!stopping.load())
+        {
+            int n = epoll_wait(ep, events, 64, 200);
+            for (int i = 0; i < n; ++i)
+            {
+                void *tag = events[i].data.ptr;
+                if (tag == &listen_marker)
+                {
+                    int cfd;
+                    while ((cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+                    {
+                        int one = 1;
+                        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                        inbound.push_back(make_unique<StreamConn>());
+                        inbound.back()->fd = cfd;
+                        epoll_event cev{};
+                        cev.events = EPOLLIN | EPOLLRDHUP;
+                        cev.data.ptr = inbound.back().get();
+                        epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &cev);
+                    }
+                    continue;
+                }
+                if (tag == &wake_marker)
+                {
+                    uint64_t count;
+                    while (read(wakeup_fd, &count, sizeof(count)) > 0)
+                        ;
+                    drain_mailbox();
+                    continue;
+                }
+
+                StreamConn &c = *(StreamConn *)tag;
+                if (c.fd == -1)
+                    continue;
+                uint32_t e = events[i].events;
+                if (c.outbound && !c.connected && (e & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+                {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err || (e & (EPOLLERR | EPOLLHUP)))
+                    {
+                        close_conn(c);
+                        continue;
+                    }
+                    c.connected = true;
+                    c.failed_dials = 0;
+                    session.log(LogKind::Notice, "Connected to " + c.addr);
+                    c.outbox.push_front(build_hello("", 0));
+                }
+                bool ok = true;
+                if (e & (EPOLLERR | EPOLLHUP))
+                    ok = false;
+                if (ok && (e & (EPOLLIN | EPOLLRDHUP)))
+                    ok = read_conn(c);
+                if (ok && (c.connected || !c.outbound))
+                    ok = flush(c);
+                if (!ok)
+                    close_conn(c);
+            }
+
+            inbound.erase(remove_if(inbound.begin(), inbound.end(),
+                                    [](const unique_ptr<StreamConn> &c) { return c->dead; }),
+                          inbound.end());
+            update_backlog();
+            time_t now = time(nullptr);
+            for (auto &c : peers)
+                if (c->fd == -1 && now >= c->retry_at)
+                    dial(*c);
+        }
+    }
+
+    Session &session;
+    TransportKind kind;
+    shared_ptr<vector<OutgoingBatch>> mailbox = make_shared<vector<OutgoingBatch>>();
+    atomic<size_t> backlog{0}; // see update_backlog
+    int wakeup_fd = -1, ep = -1, lfd = -1;
+    StreamConn listen_marker, wake_marker;
+    vector<unique_ptr<StreamConn>> peers, inbound; // event loop thread only
+    thread loop_thread;
+    atomic<bool> stopping{false};
+};
+
+unique_ptr<Transport> make_stream_transport(Session &session)
+{
+    return make_unique<StreamTransport>(session);
+}
+
+} // namespace synctext
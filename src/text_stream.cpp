@@ -0,0 +1,138 @@
+#include "synctext/text_stream.h"
+
+#include <cstring>
+
+#include "synctext/codec.h"
+#include "synctext/line_index.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+shared_ptr<const vector<char>> build_text_frame(const string &doc, const string &user_id, const OpText &text,
+                                                size_t &offset)
+{
+    size_t len = min(STREAM_CHUNK_BYTES, text.text.size() - offset);
+    TextChunk chunk{};
+    strncpy(chunk.user_id, user_id.c_str(), sizeof(chunk.user_id)-1);
+    chunk.seq = text.seq;
+    chunk.total = text.text.size();
+    chunk.offset = offset;
+
+    vector<char> payload(sizeof(chunk) + len);
+    memcpy(payload.data(), &chunk, sizeof(chunk));
+    memcpy(payload.data() + sizeof(chunk), text.text.data() + offset, len);
+    offset += len;
+    return share_frame(build_frame(doc, payload.data(), payload.size(), 0, 0, FRAME_TEXT | FRAME_BULK));
+}
+
+// -------------------- Text Assembly --------------------
+uint64_t TextAssembly::key(const UpdateObject &u)
+{
+    return key(site_id(string(u.user_id, strnlen(u.user_id, sizeof(u.user_id)))), u.seq);
+}
+
+vector<UpdateObject> TextAssembly::add(uint32_t site, const TextChunk &chunk, const char *data, size_t len)
+{
+    lock_guard<mutex> lock(m);
+    Stream &s = streams[key(site, chunk.seq)];
+    if (s.text.empty() && s.total == 0)
+    {
+        s.total = chunk.total;
+        s.text.reserve(s.total);
+        reserved.set(reserved.bytes() + s.text.capacity());
+    }
+    if (chunk.total != s.total || chunk.offset != s.text.size() || len > s.total - s.text.size())
+        return {};
+    s.text.append(data, len);
+    if (s.text.size() < s.total)
+        return {};
+    return std::move(s.held);
+}
+
+bool TextAssembly::admit(const UpdateObject &u)
+{
+    if (u.new_len == 0)
+        return true;
+    lock_guard<mutex> lock(m);
+    Stream &s = streams[key(u)];
+    if (s.total == 0)
+    {
+        s.total = u.new_len;
+        s.text.reserve(s.total);
+        reserved.set(reserved.bytes() + s.text.capacity());
+    }
+    if (s.text.size() == s.total)
+        return true;
+    s.held.push_back(u);
+    return false;
+}
+
+const string *TextAssembly::find(const UpdateObject &u) const
+{
+    lock_guard<mutex> lock(m);
+    auto it = streams.find(key(u));
+    if (it == streams.end() || it->second.text.size() != it->second.total)
+        return nullptr;
+    return &it->second.text; // complete texts are not touched again until dropped
+}
+
+string TextAssembly::take(const UpdateObject &u)
+{
+    lock_guard<mutex> lock(m);
+    auto it = streams.find(key(u));
+    if (it == streams.end() || it->second.text.size() != it->second.total)
+        return {};
+    release(it->second);
+    string text = std::move(it->second.text);
+    streams.erase(it);
+    return text;
+}
+
+void TextAssembly::drop(const UpdateObject &u)
+{
+    if (u.new_len == 0)
+        return;
+    lock_guard<mutex> lock(m);
+    auto it = streams.find(key(u));
+    if (it == streams.end())
+        return;
+    release(it->second);
+    streams.erase(it);
+}
+
+VersionVector TextAssembly::hold_back(VersionVector seen) const
+{
+    lock_guard<mutex> lock(m);
+    for (auto &kv : streams)
+    {
+        auto it = seen.find((uint32_t)(kv.first >> 32));
+        if (it == seen.end())
+            continue;
+        for (auto &u : kv.second.held)
+            if (u.seq > 0 && u.seq <= it->second)
+                it->second = u.seq - 1;
+    }
+    return seen;
+}
+
+size_t TextAssembly::pending() const
+{
+    lock_guard<mutex> lock(m);
+    size_t n = 0;
+    for (auto &kv : streams)
+        n += kv.second.text.size() < kv.second.total;
+    return n;
+}
+
+size_t TextAssembly::bytes() const
+{
+    lock_guard<mutex> lock(m);
+    size_t n = 0;
+    for (auto &kv : streams)
+        n += kv.second.text.capacity();
+    return n;
+}
+
+} // namespace synctext
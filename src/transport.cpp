@@ -0,0 +1,30 @@
+#include "transports.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+unique_ptr<Transport> make_transport(Session &session)
+{
+    switch (session.config().transport)
+    {
+    case TRANSPORT_TCP:
+    case TRANSPORT_UNIX:
+        return make_stream_transport(session);
+    case TRANSPORT_SEQPACKET:
+        return make_seqpacket_transport(session);
+    case TRANSPORT_FIFO:
+    default:
+        return make_fifo_transport(session);
+    }
+}
+
+void log_packed(Session &session, const BatchEncoder &enc)
+{
+    if (enc.packed_frame)
+        session.log(LogKind::Notice, "[Compressed batch] " + to_string(enc.raw_len) + " → " +
+                                         to_string(enc.packed_frame->size()) + " bytes");
+}
+
+} // namespace synctext
@@ -0,0 +1,20 @@
+// Concrete transports behind make_transport(); not part of the public API.
+#pragma once
+
+#include <memory>
+
+#include "synctext/codec.h"
+#include "synctext/session.h"
+#include "synctext/transport.h"
+
+namespace synctext
+{
+
+std::unique_ptr<Transport> make_fifo_transport(Session &session);
+std::unique_ptr<Transport> make_stream_transport(Session &session);
+std::unique_ptr<Transport> make_seqpacket_transport(Session &session);
+
+// Reports a batch the encoder managed to compress.
+void log_packed(Session &session, const BatchEncoder &enc);
+
+} // namespace synctext
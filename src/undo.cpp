@@ -0,0 +1,193 @@
+#include "synctext/undo.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "synctext/merge.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Undo History --------------------
+size_t UndoEdit::bytes() const
+{
+    size_t n = ops.size() * sizeof(UpdateObject);
+    for (auto *texts : {&old_text, &new_text})
+        for (auto &t : *texts)
+            n += t.text.size();
+    return n;
+}
+
+UndoHistory::UndoHistory()
+{
+    done.slots.resize(UNDO_DEPTH);
+    undone.slots.resize(UNDO_DEPTH);
+}
+
+void UndoHistory::record(UndoEdit edit)
+{
+    undone.clear();
+    done.push(std::move(edit));
+}
+
+void UndoHistory::Ring::push(UndoEdit edit)
+{
+    if (edit.ops.empty())
+        return;
+    if (edit.ops.size() > UNDO_MAX_OPS)
+    {
+        clear(); // can't keep it, so nothing before it can be undone either
+        return;
+    }
+    while (count > 0 && (count == slots.size() || ops + edit.ops.size() > UNDO_MAX_OPS))
+        drop_oldest();
+    ops += edit.ops.size();
+    held.set(held.bytes() + edit.bytes());
+    slots[(head + count) % slots.size()] = std::move(edit);
+    count++;
+}
+
+UndoEdit UndoHistory::Ring::pop()
+{
+    if (count == 0)
+        return {};
+    count--;
+    UndoEdit edit = std::move(slots[(head + count) % slots.size()]);
+    ops -= edit.ops.size();
+    held.set(held.bytes() - edit.bytes());
+    return edit;
+}
+
+void UndoHistory::Ring::drop_oldest()
+{
+    ops -= slots[head].ops.size();
+    held.set(held.bytes() - slots[head].bytes());
+    slots[head] = UndoEdit();
+    head = (head + 1) % slots.size();
+    count--;
+}
+
+void UndoHistory::Ring::clear()
+{
+    while (count > 0)
+        drop_oldest();
+}
+
+// -------------------- Inverse Ops --------------------
+static bool is_op(const UpdateObject &u, const char *type)
+{
+    return strncmp(u.op_type, type, sizeof(u.op_type)) == 0;
+}
+
+static string content(const char *field, size_t size)
+{
+    return string(field, strnlen(field, size));
+}
+
+// The whole old or new text of u: its field, or what texts keeps for it
+// when the field cut it short. Null if that was not kept.
+static const string *text_of(const char *field, size_t size, uint32_t len, const vector<OpText> &texts,
+                             uint32_t seq, string &scratch)
+{
+    if (len == 0)
+        return &(scratch = content(field, size));
+    for (auto &t : texts)
+        if (t.seq == seq && t.text.size() == len)
+            return &t.text;
+    return nullptr;
+}
+
+// Column where text now sits in line, nearest to col; -1 if it is gone.
+static long find_near(const string &line, const string &text, int col)
+{
+    if (text.empty())
+        return min(max(col, 0), (int)line.size());
+    long best = -1;
+    for (size_t at = line.find(text); at != string::npos; at = line.find(text, at + 1))
+        if (best < 0 || labs((long)at - col) < labs(best - col))
+            best = at;
+    return best;
+}
+
+UndoEdit invert_edit(const UndoEdit &edit, vector<string> &doc, LineIndex &index, uint32_t site,
+                     const string &user_id, ColumnUnit unit)
+{
+    // last op first: later ops of an edit may build on earlier ones
+    UndoEdit out;
+    string old_scratch, new_scratch;
+    for (auto it = edit.ops.rbegin(); it != edit.ops.rend(); ++it)
+    {
+        const UpdateObject &u = *it;
+        UpdateObject inv{};
+        const string *old_text =
+            text_of(u.old_content, sizeof(u.old_content), u.old_len, edit.old_text, u.seq, old_scratch);
+        const string *new_text =
+            text_of(u.new_content, sizeof(u.new_content), u.new_len, edit.new_text, u.seq, new_scratch);
+        if (is_op(u, "insert"))
+        {
+            long pos = index.position(u.line_id);
+            if (pos < 0 || pos >= (long)doc.size())
+                continue; // someone deleted it already
+            inv.line_id = u.line_id;
+            inv.after = index.visible_before(u.line_id);
+            set_text(inv.old_content, inv.old_len, doc[pos]);
+            stamp(inv, "delete", pos, user_id);
+            inv.seq = index.next_id(site).seq;
+            index.changed(inv.line_id, {site, inv.seq});
+            if (inv.old_len)
+                out.old_text.push_back({inv.seq, doc[pos]});
+            index.erase(inv.line_id, {site, inv.seq});
+            doc.erase(doc.begin() + pos);
+        }
+        else if (!old_text || !new_text)
+            continue; // its text was cut short and not kept, so the op can't restore it
+        else if (is_op(u, "delete"))
+        {
+            // a tombstone keeps its place; a collected one falls back to
+            // the line it followed
+            inv.after = index.contains(u.line_id) ? index.visible_before(u.line_id)
+                        : index.position(u.after) >= 0 ? u.after
+                                                      : DOC_START;
+            inv.line_id = index.next_id(site);
+            inv.seq = inv.line_id.seq;
+            set_text(inv.new_content, inv.new_len, *old_text);
+            if (inv.new_len)
+                out.new_text.push_back({inv.seq, *old_text});
+            long pos = index.insert(inv.after, inv.line_id);
+            stamp(inv, "insert", pos, user_id);
+            doc.insert(doc.begin() + min((size_t)pos, doc.size()), *old_text);
+        }
+        else
+        {
+            long pos = index.position(u.line_id);
+            if (pos < 0 || pos >= (long)doc.size())
+                continue;
+            string &line = doc[pos];
+            const string &was = *old_text, &now = *new_text;
+            ColumnTable cols(line, unit);
+            long col = find_near(line, now, cols.to_byte(u.start_col));
+            if (col < 0)
+                continue; // rewritten since
+            inv.line_id = u.line_id;
+            inv.start_col = cols.to_col(col);
+            inv.end_col = inv.start_col + max(column_width(was, unit), column_width(now, unit));
+            set_text(inv.old_content, inv.old_len, now);
+            set_text(inv.new_content, inv.new_len, was);
+            stamp(inv, "replace", pos, user_id);
+            inv.seq = index.next_id(site).seq;
+            index.changed(inv.line_id, {site, inv.seq});
+            if (inv.old_len)
+                out.old_text.push_back({inv.seq, now});
+            if (inv.new_len)
+                out.new_text.push_back({inv.seq, was});
+            line.replace(col, now.size(), was);
+        }
+        out.ops.push_back(inv);
+    }
+    return out;
+}
+
+} // namespace synctext
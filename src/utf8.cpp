@@ -0,0 +1,190 @@
+#include "synctext/utf8.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace synctext
+{
+
+// -------------------- Decoding --------------------
+// Bytes in the ASCII run at the start of p.
+static size_t ascii_run(const unsigned char *p, size_t n)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+    {
+        int high = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i)));
+        if (high)
+            return i + __builtin_ctz(high);
+    }
+#else
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        if (word & 0x8080808080808080ull)
+            break;
+    }
+#endif
+    while (i < n && p[i] < 0x80)
+        i++;
+    return i;
+}
+
+// Length of the well-formed sequence at p, or 0 if there is none.
+static size_t sequence_length(const unsigned char *p, size_t n)
+{
+    unsigned char c = p[0];
+    if (c < 0x80)
+        return 1;
+    auto cont = [&](size_t i) { return i < n && (p[i] & 0xc0) == 0x80; };
+    if (c >= 0xc2 && c <= 0xdf)
+        return cont(1) ? 2 : 0;
+    if (c >= 0xe0 && c <= 0xef)
+    {
+        if (!cont(1) || !cont(2))
+            return 0;
+        if ((c == 0xe0 && p[1] < 0xa0) || (c == 0xed && p[1] > 0x9f)) // overlong, surrogate
+            return 0;
+        return 3;
+    }
+    if (c >= 0xf0 && c <= 0xf4)
+    {
+        if (!cont(1) || !cont(2) || !cont(3))
+            return 0;
+        if ((c == 0xf0 && p[1] < 0x90) || (c == 0xf4 && p[1] > 0x8f)) // overlong, past U+10FFFF
+            return 0;
+        return 4;
+    }
+    return 0;
+}
+
+bool utf8_valid(const char *s, size_t n)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    size_t i = 0;
+    while (i < n)
+    {
+        i += ascii_run(p + i, n - i);
+        if (i == n)
+            break;
+        size_t len = sequence_length(p + i, n - i);
+        if (len == 0)
+            return false;
+        i += len;
+    }
+    return true;
+}
+
+size_t utf8_fit(const char *s, size_t n, size_t max)
+{
+    if (n <= max)
+        return n;
+    // back up over continuation bytes to the start of the cut character;
+    // malformed text is cut anywhere
+    auto cont = [&](size_t i) { return ((unsigned char)s[i] & 0xc0) == 0x80; };
+    size_t end = max;
+    for (int back = 0; back < 3 && end > 0 && cont(end); ++back)
+        end--;
+    if (cont(end))
+        return max;
+    size_t len = sequence_length((const unsigned char *)s + end, n - end);
+    return len == 0 || end + len <= max ? max : end;
+}
+
+// Columns and bytes of the character at p; malformed bytes stand alone.
+static size_t step(const unsigned char *p, size_t n, ColumnUnit unit, size_t &cols)
+{
+    size_t len = sequence_length(p, n);
+    if (len == 0)
+        len = 1;
+    cols = unit == COLUMNS_BYTES ? len : unit == COLUMNS_UTF16 && len == 4 ? 2 : 1;
+    return len;
+}
+
+size_t column_width(const char *s, size_t n, ColumnUnit unit)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    size_t width = 0, i = 0;
+    while (i < n)
+    {
+        size_t ascii = ascii_run(p + i, n - i);
+        width += ascii;
+        i += ascii;
+        if (i == n)
+            break;
+        size_t cols;
+        i += step(p + i, n - i, unit, cols);
+        width += cols;
+    }
+    return width;
+}
+
+// -------------------- Column Table --------------------
+ColumnTable::ColumnTable(const string &line, ColumnUnit unit) : bytes(line.size())
+{
+    if (unit == COLUMNS_BYTES)
+        return;
+    const unsigned char *p = (const unsigned char *)line.data();
+    size_t i = ascii_run(p, bytes);
+    if (i == bytes)
+        return;
+
+    identity = false;
+    columns.reserve(bytes + 1);
+    for (size_t b = 0; b < i; ++b)
+    {
+        starts.push_back(b);
+        columns.push_back(b);
+    }
+    while (i < bytes)
+    {
+        size_t cols, len = step(p + i, bytes - i, unit, cols);
+        for (size_t k = 0; k < cols; ++k)
+            starts.push_back(i);
+        for (size_t k = 0; k < len; ++k)
+            columns.push_back(starts.size() - cols);
+        i += len;
+    }
+    starts.push_back(bytes);
+    columns.push_back(starts.size() - 1);
+}
+
+size_t ColumnTable::to_byte(size_t col) const
+{
+    if (identity)
+        return col < bytes ? col : bytes;
+    return col < starts.size() ? starts[col] : bytes;
+}
+
+size_t ColumnTable::to_col(size_t byte) const
+{
+    if (identity)
+        return byte < bytes ? byte : bytes;
+    return byte < columns.size() ? columns[byte] : columns.back();
+}
+
+// -------------------- Column Cache --------------------
+void ColumnCache::reset(ColumnUnit unit)
+{
+    columns = unit;
+    tables.clear();
+}
+
+const ColumnTable &ColumnCache::table(LineId id, const string &line)
+{
+    auto it = tables.find(key(id));
+    if (it != tables.end() && it->second.length() == line.size())
+        return it->second;
+    if (tables.size() >= COLUMN_CACHE_LINES)
+        tables.clear();
+    return tables[key(id)] = ColumnTable(line, columns);
+}
+
+} // namespace synctext
@@ -0,0 +1,284 @@
+#include "synctext/versions.h"
+
+#include <algorithm>
+
+#include "synctext/merge.h"
+
+using namespace std;
+
+namespace synctext
+{
+
+// Edits above which commit stops looking for the lines two versions share
+// and splices the whole changed middle.
+static const int MAX_SHARE_EDITS = 2048;
+
+// -------------------- Line Tree --------------------
+// Joins pick the root with probability proportional to subtree size, which
+// keeps the expected depth O(log n) without storing priorities.
+static uint32_t next_random()
+{
+    thread_local uint32_t state = 0x9e3779b9;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+LineTree::Ptr LineTree::make(string_view line, Ptr left, Ptr right)
+{
+    size_t size = 1 + size_of(left) + size_of(right);
+    return allocate_shared<Node>(TaggedAllocator<Node, MEM_DOCUMENT>(),
+                                 Node{Line(line), size, std::move(left), std::move(right)});
+}
+
+LineTree::Ptr LineTree::build(const vector<string> &lines, size_t lo, size_t hi)
+{
+    if (lo >= hi)
+        return nullptr;
+    size_t mid = lo + (hi - lo) / 2;
+    return make(lines[mid], build(lines, lo, mid), build(lines, mid + 1, hi));
+}
+
+LineTree LineTree::build(const vector<string> &lines)
+{
+    return LineTree(build(lines, 0, lines.size()));
+}
+
+LineTree::Ptr LineTree::join(const Ptr &a, const Ptr &b)
+{
+    if (!a || !b)
+        return a ? a : b;
+    if (next_random() % (a->size + b->size) < a->size)
+        return make(a->line, a->left, join(a->right, b));
+    return make(b->line, join(a, b->left), b->right);
+}
+
+void LineTree::split(const Ptr &t, size_t k, Ptr &a, Ptr &b)
+{
+    if (!t)
+    {
+        a = b = nullptr;
+        return;
+    }
+    if (size_of(t->left) < k)
+    {
+        Ptr right;
+        split(t->right, k - size_of(t->left) - 1, right, b);
+        a = make(t->line, t->left, right);
+    }
+    else
+    {
+        Ptr left;
+        split(t->left, k, a, left);
+        b = make(t->line, left, t->right);
+    }
+}
+
+size_t LineTree::size() const
+{
+    return size_of(root);
+}
+
+string_view LineTree::at(size_t pos) const
+{
+    const Node *n = root.get();
+    while (true)
+    {
+        size_t left = size_of(n->left);
+        if (pos < left)
+            n = n->left.get();
+        else if (pos == left)
+            return n->line;
+        else
+        {
+            pos -= left + 1;
+            n = n->right.get();
+        }
+    }
+}
+
+vector<string> LineTree::lines(size_t pos, size_t count) const
+{
+    vector<string> out;
+    out.reserve(min(count, size() - min(pos, size())));
+    // the path down to pos, keeping the nodes still to come in order
+    vector<const Node *> stack;
+    for (const Node *n = root.get(); n;)
+    {
+        size_t left = size_of(n->left);
+        if (pos <= left)
+        {
+            stack.push_back(n);
+            if (pos == left)
+                break;
+            n = n->left.get();
+        }
+        else
+        {
+            pos -= left + 1;
+            n = n->right.get();
+        }
+    }
+    while (out.size() < count && !stack.empty())
+    {
+        const Node *n = stack.back();
+        stack.pop_back();
+        out.emplace_back(n->line.data(), n->line.size());
+        for (n = n->right.get(); n; n = n->left.get())
+            stack.push_back(n);
+    }
+    return out;
+}
+
+LineTree LineTree::splice(size_t pos, size_t count, const vector<string> &with) const
+{
+    Ptr a, rest, gone, b;
+    split(root, pos, a, rest);
+    split(rest, count, gone, b);
+    return LineTree(join(join(a, build(with, 0, with.size())), b));
+}
+
+// -------------------- Changed Lines --------------------
+void ChangedLines::insert(size_t pos)
+{
+    if (!any)
+    {
+        any = true;
+        first = pos;
+        end = pos + 1;
+        return;
+    }
+    end = pos <= end ? end + 1 : pos + 1;
+    first = min(first, pos);
+}
+
+void ChangedLines::erase(size_t pos)
+{
+    if (!any)
+    {
+        any = true;
+        first = end = pos;
+        return;
+    }
+    end = pos < end ? end - 1 : pos;
+    first = min(first, pos);
+}
+
+void ChangedLines::replace(size_t pos)
+{
+    if (!any)
+    {
+        any = true;
+        first = pos;
+        end = pos + 1;
+        return;
+    }
+    first = min(first, pos);
+    end = max(end, pos + 1);
+}
+
+// -------------------- Version Log --------------------
+void VersionLog::reset(const vector<string> &lines, long long time_ms, size_t keep_versions)
+{
+    lock_guard<mutex> lock(m);
+    keep = keep_versions;
+    kept.clear();
+    kept.push_back({0, time_ms, LineTree::build(lines)});
+}
+
+uint64_t VersionLog::commit(const vector<string> &lines, const ChangedLines &changed, long long time_ms)
+{
+    Version head{0, time_ms, {}};
+    {
+        lock_guard<mutex> lock(m);
+        if (!kept.empty())
+            head = kept.back();
+    }
+    if (!changed.any)
+        return head.number;
+
+    // the lines outside changed are the latest version's; of those inside,
+    // only the middle between a common prefix and suffix is diffed
+    const LineTree &old_tree = head.lines;
+    size_t old_n = old_tree.size(), new_n = lines.size();
+    size_t first = min(changed.first, new_n), end = max(first, min(changed.end, new_n));
+    if (first + (new_n - end) > old_n) // not what the latest version was edited into
+        first = 0, end = new_n;
+    size_t tail = new_n - end;
+    vector<string> old_mid = old_tree.lines(first, old_n - tail - first);
+    vector<string> new_mid(lines.begin() + first, lines.begin() + end);
+    size_t prefix = 0;
+    while (prefix < old_mid.size() && prefix < new_mid.size() && old_mid[prefix] == new_mid[prefix])
+        prefix++;
+    size_t suffix = 0;
+    while (suffix < old_mid.size() - prefix && suffix < new_mid.size() - prefix &&
+           old_mid[old_mid.size() - 1 - suffix] == new_mid[new_mid.size() - 1 - suffix])
+        suffix++;
+    if (prefix == old_mid.size() && prefix == new_mid.size())
+        return head.number;
+    old_mid.erase(old_mid.end() - suffix, old_mid.end());
+    old_mid.erase(old_mid.begin(), old_mid.begin() + prefix);
+    new_mid.erase(new_mid.end() - suffix, new_mid.end());
+    new_mid.erase(new_mid.begin(), new_mid.begin() + prefix);
+    first += prefix;
+
+    vector<pair<int, int>> matches;
+    if (!myers_matches(old_mid, new_mid, MAX_SHARE_EDITS, matches))
+        matches.clear();
+    matches.push_back({(int)old_mid.size(), (int)new_mid.size()});
+
+    // hunks left to right: positions before the hunk already match lines
+    LineTree tree = old_tree;
+    int i = 0, j = 0;
+    for (auto &match : matches)
+    {
+        if (match.first > i || match.second > j)
+            tree = tree.splice(first + j, match.first - i,
+                               vector<string>(new_mid.begin() + j, new_mid.begin() + match.second));
+        i = match.first + 1;
+        j = match.second + 1;
+    }
+
+    lock_guard<mutex> lock(m);
+    kept.push_back({head.number + 1, time_ms, std::move(tree)});
+    if (keep && kept.size() > keep)
+        kept.pop_front();
+    return kept.back().number;
+}
+
+VersionLookup VersionLog::at_version(uint64_t v, Version &out) const
+{
+    lock_guard<mutex> lock(m);
+    if (kept.empty() || v > kept.back().number)
+        return VERSION_UNKNOWN;
+    if (v < kept.front().number)
+        return VERSION_TRIMMED;
+    out = kept[v - kept.front().number];
+    return VERSION_FOUND;
+}
+
+VersionLookup VersionLog::at_time(long long time_ms, Version &out) const
+{
+    lock_guard<mutex> lock(m);
+    auto it = upper_bound(kept.begin(), kept.end(), time_ms,
+                          [](long long t, const Version &v) { return t < v.time_ms; });
+    if (it == kept.begin()) // version 0 is the file as opened: nothing before it
+        return kept.empty() || kept.front().number == 0 ? VERSION_UNKNOWN : VERSION_TRIMMED;
+    out = *--it;
+    return VERSION_FOUND;
+}
+
+uint64_t VersionLog::latest() const
+{
+    lock_guard<mutex> lock(m);
+    return kept.empty() ? 0 : kept.back().number;
+}
+
+size_t VersionLog::retained() const
+{
+    lock_guard<mutex> lock(m);
+    return kept.size();
+}
+
+} // namespace synctext
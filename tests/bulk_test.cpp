@@ -0,0 +1,127 @@
+// Replace-all sent as bulk ops, concurrently with another peer writing the
+// pattern: all three peers must end up with the same document, whatever
+// order the ops reach them in.
+// Run: ./build/synctext_test_bulk (ctest runs it)
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "synctext/merge.h"
+
+using namespace std;
+using namespace synctext;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                   \
+    do                                                                \
+    {                                                                 \
+        if (!(cond))                                                  \
+        {                                                             \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                               \
+        }                                                             \
+    } while (0)
+
+struct Peer
+{
+    string user;
+    uint32_t site;
+    vector<string> doc;
+    LineIndex index;
+    VersionVector seen; // what pack_bulk sends as the base
+
+    Peer(const string &user, const vector<string> &lines) : user(user), site(site_id(user)), doc(lines)
+    {
+        index.reset(lines.size());
+    }
+
+    // Our edit, as the wire carries it.
+    vector<UpdateObject> edit(const vector<string> &after)
+    {
+        vector<UpdateObject> ops = diff_lines(doc, after, index, site, user);
+        doc = after;
+        for (auto &u : ops)
+            witness(seen, site, u.seq);
+        return pack_bulk(ops, doc, index, seen);
+    }
+
+    void receive(const vector<UpdateObject> &wire)
+    {
+        CHECK(merge_updates(doc, index, {}, wire).empty());
+        for (auto &u : wire)
+            witness(seen, site_id(u.user_id), u.seq);
+    }
+};
+
+static bool has_bulk(const vector<UpdateObject> &wire)
+{
+    for (auto &u : wire)
+        if (string(u.op_type) == "bulk")
+            return true;
+    return false;
+}
+
+static vector<string> rename(vector<string> lines, const string &from, const string &to)
+{
+    for (auto &line : lines)
+        for (size_t at = line.find(from); at != string::npos; at = line.find(from, at + to.size()))
+            line.replace(at, from.size(), to);
+    return lines;
+}
+
+// c_first: b gets c's edit before a's replace-all instead of after it.
+static void concurrent_pattern(bool c_first)
+{
+    vector<string> start = {"call foo(0);", "call foo(1);", "plain;", "call foo(2);", "call foo(3);",
+                            "call foo(4);", "call foo(5);", "end;"};
+    Peer a("alice", start), b("bob", start), c("carol", start);
+
+    // a line c wrote that everyone has seen, so a's replace-all covers it
+    vector<string> seen_by_all = start;
+    seen_by_all.insert(seen_by_all.begin() + 5, "call foo(c);");
+    vector<UpdateObject> first = c.edit(seen_by_all);
+    a.receive(first);
+    b.receive(first);
+
+    // then, concurrently: a renames foo everywhere; c inserts a line
+    // holding it and types it into one that had none
+    vector<UpdateObject> from_a = a.edit(rename(a.doc, "foo", "bar"));
+    CHECK(has_bulk(from_a));
+    vector<string> typed = c.doc;
+    typed[2] = "plain foo(9);";
+    typed.insert(typed.begin() + 4, "call foo(new);");
+    vector<UpdateObject> from_c = c.edit(typed);
+
+    if (c_first)
+    {
+        b.receive(from_c);
+        b.receive(from_a);
+    }
+    else
+    {
+        b.receive(from_a);
+        b.receive(from_c);
+    }
+    c.receive(from_a);
+    a.receive(from_c);
+
+    CHECK(a.doc == b.doc);
+    CHECK(a.doc == c.doc);
+    vector<string> expected = {"call bar(0);", "call bar(1);", "plain foo(9);", "call bar(2);", "call foo(new);",
+                               "call bar(3);", "call bar(c);", "call bar(4);", "call bar(5);", "end;"};
+    CHECK(a.doc == expected);
+}
+
+int main()
+{
+    concurrent_pattern(false);
+    concurrent_pattern(true);
+
+    if (failures)
+        fprintf(stderr, "%d check(s) failed\n", failures);
+    else
+        printf("bulk: all checks passed\n");
+    return failures ? 1 : 0;
+}
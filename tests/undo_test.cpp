@@ -0,0 +1,118 @@
+// Undo and redo of edits whose text is too long for an op's fields: the
+// line comes back whole, locally and on a replica merging the ops.
+// Run: ./build/synctext_test_undo (ctest runs it)
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "synctext/merge.h"
+#include "synctext/text_stream.h"
+#include "synctext/undo.h"
+
+using namespace std;
+using namespace synctext;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                   \
+    do                                                                \
+    {                                                                 \
+        if (!(cond))                                                  \
+        {                                                             \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                               \
+        }                                                             \
+    } while (0)
+
+// A peer that merges what the editing site sends, long texts included.
+struct Replica
+{
+    vector<string> doc;
+    LineIndex index;
+    TextAssembly texts;
+
+    explicit Replica(const vector<string> &lines) : doc(lines) { index.reset(lines.size()); }
+
+    void apply(const vector<UpdateObject> &ops, const vector<OpText> &long_text)
+    {
+        vector<UpdateObject> ready;
+        for (auto &u : ops)
+        {
+            for (auto &t : long_text)
+                if (t.seq == u.seq)
+                    for (size_t offset = 0; offset < t.text.size();)
+                    {
+                        auto frame = build_text_frame("doc", u.user_id, t, offset);
+                        TextChunk chunk;
+                        memcpy(&chunk, frame->data() + sizeof(BatchHeader), sizeof(chunk));
+                        const char *data = frame->data() + sizeof(BatchHeader) + sizeof(chunk);
+                        texts.add(site_id(u.user_id), chunk, data, frame->size() - sizeof(BatchHeader) - sizeof(chunk));
+                    }
+            if (texts.admit(u))
+                ready.push_back(u);
+        }
+        LineTracking track;
+        track.texts = &texts;
+        CHECK(merge_updates(doc, index, {}, ready, track).empty());
+    }
+};
+
+// One edit through undo and redo, checking both sides after each step.
+static void round_trip(const vector<string> &before, const vector<string> &after)
+{
+    const string user = "alice";
+    uint32_t site = site_id(user);
+    vector<string> doc = before;
+    LineIndex index;
+    index.reset(doc.size());
+    Replica peer(before);
+    UndoHistory history;
+
+    vector<OpText> long_text, old_text;
+    vector<UpdateObject> ops = diff_lines(doc, after, index, site, user, COLUMNS_BYTES, &long_text, &old_text);
+    doc = after;
+    peer.apply(ops, long_text);
+    CHECK(peer.doc == after);
+    history.record({ops, old_text, long_text});
+
+    UndoEdit undone = invert_edit(history.take_undo(), doc, index, site, user);
+    CHECK(!undone.ops.empty());
+    CHECK(doc == before);
+    peer.apply(undone.ops, undone.new_text);
+    CHECK(peer.doc == before);
+    history.undone_as(undone);
+
+    UndoEdit redone = invert_edit(history.take_redo(), doc, index, site, user);
+    CHECK(!redone.ops.empty());
+    CHECK(doc == after);
+    peer.apply(redone.ops, redone.new_text);
+    CHECK(peer.doc == after);
+    history.redone_as(redone);
+
+    // and back once more, from what redo recorded
+    UndoEdit again = invert_edit(history.take_undo(), doc, index, site, user);
+    CHECK(doc == before);
+    peer.apply(again.ops, again.new_text);
+    CHECK(peer.doc == before);
+}
+
+int main()
+{
+    string long_line;
+    for (int i = 0; long_line.size() < 700; ++i)
+        long_line += "word" + to_string(i) + " ";
+    string accented = long_line + "caf\xc3\xa9 \xe2\x82\xac"; // the cut must not split a character
+
+    round_trip({"first", "last"}, {"first", long_line, "last"});   // insert
+    round_trip({"first", accented, "last"}, {"first", "last"});    // delete
+    round_trip({"first", long_line, "last"}, {"first", "x" + long_line.substr(300) + "y", "last"}); // replace
+    round_trip({"first", "short", "last"}, {"first", accented, "last"});                             // replace
+
+    if (failures)
+        fprintf(stderr, "%d check(s) failed\n", failures);
+    else
+        printf("undo: all checks passed\n");
+    return failures ? 1 : 0;
+}